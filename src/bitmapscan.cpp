@@ -0,0 +1,137 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include "bitmapscan.h"
+#include "exceptions/end_of_file_exception.h"
+
+namespace badgerdb {
+
+// record ids in the order of the file
+static bool ridBefore(const RecordId& a, const RecordId& b)
+{
+  return a.page_number < b.page_number ||
+    (a.page_number == b.page_number && a.slot_number < b.slot_number);
+}
+
+BitmapHeapScan::BitmapHeapScan(const std::string &name, BufMgr *bufferMgr, ScanCursor& cursor)
+{
+  // drain the index scan in batches, the ids come in key order. A cursor that is not scanning,
+  // as tryOpenScan() leaves it when nothing is in range, has no ids to give
+  if (cursor.isExecuting())
+  {
+    const std::size_t batchSize = 1024;
+    std::size_t count;
+    do
+    {
+      std::size_t start = rids.size();
+      rids.resize(start + batchSize);
+      count = cursor.scanNextBatch(&rids[start], batchSize);
+      rids.resize(start + count);
+    } while (count > 0);
+    cursor.endScan();
+  }
+
+  file = new PageFile(name, false);	//dont create new file
+	bufMgr = bufferMgr;
+  sortRids();
+}
+
+BitmapHeapScan::BitmapHeapScan(const std::string &name, BufMgr *bufferMgr, const std::vector<RecordId>& ridList)
+  : rids(ridList)
+{
+  file = new PageFile(name, false);	//dont create new file
+	bufMgr = bufferMgr;
+  sortRids();
+}
+
+BitmapHeapScan::~BitmapHeapScan()
+{
+  if (curPage != NULL)
+  {
+    bufMgr->unPinPage(file, pages[curPageIndex], false);
+    curPage = NULL;
+  }
+  bufMgr->flushFile(file);
+  delete file;
+}
+
+void BitmapHeapScan::sortRids()
+{
+  std::sort(rids.begin(), rids.end(), ridBefore);
+  rids.erase(std::unique(rids.begin(), rids.end()), rids.end());
+
+  for (std::size_t i = 0; i < rids.size(); i++)
+  {
+    if (pages.empty() || pages.back() != rids[i].page_number)
+    {
+      pages.push_back(rids[i].page_number);
+    }
+  }
+
+  nextRid = 0;
+  curPageIndex = 0;
+  prefetchedPages = 0;
+  curPage = NULL;
+}
+
+void BitmapHeapScan::scanNext(RecordId& outRid)
+{
+  if (!tryScanNext(outRid))
+	{
+		throw EndOfFileException();
+	}
+}
+
+bool BitmapHeapScan::tryScanNext(RecordId& outRid)
+{
+  if (nextRid == rids.size())
+  {
+    if (curPage != NULL)
+    {
+      bufMgr->unPinPage(file, pages[curPageIndex], false);
+      curPage = NULL;
+    }
+    return false;
+  }
+
+  // move to the page of the next record, leaving the current one for good
+  if (curPage == NULL || rids[nextRid].page_number != pages[curPageIndex])
+  {
+    if (curPage != NULL)
+    {
+      bufMgr->unPinPage(file, pages[curPageIndex], false);
+      curPageIndex++;
+    }
+
+    // keep the reads of the following pages going while this one is used
+    if (prefetchedPages < std::min(curPageIndex + PREFETCH_PAGES / 2, pages.size()))
+    {
+      std::size_t end = std::min(curPageIndex + PREFETCH_PAGES, pages.size());
+      prefetchedPages = std::max(prefetchedPages, curPageIndex + 1);
+      if (prefetchedPages < end)
+      {
+        bufMgr->prefetchPages(file, &pages[prefetchedPages], end - prefetchedPages);
+        prefetchedPages = end;
+      }
+    }
+
+    bufMgr->readPage(file, pages[curPageIndex], curPage);
+  }
+
+  curRid = rids[nextRid++];
+  outRid = curRid;
+  return true;
+}
+
+// returns the current record, its page is left pinned until the scan moves past it
+std::string BitmapHeapScan::getRecord()
+{
+  return curPage->getRecord(curRid);
+}
+
+}
@@ -0,0 +1,120 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "types.h"
+#include "page.h"
+#include "buffer.h"
+#include "btree.h"
+
+namespace badgerdb {
+
+/**
+ * @brief This class is used to fetch the records of a relation found through an index, one page at a time.
+ *
+ * An index scan returns record ids in key order, which has nothing to do with where the records are in the
+ * relation, so reading the records as the ids come reads the same pages over and over in random order.
+ * This scan collects the record ids first and sorts them by page, then reads every page once, in the order
+ * of the file, and returns all the records it needs from the page before moving to the next one. The pages
+ * ahead of the one being read are prefetched.
+ */
+class BitmapHeapScan
+{
+ public:
+
+  /**
+   * Collects the record ids left in an index scan, which is ended.
+   * @param name			Name of the relation the index is built on
+   * @param bufMgr		Buffer Manager instance
+   * @param cursor		Cursor of the index scan, no records are fetched if it is not scanning
+   */
+  BitmapHeapScan(const std::string &name, BufMgr *bufMgr, ScanCursor& cursor);
+
+  /**
+   * Fetches the records with the given ids.
+   * @param name			Name of the relation the records are in
+   * @param bufMgr		Buffer Manager instance
+   * @param rids			Record ids, in any order
+   */
+  BitmapHeapScan(const std::string &name, BufMgr *bufMgr, const std::vector<RecordId>& rids);
+
+  ~BitmapHeapScan();
+
+  //return RecordId of next record, throws EndOfFileException once every record was returned
+  void scanNext(RecordId& outRid);
+
+  //return RecordId of next record, or false once every record was returned
+  bool tryScanNext(RecordId& outRid);
+
+  //read current record
+  std::string getRecord();
+
+  //return the number of distinct pages the records are on
+  std::size_t numPages() const { return pages.size(); }
+
+ private:
+  /**
+   * Sorts the record ids by page and slot, dropping duplicates, and lists the pages they are on.
+   */
+  void sortRids();
+
+  /**
+   * Number of pages prefetched ahead of the one being read.
+   */
+  static const std::size_t PREFETCH_PAGES = 16;
+
+  /**
+   * File the records are in.
+   */
+  PageFile      *file;
+
+  /**
+   * Buffer Manager instance used to read pages into the buffer pool.
+   */
+	BufMgr				*bufMgr;
+
+  /**
+   * Record ids to fetch, sorted by page and slot.
+   */
+  std::vector<RecordId> rids;
+
+  /**
+   * Distinct pages of the record ids, in order.
+   */
+  std::vector<PageId> pages;
+
+  /**
+   * Index in rids of the next record to return.
+   */
+  std::size_t   nextRid;
+
+  /**
+   * Index in pages of the current page.
+   */
+  std::size_t   curPageIndex;
+
+  /**
+   * Index in pages of the first page not prefetched yet.
+   */
+  std::size_t   prefetchedPages;
+
+  /**
+   * Current page, pinned, NULL before the first record and after the last.
+   */
+  Page*         curPage;
+
+  /**
+   * Record id of the current record.
+   */
+  RecordId      curRid;
+};
+
+}
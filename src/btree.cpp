@@ -5,8 +5,14 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
 #include "btree.h"
 #include "filescan.h"
+#include "external_sort.h"
+#include "node_search.h"
 #include "exceptions/bad_index_info_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/bad_scanrange_exception.h"
@@ -21,6 +27,385 @@
 namespace badgerdb
 {
 
+    // bounds of a scan for each key type
+
+    template <>
+    int& ScanCursor::scanLowVal<int>()
+    {
+        return lowValInt;
+    }
+
+    template <>
+    int& ScanCursor::scanHighVal<int>()
+    {
+        return highValInt;
+    }
+
+    template <>
+    double& ScanCursor::scanLowVal<double>()
+    {
+        return lowValDouble;
+    }
+
+    template <>
+    double& ScanCursor::scanHighVal<double>()
+    {
+        return highValDouble;
+    }
+
+    template <>
+    StringKey& ScanCursor::scanLowVal<StringKey>()
+    {
+        return lowValStringKey;
+    }
+
+    template <>
+    StringKey& ScanCursor::scanHighVal<StringKey>()
+    {
+        return highValStringKey;
+    }
+
+    template <>
+    CompositeKey& ScanCursor::scanLowVal<CompositeKey>()
+    {
+        return lowValCompositeKey;
+    }
+
+    template <>
+    CompositeKey& ScanCursor::scanHighVal<CompositeKey>()
+    {
+        return highValCompositeKey;
+    }
+
+    template <>
+    int& ScanCursor::scanLastKey<int>()
+    {
+        return lastKeyInt;
+    }
+
+    template <>
+    double& ScanCursor::scanLastKey<double>()
+    {
+        return lastKeyDouble;
+    }
+
+    template <>
+    StringKey& ScanCursor::scanLastKey<StringKey>()
+    {
+        return lastKeyStringKey;
+    }
+
+    template <>
+    CompositeKey& ScanCursor::scanLastKey<CompositeKey>()
+    {
+        return lastKeyCompositeKey;
+    }
+
+    // STRING bounds also keep the full strings for the keys that tie with them on their prefix
+
+    template <>
+    void BTreeIndex::setScanBounds<StringKey>(ScanCursor& cursor, const void* lowValParm, const void* highValParm)
+    {
+        cursor.lowValString = (const char*) lowValParm;
+        cursor.highValString = (const char*) highValParm;
+        cursor.lowValStringKey = StringKey::fromString(cursor.lowValString.c_str());
+        cursor.highValStringKey = StringKey::fromString(cursor.highValString.c_str());
+
+        // check for bad scan range
+        if (cursor.highValString < cursor.lowValString)
+        {
+            throw BadScanrangeException();
+        }
+    }
+
+    // comparison of keys, only the sign of the result matters
+
+    template <class T>
+    static inline int compareKeys(const T& key1, const T& key2)
+    {
+        return (key2 < key1) - (key1 < key2);
+    }
+
+    static inline int compareKeys(const StringKey& key1, const StringKey& key2)
+    {
+        return memcmp(key1.bytes, key2.bytes, STRINGKEYSIZE);
+    }
+
+    static inline int compareKeys(const CompositeKey& key1, const CompositeKey& key2)
+    {
+        return memcmp(key1.bytes, key2.bytes, COMPOSITEKEYSIZE);
+    }
+
+    // whether keys that compare equal to this one are equal to it in full
+
+    template <class T>
+    static inline bool isCompleteKey(const T& key)
+    {
+        return true;
+    }
+
+    static inline bool isCompleteKey(const StringKey& key)
+    {
+        return key.isComplete();
+    }
+
+    // order of record ids in posting lists, the order of the records in the relation
+
+    static inline bool ridBefore(const RecordId& a, const RecordId& b)
+    {
+        return a.page_number < b.page_number || (a.page_number == b.page_number && a.slot_number < b.slot_number);
+    }
+
+    // index of the first record id of a posting page that is not before rid
+
+    static inline int postingLowerBound(const PostingPage* posting, const RecordId& rid)
+    {
+        int low = 0;
+        int high = posting->header.numKeys;
+        while (low < high)
+        {
+            int mid = (low + high) / 2;
+            if (ridBefore(posting->ridArray[mid], rid))
+            {
+                low = mid + 1;
+            }
+            else
+            {
+                high = mid;
+            }
+        }
+        return low;
+    }
+
+    // whether a plain entry comes before another one, in the order of key and then record id which the duplicates
+    // of a key are kept in
+
+    template <class T>
+    static inline bool entryBefore(const T& key1, const RecordId& rid1, const T& key2, const RecordId& rid2)
+    {
+        return key1 < key2 || (!(key2 < key1) && ridBefore(rid1, rid2));
+    }
+
+    // index of the first entry of a leaf that comes after a plain entry, where the entry goes if its key has no
+    // posting list in the leaf
+
+    template <class T>
+    static inline int entryUpperBound(const LeafNode<T>* leaf, const int numKeys, const T& key, const RecordId& rid)
+    {
+        int low = searchLowerBound(leaf->keyArray, numKeys, key);
+        int high = low + searchUpperBound(leaf->keyArray + low, numKeys - low, key);
+        while (low < high)
+        {
+            int mid = (low + high) / 2;
+            if (ridBefore(rid, leaf->ridArray[mid]))
+            {
+                high = mid;
+            }
+            else
+            {
+                low = mid + 1;
+            }
+        }
+        return low;
+    }
+
+    // position of a key on a line, which the histogram interpolates on within a bucket, and the distance between
+    // two consecutive keys on it, 0 if there are keys between any two. Keys compared byte by byte are placed by
+    // their first 8 bytes
+
+    static inline double keyPosition(const int key)
+    {
+        return key;
+    }
+
+    static inline double keyPosition(const double key)
+    {
+        return key;
+    }
+
+    static inline double bytesPosition(const unsigned char* bytes)
+    {
+        double position = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            position = position * 256 + bytes[i];
+        }
+        return position;
+    }
+
+    static inline double keyPosition(const StringKey& key)
+    {
+        return bytesPosition(key.bytes);
+    }
+
+    static inline double keyPosition(const CompositeKey& key)
+    {
+        return bytesPosition(key.bytes);
+    }
+
+    template <class T>
+    static inline double keyStep(const T& key)
+    {
+        return 0;
+    }
+
+    static inline double keyStep(const int key)
+    {
+        return 1;
+    }
+
+    // 64-bit hash of the bytes of a key for the sketch of distinct keys, FNV-1a followed by the
+    // finalizer of MurmurHash3 so that the leading bits depend on every byte
+
+    static inline std::uint64_t hashKey(const unsigned char* bytes, const int size)
+    {
+        std::uint64_t hash = 14695981039346656037ULL;
+        for (int i = 0; i < size; i++)
+        {
+            hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        }
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    // number of times a descent reads the non-leaf nodes optimistically before it latches them instead
+    static const int MAX_OPTIMISTIC_DESCENTS = 8;
+
+    // number of leaves a scan reads ahead of the one it is on, when it first moves to another leaf and at most
+    static const int MIN_READAHEAD_LEAVES = 2;
+    static const int MAX_READAHEAD_LEAVES = 64;
+
+// -----------------------------------------------------------------------------
+// CompositeKeyFormat::CompositeKeyFormat
+// -----------------------------------------------------------------------------
+
+    CompositeKeyFormat::CompositeKeyFormat(const std::vector<KeyAttribute>& attributes)
+        : attributes(attributes), size(0)
+    {
+        if (attributes.empty() || attributes.size() > (std::size_t) MAXKEYATTRIBUTES)
+        {
+            throw BadIndexInfoException("composite key with no attributes or too many of them");
+        }
+        for (std::size_t a = 0; a < attributes.size(); a++)
+        {
+            const KeyAttribute& attribute = attributes[a];
+            if (attribute.byteOffset < 0 || (attribute.type != INTEGER && attribute.type != DOUBLE &&
+                    (attribute.type != STRING || attribute.length <= 0)))
+            {
+                throw BadIndexInfoException("bad composite key attribute");
+            }
+            size += encodedLength(attribute);
+        }
+        if (size > COMPOSITEKEYSIZE)
+        {
+            throw BadIndexInfoException("composite key attributes do not fit in the key");
+        }
+    }
+
+// -----------------------------------------------------------------------------
+// CompositeKeyFormat::encodedLength
+// -----------------------------------------------------------------------------
+
+    int CompositeKeyFormat::encodedLength(const KeyAttribute& attribute)
+    {
+        switch (attribute.type)
+        {
+            case INTEGER:
+                return sizeof(int);
+            case DOUBLE:
+                return sizeof(double);
+            default:
+                return attribute.length;
+        }
+    }
+
+// -----------------------------------------------------------------------------
+// CompositeKeyFormat::encode
+// -----------------------------------------------------------------------------
+
+    void CompositeKeyFormat::encode(const KeyAttribute& attribute, const void* value, unsigned char* out)
+    {
+        // numbers go most significant byte first, with the sign bit flipped so that negative values come first.
+        // All bits of a negative double are flipped, its magnitude grows as its bits go down
+        std::uint64_t bits;
+        int length;
+        switch (attribute.type)
+        {
+            case INTEGER:
+            {
+                std::uint32_t v;
+                memcpy(&v, value, sizeof(v));
+                bits = v ^ 0x80000000u;
+                length = sizeof(v);
+                break;
+            }
+            case DOUBLE:
+            {
+                // -0.0 is the same key as 0.0
+                double d;
+                memcpy(&d, value, sizeof(d));
+                d = (d == 0) ? 0.0 : d;
+                memcpy(&bits, &d, sizeof(bits));
+                bits = (bits >> 63) ? ~bits : bits ^ (1ull << 63);
+                length = sizeof(bits);
+                break;
+            }
+            default:
+                strncpy((char*) out, (const char*) value, attribute.length);
+                return;
+        }
+        for (int i = length - 1; i >= 0; i--)
+        {
+            out[i] = (unsigned char) bits;
+            bits >>= 8;
+        }
+    }
+
+// -----------------------------------------------------------------------------
+// CompositeKeyFormat::keyOfRecord
+// -----------------------------------------------------------------------------
+
+    CompositeKey CompositeKeyFormat::keyOfRecord(const char* record) const
+    {
+        CompositeKey key;
+        memset(key.bytes, 0, COMPOSITEKEYSIZE);
+        unsigned char* out = key.bytes;
+        for (std::size_t a = 0; a < attributes.size(); a++)
+        {
+            encode(attributes[a], record + attributes[a].byteOffset, out);
+            out += encodedLength(attributes[a]);
+        }
+        return key;
+    }
+
+// -----------------------------------------------------------------------------
+// CompositeKeyFormat::makeKey
+// -----------------------------------------------------------------------------
+
+    CompositeKey CompositeKeyFormat::makeKey(const void* const* values, const int numValues, const bool highest) const
+    {
+        CompositeKey key;
+        memset(key.bytes, 0, COMPOSITEKEYSIZE);
+        unsigned char* out = key.bytes;
+        int count = std::min(numValues, (int) attributes.size());
+        for (int a = 0; a < count; a++)
+        {
+            encode(attributes[a], values[a], out);
+            out += encodedLength(attributes[a]);
+        }
+
+        // the attributes left out take their lowest or highest encoding
+        if (highest)
+        {
+            memset(out, 0xFF, key.bytes + size - out);
+        }
+        return key;
+    }
+
 // -----------------------------------------------------------------------------
 // BTreeIndex::BTreeIndex -- Constructor
 // -----------------------------------------------------------------------------
@@ -29,17 +414,130 @@ namespace badgerdb
                            BufMgr *bufMgrIn,
                            const int attrByteOffset,
                            const Datatype attrType)
+        : BTreeIndex(relationName, outIndexName, bufMgrIn, attrByteOffset, attrType,
+                     INTARRAYNONLEAFSIZE, INTARRAYLEAFSIZE)
+    {
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::BTreeIndex -- Constructor of a covering index
+// -----------------------------------------------------------------------------
+    BTreeIndex::BTreeIndex(const std::string & relationName,
+                           std::string & outIndexName,
+                           BufMgr *bufMgrIn,
+                           const int attrByteOffset,
+                           const Datatype attrType,
+                           const std::vector<IncludedColumn>& includedColumns)
+        : BTreeIndex(relationName, outIndexName, bufMgrIn, attrByteOffset, attrType,
+                     INTARRAYNONLEAFSIZE, INTARRAYLEAFSIZE, includedColumns)
+    {
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::BTreeIndex -- Constructor of a counted index
+// -----------------------------------------------------------------------------
+    BTreeIndex::BTreeIndex(const std::string & relationName,
+                           std::string & outIndexName,
+                           BufMgr *bufMgrIn,
+                           const int attrByteOffset,
+                           const Datatype attrType, const bool counted,
+                           const int nodeOccupancy, const int leafOccupancy)
+        : BTreeIndex(relationName, outIndexName, bufMgrIn, attrByteOffset, attrType,
+                     nodeOccupancy, leafOccupancy, std::vector<IncludedColumn>(), CompositeKeyFormat(), counted)
+    {
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::BTreeIndex -- Constructor of a COMPOSITE index
+// -----------------------------------------------------------------------------
+    BTreeIndex::BTreeIndex(const std::string & relationName,
+                           std::string & outIndexName,
+                           BufMgr *bufMgrIn,
+                           const std::vector<KeyAttribute>& keyAttributes,
+                           const int nodeOccupancy, const int leafOccupancy,
+                           const std::vector<IncludedColumn>& includedColumns)
+        : BTreeIndex(relationName, outIndexName, bufMgrIn, keyAttributes.empty() ? 0 : keyAttributes[0].byteOffset,
+                     COMPOSITE, nodeOccupancy, leafOccupancy, includedColumns, CompositeKeyFormat(keyAttributes), false)
+    {
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::BTreeIndex -- Constructor with specified node/leaf capacities
+// -----------------------------------------------------------------------------
+    BTreeIndex::BTreeIndex(const std::string & relationName,
+                           std::string & outIndexName,
+                           BufMgr *bufMgrIn,
+                           const int attrByteOffset,
+                           const Datatype attrType, const int nodeOccupancy, const int leafOccupancy,
+                           const std::vector<IncludedColumn>& includedColumns)
+        : BTreeIndex(relationName, outIndexName, bufMgrIn, attrByteOffset, attrType,
+                     nodeOccupancy, leafOccupancy, includedColumns, CompositeKeyFormat(), false)
+    {
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::BTreeIndex -- Constructor all others delegate to
+// -----------------------------------------------------------------------------
+    BTreeIndex::BTreeIndex(const std::string & relationName,
+                           std::string & outIndexName,
+                           BufMgr *bufMgrIn,
+                           const int attrByteOffset,
+                           const Datatype attrType, const int nodeOccupancy, const int leafOccupancy,
+                           const std::vector<IncludedColumn>& includedColumns,
+                           const CompositeKeyFormat& keyFormat, const bool counted)
+        : keyFormat(keyFormat), counted(counted)
     {
+        // a COMPOSITE index is named after the offsets of all its attributes
+        const std::vector<KeyAttribute>& keyAttributes = keyFormat.getAttributes();
         std::ostringstream idxStr;
         idxStr << relationName << '.' << attrByteOffset;
+        for (std::size_t a = 1; a < keyAttributes.size(); a++)
+        {
+            idxStr << '.' << keyAttributes[a].byteOffset;
+        }
         outIndexName = idxStr.str();
+        if ((attrType == COMPOSITE) != !keyAttributes.empty())
+        {
+            throw BadIndexInfoException(outIndexName + ": key attributes do not match the attribute type");
+        }
+
+        if (includedColumns.size() > (std::size_t) MAXINCLUDEDCOLUMNS)
+        {
+            throw BadIndexInfoException(outIndexName + ": too many included columns");
+        }
+        this->includedColumns = includedColumns;
+        includedSize = 0;
+        for (std::size_t c = 0; c < includedColumns.size(); c++)
+        {
+            if (includedColumns[c].byteOffset < 0 || includedColumns[c].length <= 0)
+            {
+                throw BadIndexInfoException(outIndexName + ": bad included column");
+            }
+            includedSize += includedColumns[c].length;
+        }
 
         bufMgr = bufMgrIn;
-        leafOccupancy = INTARRAYLEAFSIZE;
-        nodeOccupancy = INTARRAYNONLEAFSIZE;
+        this->relationName = relationName;
+        relationFile = NULL;
+        leftmostLeafPageNo = Page::INVALID_NUMBER;
+        rightmostLeafPageNo = Page::INVALID_NUMBER;
+        structureVersion = 0;
+        for (int shard = 0; shard < STATISTICSSHARDS; shard++)
+        {
+            statisticsShards[shard].clear();
+        }
         attributeType = attrType;
         this->attrByteOffset = attrByteOffset;
-        scanExecuting = false;
+
+        bindKeyType(outIndexName, nodeOccupancy, leafOccupancy);
+        if (this->leafOccupancy < 2)
+        {
+            throw BadIndexInfoException(outIndexName + ": included columns leave no room in the leaves");
+        }
+        if (this->nodeOccupancy < 2)
+        {
+            throw BadIndexInfoException(outIndexName + ": counts leave no room in the nodes");
+        }
 
         // Check to see if file exists
         try
@@ -53,506 +551,3975 @@ namespace badgerdb
             bufMgr->readPage(file, headerPageNum, headerPage);
             IndexMetaInfo* metaInfo = (IndexMetaInfo*) headerPage;
             rootPageNum = metaInfo->rootPageNo;
+            rootIsLeaf = metaInfo->rootIsLeaf;
+            freeListHead = metaInfo->freeListHead;
+            statistics = metaInfo->statistics;
+            histogramBuckets = statistics.numBuckets;
+            int storedNodeOccupancy = metaInfo->nodeOccupancy;
+            int storedLeafOccupancy = metaInfo->leafOccupancy;
+            bool matches = strncmp(metaInfo->relationName, relationName.c_str(), sizeof(metaInfo->relationName) - 1) == 0
+                && metaInfo->attrByteOffset == attrByteOffset
+                && metaInfo->attrType == attrType
+                && metaInfo->formatVersion == NODEFORMATVERSION
+                && metaInfo->numIncluded == (int) includedColumns.size()
+                && metaInfo->numKeyAttributes == (int) keyAttributes.size()
+                && metaInfo->counted == counted;
+            for (int c = 0; matches && c < metaInfo->numIncluded; c++)
+            {
+                matches = metaInfo->included[c].byteOffset == includedColumns[c].byteOffset
+                    && metaInfo->included[c].length == includedColumns[c].length;
+            }
+            for (int a = 0; matches && a < metaInfo->numKeyAttributes; a++)
+            {
+                matches = metaInfo->keyAttributes[a].byteOffset == keyAttributes[a].byteOffset
+                    && metaInfo->keyAttributes[a].type == keyAttributes[a].type
+                    && (keyAttributes[a].type != STRING || metaInfo->keyAttributes[a].length == keyAttributes[a].length);
+            }
             bufMgr->unPinPage(file, headerPageNum, false);
 
-            rootIsLeaf = metaInfo->rootIsLeaf;
+            if (!matches)
+            {
+                // the destructor does not run for an object whose constructor throws
+                bufMgr->flushFile(file);
+                delete file;
+                throw BadIndexInfoException(outIndexName);
+            }
+
+            // the counts of the children and the included values sit past the capacities the index was built
+            // with, which it keeps whatever capacities it is opened with
+            if (storedNodeOccupancy != this->nodeOccupancy || storedLeafOccupancy != this->leafOccupancy)
+            {
+                bindKeyType(outIndexName, storedNodeOccupancy, storedLeafOccupancy);
+            }
+        }
+        catch (FileNotFoundException& e)
+        {
+            // File does not exist, create one
+            file = new BlobFile(outIndexName, true);
+
+            // allocate the meta page, the root is filled in once the tree is built
+            Page* headerPage;
+            bufMgr->allocPage(file, headerPageNum, headerPage);
+
+            IndexMetaInfo* metaInfo = (IndexMetaInfo*) headerPage;
+            metaInfo->attrByteOffset = attrByteOffset;
+            metaInfo->attrType = attrType;
+            strncpy(metaInfo->relationName, relationName.c_str(), sizeof(metaInfo->relationName) - 1);
+            metaInfo->relationName[sizeof(metaInfo->relationName) - 1] = '\0';
+            metaInfo->formatVersion = NODEFORMATVERSION;
+            metaInfo->numIncluded = includedColumns.size();
+            std::copy(includedColumns.begin(), includedColumns.end(), metaInfo->included);
+            metaInfo->numKeyAttributes = keyAttributes.size();
+            std::copy(keyAttributes.begin(), keyAttributes.end(), metaInfo->keyAttributes);
+            metaInfo->counted = counted;
+            metaInfo->nodeOccupancy = this->nodeOccupancy;
+            metaInfo->leafOccupancy = this->leafOccupancy;
+            freeListHead = Page::INVALID_NUMBER;
+            memset(&statistics, 0, sizeof(statistics));
+            histogramBuckets = 0;
+            bufMgr->unPinPage(file, headerPageNum, true);
+
+            (this->*keyOps->build)(relationName, outIndexName);
+        }
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::bindKeyType
+// -----------------------------------------------------------------------------
+
+    void BTreeIndex::bindKeyType(const std::string& indexName, const int nodeOccupancy, const int leafOccupancy)
+    {
+        // pick the implementation for the key type once, every operation goes through it
+        switch (attributeType)
+        {
+            case INTEGER:
+                bindKeyType<int>(nodeOccupancy, leafOccupancy);
+                break;
+            case DOUBLE:
+                bindKeyType<double>(nodeOccupancy, leafOccupancy);
+                break;
+            case STRING:
+                bindKeyType<StringKey>(nodeOccupancy, leafOccupancy);
+                break;
+            case COMPOSITE:
+                bindKeyType<CompositeKey>(nodeOccupancy, leafOccupancy);
+                break;
+            default:
+                throw BadIndexInfoException(indexName);
+        }
+    }
+
+    template <class T>
+    const BTreeIndex::KeyTypeOps* BTreeIndex::keyTypeOps()
+    {
+        static const KeyTypeOps ops = {
+            &BTreeIndex::build<T>,
+            &BTreeIndex::insertEntryTyped<T>,
+            &BTreeIndex::insertBatchTyped<T>,
+            &BTreeIndex::deleteEntryTyped<T>,
+            &BTreeIndex::startScanTyped<T>,
+            &BTreeIndex::scanNextTyped<T>,
+            &BTreeIndex::scanNextBatchTyped<T>,
+            &BTreeIndex::lookupManyTyped<T>,
+            &BTreeIndex::estimateRangeTyped<T>,
+            &BTreeIndex::countRangeTyped<T>,
+            &BTreeIndex::countBelowTyped<T>,
+            &BTreeIndex::selectTyped<T>,
+            &BTreeIndex::foldStatisticsTyped<T>
+        };
+        return &ops;
+    }
+
+    template <class T>
+    void BTreeIndex::bindKeyType(const int nodeOccupancy, const int leafOccupancy)
+    {
+        keyOps = keyTypeOps<T>();
+        this->nodeOccupancy = std::min(nodeOccupancy, (int) NonLeafNode<T>::CAPACITY);
+        this->leafOccupancy = std::min(leafOccupancy, (int) LeafNode<T>::CAPACITY);
+
+        // the values of the included columns share the space after the record ids
+        if (includedSize > 0)
+        {
+            int room = (Page::SIZE - offsetof(LeafNode<T>, ridArray)) / (sizeof(PackedRecordId) + includedSize);
+            this->leafOccupancy = std::min(this->leafOccupancy, room);
+        }
+
+        // so do the counts of the children with the page numbers
+        if (counted)
+        {
+            int room = (Page::SIZE - offsetof(NonLeafNode<T>, pageNoArray)) / (sizeof(PageId) + sizeof(std::uint64_t)) - 1;
+            this->nodeOccupancy = std::min(this->nodeOccupancy, room);
+        }
+
+        // a run of duplicates filling half a leaf takes a single entry once its record ids are moved to
+        // a posting list, where they take less room than in the leaf
+        postingRunLength = 0;
+        if (includedSize == 0)
+        {
+            postingRunLength = std::max(2, std::min((int) PostingPage::CAPACITY, this->leafOccupancy) / 2);
+        }
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::build
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    void BTreeIndex::build(const std::string& relationName, const std::string& runPrefix)
+    {
+        // sort the <key, rid> pairs of every tuple in the base relation,
+        // spilling to temporary runs if they do not fit the sort budget
+        FileScan fscan(relationName, bufMgr);
+        ExternalSort<T> sorted(fscan, attrByteOffset, bufMgr, runPrefix, SORTBUFFERFRAMES, 0, keyFormat);
+
+        // build the tree bottom-up
+        bulkLoad(sorted);
+    }
+
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::bulkLoad
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    void BTreeIndex::bulkLoad(ExternalSort<T>& entries)
+    {
+        // lay down the leaf level left to right, filling every leaf. The last leaf evens out its entries
+        // with the one before it, so that every leaf except a lone root is at least half full.
+        // The statistics of the keys are gathered on the way
+        memset(&statistics, 0, sizeof(statistics));
+
+        // <page number, separator from the node on its left> of every node on the level being built,
+        // the first node keeps its smallest key, and the number of entries under each of them
+        std::vector<PageKeyPair<T> > level;
+        std::vector<std::uint64_t> levelCounts;
+        LeafNode<T>* prevLeaf = NULL;
+        PageId prevPageNum = 0;
+        LeafNode<T>* leaf = NULL;
+        PageId leafPageNum = 0;
+
+        RIDKeyPair<T> next;
+        bool hasNext = nextSorted(entries, next);
+        std::vector<RIDKeyPair<T> > run;
+        std::vector<RecordId> postingRids;
+        while (hasNext || leaf == NULL)
+        {
+            // take the entries with the next key, up to as many as go to a posting list
+            run.clear();
+            int runLimit = (postingRunLength > 0) ? postingRunLength : 1;
+            while (hasNext && (run.empty() || (next.key == run[0].key && (int) run.size() < runLimit)))
+            {
+                run.push_back(next);
+                hasNext = nextSorted(entries, next);
+            }
+
+            // a long enough run goes to a posting list along with the rest of the entries with its key,
+            // the leaf gets a single entry for all of them
+            int numLeafEntries = run.size();
+            PageId headNum = Page::INVALID_NUMBER;
+            std::uint64_t numListed = 0;
+            if (postingRunLength > 0 && (int) run.size() == postingRunLength && isCompleteKey(run[0].key))
+            {
+                postingRids.clear();
+                for (std::size_t i = 0; i < run.size(); i++)
+                {
+                    postingRids.push_back(run[i].rid);
+                }
+                while (hasNext && next.key == run[0].key)
+                {
+                    if ((int) postingRids.size() == PostingPage::CAPACITY)
+                    {
+                        appendToPostingList(headNum, postingRids);
+                        postingRids.clear();
+                    }
+                    postingRids.push_back(next.rid);
+                    numListed++;
+                    hasNext = nextSorted(entries, next);
+                }
+                appendToPostingList(headNum, postingRids);
+                numListed += run.size();
+                numLeafEntries = 1;
+            }
+
+            // an empty relation still gets its root leaf
+            for (int i = 0; i < numLeafEntries || leaf == NULL; i++)
+            {
+                if (leaf == NULL || leaf->header.numKeys == leafOccupancy)
+                {
+                    Page* page;
+                    PageId pageNum;
+                    allocNode(pageNum, page);
+                    LeafNode<T>* newLeaf = (LeafNode<T>*) page;
+                    newLeaf->header.initialize(0);
+
+                    // link the current leaf to the new one, the leaf before it is complete now
+                    PageKeyPair<T> pair;
+                    if (leaf != NULL)
+                    {
+                        leaf->header.rightSibPageNo = pageNum;
+                        newLeaf->header.leftSibPageNo = leafPageNum;
+                        if (prevLeaf != NULL)
+                        {
+                            bufMgr->unPinPage(file, prevPageNum, true);
+                        }
+                        prevLeaf = leaf;
+                        prevPageNum = leafPageNum;
+                        pair.set(pageNum, run[i].key);
+                        newLeaf->header.lowRid = leafLowRid(leaf->keyArray[leaf->header.numKeys - 1], run[i].key,
+                                                            PackedRecordId(run[i].rid));
+                    }
+                    else
+                    {
+                        pair.set(pageNum, run.empty() ? T() : run[0].key);
+                    }
+                    level.push_back(pair);
+                    levelCounts.push_back(0);
+                    leaf = newLeaf;
+                    leafPageNum = pageNum;
+                }
+                if (i >= numLeafEntries)
+                {
+                    break;
+                }
+
+                int index = leaf->header.numKeys;
+                leaf->keyArray[index] = run[i].key;
+                if (headNum != Page::INVALID_NUMBER)
+                {
+                    leaf->ridArray[index] = PackedRecordId::postingList(headNum);
+                    levelCounts.back() += numListed;
+                }
+                else
+                {
+                    leaf->ridArray[index] = run[i].rid;
+                    levelCounts.back()++;
+                }
+                if (includedSize > 0)
+                {
+                    readIncluded(run[i].rid, leafIncluded(leaf, index));
+                }
+                leaf->header.numKeys++;
+            }
+        }
+
+        if (prevLeaf != NULL)
+        {
+            if (leaf->header.numKeys < leafOccupancy / 2)
+            {
+                rebalanceLeaves<T>(prevLeaf, leaf, level.back().key);
+                int last = level.size() - 1;
+                levelCounts[last - 1] = leafEntries(prevLeaf, prevLeaf->header.numKeys);
+                levelCounts[last] = leafEntries(leaf, leaf->header.numKeys);
+            }
+            bufMgr->unPinPage(file, prevPageNum, true);
+        }
+        bufMgr->unPinPage(file, leafPageNum, true);
+
+        // build the non-leaf levels on top until a single root remains
+        int nodeLevel = 1;
+        while (level.size() > 1)
+        {
+            std::vector<PageKeyPair<T> > parents;
+            std::vector<std::uint64_t> parentCounts;
+            int numChildren = level.size();
+            int numNodes = (numChildren + nodeOccupancy) / (nodeOccupancy + 1);
+            int child = 0;
+            NonLeafNode<T>* prevNode = NULL;
+            PageId prevNodeNum = 0;
+            for (int n = 0; n < numNodes; n++)
+            {
+                int count = numChildren / numNodes + (n < numChildren % numNodes ? 1 : 0);
+
+                Page* page;
+                PageId pageNum;
+                allocNode(pageNum, page);
+                NonLeafNode<T>* node = (NonLeafNode<T>*) page;
+                node->header.initialize(nodeLevel);
+                node->header.numKeys = count - 1;
+                node->header.lowRid = lowRidOf(level[child].pageNo);
+
+                // the smallest key of every child but the first becomes a separator
+                node->pageNoArray[0] = level[child].pageNo;
+                for (int i = 1; i < count; i++)
+                {
+                    node->keyArray[i - 1] = level[child + i].key;
+                    node->pageNoArray[i] = level[child + i].pageNo;
+                }
+                std::uint64_t entriesUnder = 0;
+                for (int i = 0; i < count; i++)
+                {
+                    if (counted)
+                    {
+                        setChildCount(node, i, levelCounts[child + i]);
+                    }
+                    entriesUnder += levelCounts[child + i];
+                }
+
+                // link the previous node of this level to this one, it is complete now
+                if (prevNode != NULL)
+                {
+                    prevNode->header.rightSibPageNo = pageNum;
+                    node->header.leftSibPageNo = prevNodeNum;
+                    bufMgr->unPinPage(file, prevNodeNum, true);
+                }
+
+                PageKeyPair<T> pair;
+                pair.set(pageNum, level[child].key);
+                parents.push_back(pair);
+                parentCounts.push_back(entriesUnder);
+
+                prevNode = node;
+                prevNodeNum = pageNum;
+                child += count;
+            }
+            bufMgr->unPinPage(file, prevNodeNum, true);
+            level.swap(parents);
+            levelCounts.swap(parentCounts);
+            nodeLevel++;
+        }
+
+        rootPageNum = level[0].pageNo;
+        rootIsLeaf = (nodeLevel == 1);
+        histogramBuckets = statistics.numBuckets;
+
+        // record the new root in the meta page
+        updateMetaPage();
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::nextSorted
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    bool BTreeIndex::nextSorted(ExternalSort<T>& entries, RIDKeyPair<T>& next)
+    {
+        if (!entries.next(next))
+        {
+            return false;
+        }
+
+        // the entries come in order, the first ones fill the first bucket and so on
+        std::uint64_t ordinal = statistics.numEntries;
+        std::uint64_t total = entries.size();
+        statistics.numBuckets = (int) std::min((std::uint64_t) HISTOGRAMBUCKETS, total);
+        int bucket = ordinal * statistics.numBuckets / total;
+        if (ordinal == 0)
+        {
+            memcpy(statistics.bounds[0], &next.key, sizeof(T));
+        }
+        memcpy(statistics.bounds[bucket + 1], &next.key, sizeof(T));
+        statistics.bucketCounts[bucket]++;
+        statistics.numEntries++;
+        addToSketch(statistics.sketch, &next.key, sizeof(T));
+        return true;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::addStatistics
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    void BTreeIndex::addStatistics(const T& key)
+    {
+        // the first key sets up a single bucket, whose outer bounds the folds then stretch
+        int numBuckets = histogramBuckets.load(std::memory_order_acquire);
+        if (numBuckets == 0)
+        {
+            std::lock_guard<std::mutex> lock(statsMutex);
+            if (statistics.numBuckets == 0)
+            {
+                statistics.numBuckets = 1;
+                memcpy(statistics.bounds[0], &key, sizeof(T));
+                memcpy(statistics.bounds[1], &key, sizeof(T));
+                histogramBuckets.store(1, std::memory_order_release);
+            }
+            numBuckets = statistics.numBuckets;
+        }
+
+        int bucket = statisticsBucket<T>(key, numBuckets);
+        StatisticsShard& shard = statisticsShard();
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.numEntries++;
+        shard.bucketCounts[bucket]++;
+        addToSketch(shard.sketch, &key, sizeof(T));
+        T low;
+        T high;
+        memcpy(&low, shard.low, sizeof(T));
+        memcpy(&high, shard.high, sizeof(T));
+        if (!shard.hasKeys || key < low)
+        {
+            memcpy(shard.low, &key, sizeof(T));
+        }
+        if (!shard.hasKeys || high < key)
+        {
+            memcpy(shard.high, &key, sizeof(T));
+        }
+        shard.hasKeys = true;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::removeStatistics
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    void BTreeIndex::removeStatistics(const T& key)
+    {
+        int numBuckets = histogramBuckets.load(std::memory_order_acquire);
+        if (numBuckets == 0)
+        {
+            return;
+        }
+
+        // the fold moves what a bucket cannot give on to the next ones holding the key
+        int bucket = statisticsBucket<T>(key, numBuckets);
+        StatisticsShard& shard = statisticsShard();
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.numEntries--;
+        shard.bucketCounts[bucket]--;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::statisticsBucket
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    int BTreeIndex::statisticsBucket(const T& key, const int numBuckets)
+    {
+        // the first bucket whose largest key is not smaller, the outer buckets stretch to keys past the ends.
+        // Only the bounds between the buckets are read, which stay as they are once set
+        int low = 0;
+        int high = numBuckets - 1;
+        while (low < high)
+        {
+            int mid = (low + high) / 2;
+            if (statisticsBound<T>(mid + 1) < key)
+            {
+                low = mid + 1;
+            }
+            else
+            {
+                high = mid;
+            }
+        }
+        return low;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::statisticsShard
+// -----------------------------------------------------------------------------
+
+    StatisticsShard& BTreeIndex::statisticsShard()
+    {
+        // threads take the shards in turn as they first count a key
+        static std::atomic<int> nextShard(0);
+        static thread_local int shard = nextShard.fetch_add(1) % STATISTICSSHARDS;
+        return statisticsShards[shard];
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::foldStatistics
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    void BTreeIndex::foldStatisticsTyped()
+    {
+        // nothing is counted in the shards before the first bucket is set up
+        int numBuckets = statistics.numBuckets;
+        if (numBuckets == 0)
+        {
+            return;
+        }
+
+        for (int s = 0; s < STATISTICSSHARDS; s++)
+        {
+            StatisticsShard& shard = statisticsShards[s];
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            std::int64_t entries = (std::int64_t) statistics.numEntries + shard.numEntries;
+            statistics.numEntries = std::max((std::int64_t) 0, entries);
+
+            // an entry of a key spanning buckets may have been counted in a later one than it is taken from
+            std::int64_t owed = 0;
+            for (int bucket = 0; bucket < numBuckets; bucket++)
+            {
+                std::int64_t count = (std::int64_t) statistics.bucketCounts[bucket] + shard.bucketCounts[bucket] - owed;
+                owed = std::max((std::int64_t) 0, -count);
+                statistics.bucketCounts[bucket] = std::max((std::int64_t) 0, count);
+            }
+
+            for (int reg = 0; reg < SKETCHREGISTERS; reg++)
+            {
+                statistics.sketch[reg] = std::max(statistics.sketch[reg], shard.sketch[reg]);
+            }
+
+            if (shard.hasKeys)
+            {
+                T low;
+                T high;
+                memcpy(&low, shard.low, sizeof(T));
+                memcpy(&high, shard.high, sizeof(T));
+                if (low < statisticsBound<T>(0))
+                {
+                    memcpy(statistics.bounds[0], &low, sizeof(T));
+                }
+                if (statisticsBound<T>(numBuckets) < high)
+                {
+                    memcpy(statistics.bounds[numBuckets], &high, sizeof(T));
+                }
+            }
+            shard.clear();
+        }
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::addToSketch
+// -----------------------------------------------------------------------------
+
+    void BTreeIndex::addToSketch(std::uint8_t* sketch, const void* key, const int size)
+    {
+        // the leading bits of the hash pick the register, which keeps the largest position of the first
+        // set bit among the rest
+        std::uint64_t hash = hashKey((const unsigned char*) key, size);
+        int reg = hash >> (64 - SKETCHBITS);
+        std::uint64_t rest = hash << SKETCHBITS;
+        std::uint8_t rank = (rest == 0) ? 64 - SKETCHBITS + 1 : __builtin_clzll(rest) + 1;
+        sketch[reg] = std::max(sketch[reg], rank);
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::distinctKeys
+// -----------------------------------------------------------------------------
+
+    double BTreeIndex::distinctKeys()
+    {
+        if (statistics.numEntries == 0)
+        {
+            return 0;
+        }
+
+        // HyperLogLog estimate, with linear counting of the empty registers for small counts
+        double m = SKETCHREGISTERS;
+        double sum = 0;
+        int zeros = 0;
+        for (int reg = 0; reg < SKETCHREGISTERS; reg++)
+        {
+            sum += std::ldexp(1.0, -statistics.sketch[reg]);
+            if (statistics.sketch[reg] == 0)
+            {
+                zeros++;
+            }
+        }
+        double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+        if (estimate <= 2.5 * m && zeros > 0)
+        {
+            estimate = m * std::log(m / zeros);
+        }
+        return std::min(estimate, (double) statistics.numEntries);
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::estimateRange
+// -----------------------------------------------------------------------------
+
+    double BTreeIndex::estimateRange(const void* lowVal, const Operator lowOp, const void* highVal,
+                                     const Operator highOp)
+    {
+        if (lowOp != GT && lowOp != GTE)
+        {
+            throw BadOpcodesException();
+        }
+
+        if (highOp != LT && highOp != LTE)
+        {
+            throw BadOpcodesException();
+        }
+
+        return (this->*keyOps->estimateRange)(lowVal, lowOp, highVal, highOp);
+    }
+
+    template <class T>
+    double BTreeIndex::estimateRangeTyped(const void* lowValParm, const Operator lowOp, const void* highValParm,
+                                          const Operator highOp)
+    {
+        T lowVal = keyFromBytes<T>(lowValParm);
+        T highVal = keyFromBytes<T>(highValParm);
+        if (highVal < lowVal)
+        {
+            throw BadScanrangeException();
+        }
+
+        std::lock_guard<std::mutex> lock(statsMutex);
+        foldStatisticsTyped<T>();
+        if (statistics.numEntries == 0)
+        {
+            return 0;
+        }
+
+        // a bucket is taken as its count of entries spread evenly from its first to its last key, a bucket of
+        // a single key only matches whole
+        double step = keyStep(lowVal);
+        double low = keyPosition(lowVal) + (lowOp == GT ? step : 0);
+        double high = keyPosition(highVal) + (highOp == LTE ? step : 0);
+        bool point = compareKeys(lowVal, highVal) == 0;
+        if (point && (lowOp == GT || highOp == LT) && isCompleteKey(lowVal))
+        {
+            return 0;
+        }
+
+        double estimate = 0;
+        bool inside = false;
+        for (int bucket = 0; bucket < statistics.numBuckets; bucket++)
+        {
+            T from = statisticsBound<T>(bucket);
+            T to = statisticsBound<T>(bucket + 1);
+            int fromLow = compareKeys(from, lowVal);
+            int toLow = compareKeys(to, lowVal);
+            int fromHigh = compareKeys(from, highVal);
+            int toHigh = compareKeys(to, highVal);
+            if (toLow < 0 || (toLow == 0 && lowOp == GT) || fromHigh > 0 || (fromHigh == 0 && highOp == LT))
+            {
+                continue;
+            }
+            inside = true;
+
+            double count = statistics.bucketCounts[bucket];
+            bool covered = (fromLow > 0 || (fromLow == 0 && lowOp == GTE)) &&
+                    (toHigh < 0 || (toHigh == 0 && highOp == LTE));
+            if (covered || compareKeys(from, to) == 0)
+            {
+                estimate += covered ? count : 0;
+                continue;
+            }
+
+            double start = keyPosition(from);
+            double width = keyPosition(to) + step - start;
+            if (width > 0)
+            {
+                double overlap = std::min(high, start + width) - std::max(low, start);
+                estimate += count * std::max(0.0, std::min(1.0, overlap / width));
+            }
+        }
+
+        // a key falling between the bounds of the buckets has the average number of entries of a key
+        if (point && estimate == 0 && inside)
+        {
+            estimate = statistics.numEntries / std::max(1.0, distinctKeys());
+        }
+        return estimate;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::estimateDistinctKeys
+// -----------------------------------------------------------------------------
+
+    double BTreeIndex::estimateDistinctKeys()
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        (this->*keyOps->foldStatistics)();
+        return distinctKeys();
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::updateMetaPage
+// -----------------------------------------------------------------------------
+
+    void BTreeIndex::updateMetaPage()
+    {
+        std::lock_guard<std::mutex> lock(metaMutex);
+        Page* headerPage;
+        bufMgr->readPage(file, headerPageNum, headerPage);
+        IndexMetaInfo* metaInfo = (IndexMetaInfo*) headerPage;
+        metaInfo->rootPageNo = rootPageNum;
+        metaInfo->rootIsLeaf = rootIsLeaf;
+        metaInfo->freeListHead = freeListHead;
+        {
+            std::lock_guard<std::mutex> statsLock(statsMutex);
+            (this->*keyOps->foldStatistics)();
+            metaInfo->statistics = statistics;
+        }
+        bufMgr->unPinPage(file, headerPageNum, true);
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::allocNode
+// -----------------------------------------------------------------------------
+
+    void BTreeIndex::allocNode(PageId& pageNum, Page*& page)
+    {
+        std::unique_lock<std::mutex> lock(metaMutex);
+        if (freeListHead == Page::INVALID_NUMBER)
+        {
+            lock.unlock();
+            bufMgr->allocPage(file, pageNum, page);
+            return;
+        }
+
+        // reuse the page freed last
+        pageNum = freeListHead;
+        bufMgr->readPage(file, pageNum, page);
+        freeListHead = ((FreePageInfo*) page)->nextFreePageNo;
+        lock.unlock();
+        updateMetaPage();
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::freeNode
+// -----------------------------------------------------------------------------
+
+    void BTreeIndex::freeNode(PageId pageNum, Page* page)
+    {
+        std::unique_lock<std::mutex> lock(metaMutex);
+        FreePageInfo* freePage = (FreePageInfo*) page;
+        freePage->nextFreePageNo = freeListHead;
+        bufMgr->unPinPage(file, pageNum, true);
+
+        freeListHead = pageNum;
+        lock.unlock();
+        updateMetaPage();
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::setLeftSibling
+// -----------------------------------------------------------------------------
+
+    void BTreeIndex::setLeftSibling(PageId pageNum, PageId leftNum)
+    {
+        if (pageNum == Page::INVALID_NUMBER)
+        {
+            return;
+        }
+
+        latches[pageNum].lock();
+        Page* page;
+        bufMgr->readPage(file, pageNum, page);
+        ((NodeHeader*) page)->leftSibPageNo = leftNum;
+        bufMgr->unPinPage(file, pageNum, true);
+        latches[pageNum].unlock();
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::lowRidOf
+// -----------------------------------------------------------------------------
+
+    PackedRecordId BTreeIndex::lowRidOf(PageId pageNum)
+    {
+        Page* page;
+        bufMgr->readPage(file, pageNum, page);
+        PackedRecordId lowRid = ((NodeHeader*) page)->lowRid;
+        bufMgr->unPinPage(file, pageNum, false);
+        return lowRid;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::leafLowRid
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    PackedRecordId BTreeIndex::leafLowRid(const T& leftKey, const T& key, const PackedRecordId& rid)
+    {
+        PackedRecordId lowRid;
+        lowRid.pageLow = 0;
+        lowRid.pageHigh = 0;
+        lowRid.slot = 0;
+        if (leftKey < key)
+        {
+            return lowRid;
+        }
+        return rid.isPostingList() ? PackedRecordId(postingListEntry(rid.pageNumber(), 0)) : rid;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::childForEntry
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    int BTreeIndex::childForEntry(NonLeafNode<T>* node, const int numKeys, const T& key, const RecordId& rid,
+                                  NodeLatch* latch, const std::uint64_t version)
+    {
+        // the children between the separators equal to the key may all hold it, each one from its low record id
+        // on. Only those children are read, the node itself being checked first if it is read without its latch
+        int low = searchLowerBound(node->keyArray, numKeys, key);
+        int high = low + searchUpperBound(node->keyArray + low, numKeys - low, key);
+        while (low < high)
+        {
+            int mid = (low + high + 1) / 2;
+            PageId childNum = node->pageNoArray[mid];
+            if (latch != NULL && !latch->validate(version))
+            {
+                return -1;
+            }
+            if (ridBefore(rid, lowRidOf(childNum)))
+            {
+                high = mid - 1;
+            }
+            else
+            {
+                low = mid;
+            }
+        }
+        return low;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::findPostingList
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    int BTreeIndex::findPostingList(LeafNode<T>* leaf, int index, const T& key)
+    {
+        for (int i = index; i < leaf->header.numKeys && leaf->keyArray[i] == key; i++)
+        {
+            if (leaf->ridArray[i].isPostingList())
+            {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::packDuplicates
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    int BTreeIndex::packDuplicates(T* keys, PackedRecordId* rids, int count, const bool newLists)
+    {
+        if (postingRunLength == 0)
+        {
+            return count;
+        }
+
+        // entries are only ever moved towards the front
+        int out = 0;
+        int start = 0;
+        while (start < count)
+        {
+            int end = start + 1;
+            while (end < count && keys[end] == keys[start])
+            {
+                end++;
+            }
+
+            PageId listNum = Page::INVALID_NUMBER;
+            int numLists = 0;
+            for (int i = start; i < end; i++)
+            {
+                if (rids[i].isPostingList())
+                {
+                    listNum = (numLists == 0) ? rids[i].pageNumber() : listNum;
+                    numLists++;
+                }
+            }
+
+            // keys cut to a prefix stand for several values and keep their entries
+            int numPlain = end - start - numLists;
+            bool pack = isCompleteKey(keys[start]) && end - start > 1 &&
+                    (numLists > 0 || (newLists && numPlain >= postingRunLength));
+            if (!pack)
+            {
+                for (int i = start; i < end; i++)
+                {
+                    keys[out] = keys[i];
+                    rids[out] = rids[i];
+                    out++;
+                }
+                start = end;
+                continue;
+            }
+
+            if (numLists == 1)
+            {
+                for (int i = start; i < end; i++)
+                {
+                    if (!rids[i].isPostingList())
+                    {
+                        addToPostingList(listNum, rids[i]);
+                    }
+                }
+            }
+            else
+            {
+                // the entries are in order, so are the record ids read from them in turn, those of the lists
+                // of leaves that were merged included
+                std::vector<RecordId> ridList;
+                for (int i = start; i < end; i++)
+                {
+                    if (rids[i].isPostingList())
+                    {
+                        readPostingList(rids[i].pageNumber(), ridList);
+                        freePostingList(rids[i].pageNumber());
+                    }
+                    else
+                    {
+                        ridList.push_back(rids[i]);
+                    }
+                }
+                listNum = Page::INVALID_NUMBER;
+                appendToPostingList(listNum, ridList);
+            }
+            keys[out] = keys[start];
+            rids[out] = PackedRecordId::postingList(listNum);
+            out++;
+            start = end;
+        }
+        return out;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::appendToPostingList
+// -----------------------------------------------------------------------------
+
+    void BTreeIndex::appendToPostingList(PageId& headNum, const std::vector<RecordId>& rids)
+    {
+        if (rids.empty())
+        {
+            return;
+        }
+
+        Page* headPage;
+        if (headNum == Page::INVALID_NUMBER)
+        {
+            allocNode(headNum, headPage);
+            PostingPage* head = (PostingPage*) headPage;
+            head->header.initialize(-1);
+            head->totalRids = 0;
+            head->lastPageNo = headNum;
+        }
+        else
+        {
+            bufMgr->readPage(file, headNum, headPage);
+        }
+        PostingPage* head = (PostingPage*) headPage;
+
+        // fill up the last page, then add pages after it
+        PageId tailNum = head->lastPageNo;
+        Page* tailPage = headPage;
+        if (tailNum != headNum)
+        {
+            bufMgr->readPage(file, tailNum, tailPage);
+        }
+        std::size_t done = 0;
+        while (true)
+        {
+            PostingPage* tail = (PostingPage*) tailPage;
+            int numRids = tail->header.numKeys;
+            std::size_t taken = std::min(rids.size() - done, (std::size_t) (PostingPage::CAPACITY - numRids));
+            std::copy(rids.begin() + done, rids.begin() + done + taken, tail->ridArray + numRids);
+            tail->header.numKeys += taken;
+            done += taken;
+            if (done == rids.size())
+            {
+                break;
+            }
+
+            Page* page;
+            PageId pageNum;
+            allocNode(pageNum, page);
+            ((PostingPage*) page)->header.initialize(-1);
+            ((PostingPage*) page)->header.leftSibPageNo = tailNum;
+            tail->header.rightSibPageNo = pageNum;
+            if (tailNum != headNum)
+            {
+                bufMgr->unPinPage(file, tailNum, true);
+            }
+            tailNum = pageNum;
+            tailPage = page;
+        }
+
+        head->lastPageNo = tailNum;
+        head->totalRids += rids.size();
+        if (tailNum != headNum)
+        {
+            bufMgr->unPinPage(file, tailNum, true);
+        }
+        bufMgr->unPinPage(file, headNum, true);
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::addToPostingList
+// -----------------------------------------------------------------------------
+
+    void BTreeIndex::addToPostingList(PageId headNum, const RecordId& rid)
+    {
+        Page* headPage;
+        bufMgr->readPage(file, headNum, headPage);
+        PostingPage* head = (PostingPage*) headPage;
+
+        // new records mostly come after all the others and go to the last page. Otherwise the record id goes
+        // to the first page whose last record id comes after it
+        PageId pageNum = head->lastPageNo;
+        Page* page;
+        bufMgr->readPage(file, pageNum, page);
+        PostingPage* posting = (PostingPage*) page;
+        if (posting->header.numKeys > 0 && ridBefore(rid, posting->ridArray[posting->header.numKeys - 1]))
+        {
+            bufMgr->unPinPage(file, pageNum, false);
+            pageNum = headNum;
+            while (true)
+            {
+                bufMgr->readPage(file, pageNum, page);
+                posting = (PostingPage*) page;
+                PageId nextNum = posting->header.rightSibPageNo;
+                if (nextNum == Page::INVALID_NUMBER || ridBefore(rid, posting->ridArray[posting->header.numKeys - 1]))
+                {
+                    break;
+                }
+                bufMgr->unPinPage(file, pageNum, false);
+                pageNum = nextNum;
+            }
+        }
+
+        int numRids = posting->header.numKeys;
+        int index = postingLowerBound(posting, rid);
+        if (numRids == PostingPage::CAPACITY)
+        {
+            // split the page in two, a record id past the end starts a page of its own
+            Page* splitPage;
+            PageId splitNum;
+            allocNode(splitNum, splitPage);
+            PostingPage* split = (PostingPage*) splitPage;
+            split->header.initialize(-1);
+            split->header.rightSibPageNo = posting->header.rightSibPageNo;
+            split->header.leftSibPageNo = pageNum;
+            posting->header.rightSibPageNo = splitNum;
+            setLeftSibling(split->header.rightSibPageNo, splitNum);
+            if (head->lastPageNo == pageNum)
+            {
+                head->lastPageNo = splitNum;
+            }
+
+            int leftCount = (index == numRids) ? numRids : numRids / 2;
+            std::copy(posting->ridArray + leftCount, posting->ridArray + numRids, split->ridArray);
+            split->header.numKeys = numRids - leftCount;
+            posting->header.numKeys = leftCount;
+            if (index >= leftCount)
+            {
+                bufMgr->unPinPage(file, pageNum, true);
+                pageNum = splitNum;
+                page = splitPage;
+                posting = split;
+                index -= leftCount;
+            }
+            else
+            {
+                bufMgr->unPinPage(file, splitNum, true);
+            }
+            numRids = posting->header.numKeys;
+        }
+
+        std::copy_backward(posting->ridArray + index, posting->ridArray + numRids, posting->ridArray + numRids + 1);
+        posting->ridArray[index] = rid;
+        posting->header.numKeys++;
+        head->totalRids++;
+        bufMgr->unPinPage(file, pageNum, true);
+        bufMgr->unPinPage(file, headNum, true);
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::removeFromPostingList
+// -----------------------------------------------------------------------------
+
+    bool BTreeIndex::removeFromPostingList(PageId headNum, const RecordId& rid, bool& emptied)
+    {
+        emptied = false;
+
+        // the record id can only be in the first page whose last record id does not come before it
+        PageId prevNum = Page::INVALID_NUMBER;
+        PageId pageNum = headNum;
+        Page* page;
+        PostingPage* posting;
+        int index;
+        while (true)
+        {
+            if (pageNum == Page::INVALID_NUMBER)
+            {
+                return false;
+            }
+            bufMgr->readPage(file, pageNum, page);
+            posting = (PostingPage*) page;
+            index = postingLowerBound(posting, rid);
+            if (index < posting->header.numKeys)
+            {
+                break;
+            }
+            PageId nextNum = posting->header.rightSibPageNo;
+            bufMgr->unPinPage(file, pageNum, false);
+            prevNum = pageNum;
+            pageNum = nextNum;
+        }
+        if (posting->ridArray[index] != rid)
+        {
+            bufMgr->unPinPage(file, pageNum, false);
+            return false;
+        }
+
+        int numRids = posting->header.numKeys;
+        std::copy(posting->ridArray + index + 1, posting->ridArray + numRids, posting->ridArray + index);
+        posting->header.numKeys--;
+        if (pageNum == headNum)
+        {
+            posting->totalRids--;
+        }
+        else
+        {
+            Page* headPage;
+            bufMgr->readPage(file, headNum, headPage);
+            ((PostingPage*) headPage)->totalRids--;
+            bufMgr->unPinPage(file, headNum, true);
+        }
+        if (posting->header.numKeys > 0)
+        {
+            bufMgr->unPinPage(file, pageNum, true);
+            return true;
+        }
+
+        // drop the page left empty. The first page stays first, taking over the record ids of the second one
+        PageId nextNum = posting->header.rightSibPageNo;
+        if (pageNum == headNum)
+        {
+            if (nextNum == Page::INVALID_NUMBER)
+            {
+                freeNode(pageNum, page);
+                emptied = true;
+                return true;
+            }
+
+            Page* nextPage;
+            bufMgr->readPage(file, nextNum, nextPage);
+            PostingPage* next = (PostingPage*) nextPage;
+            std::copy(next->ridArray, next->ridArray + next->header.numKeys, posting->ridArray);
+            posting->header.numKeys = next->header.numKeys;
+            posting->header.rightSibPageNo = next->header.rightSibPageNo;
+            if (posting->lastPageNo == nextNum)
+            {
+                posting->lastPageNo = headNum;
+            }
+            freeNode(nextNum, nextPage);
+            setLeftSibling(posting->header.rightSibPageNo, headNum);
+            bufMgr->unPinPage(file, pageNum, true);
+            return true;
+        }
+        freeNode(pageNum, page);
+
+        Page* prevPage;
+        bufMgr->readPage(file, prevNum, prevPage);
+        ((PostingPage*) prevPage)->header.rightSibPageNo = nextNum;
+        bufMgr->unPinPage(file, prevNum, true);
+        setLeftSibling(nextNum, prevNum);
+
+        Page* headPage;
+        bufMgr->readPage(file, headNum, headPage);
+        PostingPage* head = (PostingPage*) headPage;
+        if (head->lastPageNo == pageNum)
+        {
+            head->lastPageNo = prevNum;
+        }
+        bufMgr->unPinPage(file, headNum, true);
+        return true;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::readPostingList
+// -----------------------------------------------------------------------------
+
+    void BTreeIndex::readPostingList(PageId headNum, std::vector<RecordId>& outRids)
+    {
+        PageId pageNum = headNum;
+        while (pageNum != Page::INVALID_NUMBER)
+        {
+            Page* page;
+            bufMgr->readPage(file, pageNum, page);
+            PostingPage* posting = (PostingPage*) page;
+            outRids.insert(outRids.end(), posting->ridArray, posting->ridArray + posting->header.numKeys);
+            PageId nextNum = posting->header.rightSibPageNo;
+            bufMgr->unPinPage(file, pageNum, false);
+            pageNum = nextNum;
+        }
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::freePostingList
+// -----------------------------------------------------------------------------
+
+    void BTreeIndex::freePostingList(PageId headNum)
+    {
+        PageId pageNum = headNum;
+        while (pageNum != Page::INVALID_NUMBER)
+        {
+            Page* page;
+            bufMgr->readPage(file, pageNum, page);
+            PageId nextNum = ((PostingPage*) page)->header.rightSibPageNo;
+            freeNode(pageNum, page);
+            pageNum = nextNum;
+        }
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::postingListSize
+// -----------------------------------------------------------------------------
+
+    std::uint64_t BTreeIndex::postingListSize(PageId headNum)
+    {
+        Page* page;
+        bufMgr->readPage(file, headNum, page);
+        std::uint64_t size = ((PostingPage*) page)->totalRids;
+        bufMgr->unPinPage(file, headNum, false);
+        return size;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::postingListEntry
+// -----------------------------------------------------------------------------
+
+    RecordId BTreeIndex::postingListEntry(PageId headNum, std::uint64_t index)
+    {
+        PageId pageNum = headNum;
+        while (true)
+        {
+            Page* page;
+            bufMgr->readPage(file, pageNum, page);
+            PostingPage* posting = (PostingPage*) page;
+            std::uint64_t numRids = posting->header.numKeys;
+            PageId nextNum = posting->header.rightSibPageNo;
+            if (index < numRids || nextNum == Page::INVALID_NUMBER)
+            {
+                RecordId rid = posting->ridArray[std::min(index, numRids - 1)];
+                bufMgr->unPinPage(file, pageNum, false);
+                return rid;
+            }
+            bufMgr->unPinPage(file, pageNum, false);
+            index -= numRids;
+            pageNum = nextNum;
+        }
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::nextPostingRids
+// -----------------------------------------------------------------------------
+
+    std::size_t BTreeIndex::nextPostingRids(ScanCursor& cursor, PageId headNum, RecordId* outRids,
+                                            std::size_t maxRids)
+    {
+        // a descending scan starts from the last page of the list, an entry past the end of a page standing
+        // for its last record id
+        if (cursor.postingPageNum == Page::INVALID_NUMBER)
+        {
+            cursor.postingPageNum = headNum;
+            cursor.postingEntry = 0;
+            if (cursor.descending)
+            {
+                Page* page;
+                bufMgr->readPage(file, headNum, page);
+                cursor.postingPageNum = ((PostingPage*) page)->lastPageNo;
+                cursor.postingEntry = PostingPage::CAPACITY;
+                bufMgr->unPinPage(file, headNum, false);
+            }
+        }
+
+        std::size_t count = 0;
+        while (count < maxRids)
+        {
+            Page* page;
+            bufMgr->readPage(file, cursor.postingPageNum, page);
+            PostingPage* posting = (PostingPage*) page;
+            int numRids = posting->header.numKeys;
+            PageId nextNum;
+            bool pageDone;
+            if (cursor.descending)
+            {
+                int end = std::min(cursor.postingEntry + 1, numRids);
+                int taken = std::min((std::size_t) std::max(end, 0), maxRids - count);
+                std::reverse_copy(posting->ridArray + end - taken, posting->ridArray + end, outRids + count);
+                cursor.postingEntry = end - 1 - taken;
+                count += taken;
+                nextNum = posting->header.leftSibPageNo;
+                pageDone = (cursor.postingEntry < 0);
+            }
+            else
+            {
+                std::size_t taken = std::min((std::size_t) std::max(numRids - cursor.postingEntry, 0), maxRids - count);
+                std::copy(posting->ridArray + cursor.postingEntry, posting->ridArray + cursor.postingEntry + taken,
+                          outRids + count);
+                cursor.postingEntry += taken;
+                count += taken;
+                nextNum = posting->header.rightSibPageNo;
+                pageDone = (cursor.postingEntry >= numRids);
+            }
+            bufMgr->unPinPage(file, cursor.postingPageNum, false);
+
+            if (pageDone)
+            {
+                cursor.postingPageNum = nextNum;
+                cursor.postingEntry = cursor.descending ? PostingPage::CAPACITY : 0;
+                if (nextNum == Page::INVALID_NUMBER)
+                {
+                    cursor.nextEntry += cursor.descending ? -1 : 1;
+                    break;
+                }
+            }
+        }
+        return count;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::seekPostingList
+// -----------------------------------------------------------------------------
+
+    bool BTreeIndex::seekPostingList(ScanCursor& cursor, PageId headNum, const RecordId& rid)
+    {
+        // the record ids past the one sought start in the first page whose last record id is not before it
+        PageId pageNum = headNum;
+        while (true)
+        {
+            Page* page;
+            bufMgr->readPage(file, pageNum, page);
+            PostingPage* posting = (PostingPage*) page;
+            int numRids = posting->header.numKeys;
+            int index = postingLowerBound(posting, rid);
+            bool found = index < numRids && posting->ridArray[index] == rid;
+            PageId nextNum = posting->header.rightSibPageNo;
+            PageId prevNum = posting->header.leftSibPageNo;
+            bufMgr->unPinPage(file, pageNum, false);
+            if (index == numRids && nextNum != Page::INVALID_NUMBER)
+            {
+                pageNum = nextNum;
+                continue;
+            }
+
+            // a descending scan is left on the record id before it, an entry past the end of a page standing
+            // for its last record id
+            if (cursor.descending)
+            {
+                if (index == 0 && prevNum == Page::INVALID_NUMBER)
+                {
+                    return false;
+                }
+                cursor.postingPageNum = (index == 0) ? prevNum : pageNum;
+                cursor.postingEntry = (index == 0) ? PostingPage::CAPACITY : index - 1;
+                return true;
+            }
+
+            index += found;
+            if (index == numRids && nextNum == Page::INVALID_NUMBER)
+            {
+                return false;
+            }
+            cursor.postingPageNum = (index == numRids) ? nextNum : pageNum;
+            cursor.postingEntry = (index == numRids) ? 0 : index;
+            return true;
+        }
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::~BTreeIndex -- destructor
+// -----------------------------------------------------------------------------
+
+    BTreeIndex::~BTreeIndex()
+    {
+        // the pinned leaf of the scan would keep the file from being flushed
+        if (scan.isExecuting())
+        {
+            scan.endScan();
+        }
+
+        // the statistics are only written to the meta page along with the rest of it
+        updateMetaPage();
+        bufMgr->flushFile(file);
+        delete file;
+
+        if (relationFile != NULL)
+        {
+            bufMgr->flushFile(relationFile);
+            delete relationFile;
+        }
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::insertEntry
+// -----------------------------------------------------------------------------
+
+    void BTreeIndex::insertEntry(const void *key, const RecordId rid)
+    {
+        // an entry changes the counts all the way from the root, which only a batch of one updates
+        if (counted)
+        {
+            insertBatch(&key, &rid, 1);
+            return;
+        }
+
+        SharedLatchGuard guard(structureLatch);
+        (this->*keyOps->insertEntry)(key, rid);
+    }
+
+    template <class T>
+    void BTreeIndex::insertEntryTyped(const void *key, const RecordId rid)
+    {
+        // Splitting logic
+        /*
+        If the tree is empty insert the root node
+        Else determine if the value should go to left or right of the root
+        */
+        /*
+        1) Search for appropriate location to add an entry
+        2) Check if the node has the space for a new entry
+            a) if there is no space split the entry into two entries. If there is space then insert and terminate
+            b) Is this entry a leaf node?
+                i) If yes then copy the middle node into the parent entry
+                ii) If no then move the middle node to the parent entry
+            c) insert index entry pointing towards the new half of the split entry into the parent entry
+
+         */
+        // a covering index reads the values of the included columns before any leaf is latched
+        std::vector<char> includedValues(includedSize);
+        const char* included = NULL;
+        if (includedSize > 0)
+        {
+            readIncluded(rid, &includedValues[0]);
+            included = &includedValues[0];
+        }
+
+        if (!appendToEdgeLeaf<T>(keyFromBytes<T>(key), rid, included) && !insertOptimistic<T>(key, rid, included))
+        {
+            insertPessimistic<T>(key, rid, included);
+        }
+        addStatistics<T>(keyFromBytes<T>(key));
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::insertOptimistic
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    bool BTreeIndex::insertOptimistic(const void *key, const RecordId rid, const char* included)
+    {
+        PageId pageNum;
+        bool leftmost;
+        bool rightmost;
+        PageId parentNum;
+        int childIndex;
+        latchLeaf<T>(keyFromBytes<T>(key), &rid, true, false, pageNum, leftmost, rightmost, parentNum, childIndex);
+
+        // a key with a posting list in the leaf takes no room in it
+        Page* page;
+        bufMgr->readPage(file, pageNum, page);
+        LeafNode<T>* leaf = (LeafNode<T>*) page;
+        T k = keyFromBytes<T>(key);
+        int numKeys = leaf->header.numKeys;
+        bool fits = numKeys < leafOccupancy ||
+                findPostingList(leaf, searchLowerBound(leaf->keyArray, numKeys, k), k) >= 0;
+        bufMgr->unPinPage(file, pageNum, false);
+        if (fits)
+        {
+            insertLeaf<T>(pageNum, key, rid, included, leftmost, rightmost);
+        }
+        latches[pageNum].unlock();
+        return fits;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::insertPessimistic
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    void BTreeIndex::insertPessimistic(const void *key, const RecordId rid, const char* included)
+    {
+        T k = keyFromBytes<T>(key);
+
+        // nodes latched for writing, top down. The root latch counts as the parent of the root
+        std::vector<PageId> held;
+        rootLatch.lock();
+        bool holdingRoot = true;
+
+        PageId pageNum = rootPageNum;
+        latches[pageNum].lock();
+        PageId top = pageNum;
+        bool topIsLeaf = rootIsLeaf;
+        bool topLeftmost = true;
+        bool topRightmost = true;
+        bool leftmost = true;
+        bool rightmost = true;
+        while (true)
+        {
+            Page* page;
+            bufMgr->readPage(file, pageNum, page);
+            NodeHeader* header = (NodeHeader*) page;
+            bool isLeaf = (header->level == 0);
+
+            // a node with room for one more key absorbs any split below it, the nodes above stay as they are
+            if (header->numKeys < (isLeaf ? leafOccupancy : nodeOccupancy))
+            {
+                for (std::size_t i = 0; i < held.size(); i++)
+                {
+                    latches[held[i]].unlock();
+                }
+                held.clear();
+                if (holdingRoot)
+                {
+                    rootLatch.unlock();
+                    holdingRoot = false;
+                }
+                top = pageNum;
+                topIsLeaf = isLeaf;
+                topLeftmost = leftmost;
+                topRightmost = rightmost;
+            }
+            held.push_back(pageNum);
+
+            if (isLeaf)
+            {
+                bufMgr->unPinPage(file, pageNum, false);
+                break;
+            }
+
+            NonLeafNode<T>* node = (NonLeafNode<T>*) page;
+            int numKeys = node->header.numKeys;
+            int index = childForEntry(node, numKeys, k, rid, NULL, 0);
+            PageId childNum = node->pageNoArray[index];
+            leftmost = leftmost && index == 0;
+            rightmost = rightmost && index == numKeys;
+            bufMgr->unPinPage(file, pageNum, false);
+
+            latches[childNum].lock();
+            pageNum = childNum;
+        }
+
+        // every node from the top down is latched, the insert takes the same path through them
+        PageKeyPair<T> split;
+        if (topIsLeaf)
+        {
+            split = insertLeaf<T>(top, key, rid, included, topLeftmost, topRightmost);
+        }
+        else
+        {
+            split = insertNode<T>(top, key, rid, included, topLeftmost, topRightmost);
+        }
+
+		// check if the root is to be split, which only happens while the root latch is held
+        if (split.pageNo != Page::INVALID_NUMBER)
+        {
+            // the new root sits one level above the old one
+            Page* oldRoot;
+            bufMgr->readPage(file, rootPageNum, oldRoot);
+            int rootLevel = ((NodeHeader*) oldRoot)->level + 1;
+            bufMgr->unPinPage(file, rootPageNum, false);
+
+			// create new root node
+            Page* page;
+            PageId newRootNum;
+
+            allocNode(newRootNum, page);
+
+            NonLeafNode<T>* node = (NonLeafNode<T>*) page;
+            node->header.initialize(rootLevel);
+            node->header.numKeys = 1;
+            node->keyArray[0] = split.key;
+            node->pageNoArray[0] = rootPageNum;
+            node->pageNoArray[1] = split.pageNo;
+            bufMgr->unPinPage(file, newRootNum, true);
+
+            {
+                std::lock_guard<std::mutex> lock(metaMutex);
+                rootPageNum = newRootNum;
+                rootIsLeaf = false;
+            }
+
+            //  update root page number in the header
+            updateMetaPage();
+        }
+
+        for (std::size_t i = 0; i < held.size(); i++)
+        {
+            latches[held[i]].unlock();
+        }
+        if (holdingRoot)
+        {
+            rootLatch.unlock();
+        }
+    }
+
+    // -----------------------------------------------------------------------------
+    // BTreeIndex::insertNode
+    // -----------------------------------------------------------------------------
+
+    template <class T>
+    PageKeyPair<T> BTreeIndex::insertNode(PageId pageNum, const void *key, const RecordId rid,
+                                          const char* included, bool leftmost, bool rightmost)
+    {
+        Page* page;
+        bufMgr->readPage(file, pageNum, page);
+        NonLeafNode<T>* node = (NonLeafNode<T>*) page;
+
+		// find the child whose entries the new one falls among, in the order of key and then record id
+        T k = keyFromBytes<T>(key);
+        int numKeys = node->header.numKeys;
+        int index = childForEntry(node, numKeys, k, rid, NULL, 0);
+
+        // Determine if the current node is at the level above the leaf nodes
+        PageKeyPair<T> split;
+        bool leftmostChild = leftmost && index == 0;
+        bool rightmostChild = rightmost && index == numKeys;
+        if (node->header.level == 1)
+        {
+            split = insertLeaf<T>(node->pageNoArray[index], key, rid, included, leftmostChild, rightmostChild);
+        }
+        else
+        {
+            split = insertNode<T>(node->pageNoArray[index], key, rid, included, leftmostChild, rightmostChild);
+        }
+
+        PageKeyPair<T> pair;
+        pair.set(Page::INVALID_NUMBER, T());
+
+        // children of node were not split, nothing to add here
+        if (split.pageNo == Page::INVALID_NUMBER)
+        {
+            bufMgr->unPinPage(file, pageNum, false);
+            return pair;
+        }
+
+        if (numKeys < nodeOccupancy)
+        {
+            // shift keys right and add the new child after the one that was split
+            std::copy_backward(node->keyArray + index, node->keyArray + numKeys, node->keyArray + numKeys + 1);
+            std::copy_backward(node->pageNoArray + index + 1, node->pageNoArray + numKeys + 1, node->pageNoArray + numKeys + 2);
+            node->keyArray[index] = split.key;
+            node->pageNoArray[index + 1] = split.pageNo;
+            node->header.numKeys++;
+        }
+        else
+        {
+            // node is full, lay out its keys and children along with the new ones in order
+            std::vector<T> keys(node->keyArray, node->keyArray + numKeys);
+            std::vector<PageId> children(node->pageNoArray, node->pageNoArray + numKeys + 1);
+            keys.insert(keys.begin() + index, split.key);
+            children.insert(children.begin() + index + 1, split.pageNo);
+
+            // create new node for splitting
+            Page* splitPage;
+            PageId splitID;
+            allocNode(splitID, splitPage);
+            NonLeafNode<T>* splitNode = (NonLeafNode<T>*) splitPage;
+            splitNode->header.initialize(node->header.level);
+            splitNode->header.rightSibPageNo = node->header.rightSibPageNo;
+            splitNode->header.leftSibPageNo = pageNum;
+            node->header.rightSibPageNo = splitID;
+            setLeftSibling(splitNode->header.rightSibPageNo, splitID);
+
+            // the middle key is pushed up, the keys on its left stay and the ones on its right move.
+            // A child added at the far end of the level is split off with one key next to it,
+            // leaving the rest of the node full
+            int mid = keys.size() / 2;
+            if (rightmostChild)
+            {
+                mid = keys.size() - 2;
+            }
+            else if (leftmostChild)
+            {
+                mid = 1;
+            }
+            node->header.numKeys = mid;
+            std::copy(keys.begin(), keys.begin() + mid, node->keyArray);
+            std::copy(children.begin(), children.begin() + mid + 1, node->pageNoArray);
+
+            splitNode->header.numKeys = keys.size() - mid - 1;
+            std::copy(keys.begin() + mid + 1, keys.end(), splitNode->keyArray);
+            std::copy(children.begin() + mid + 1, children.end(), splitNode->pageNoArray);
+
+            pair.set(splitID, keys[mid]);
+            splitNode->header.lowRid = lowRidOf(children[mid + 1]);
+            bufMgr->unPinPage(file, splitID, true);
+        }
+        bufMgr->unPinPage(file, pageNum, true);
+        return pair;
+    }
+
+    /*
+    Helper method for the insertNode, manages adding a leaf to the b+ tree.
+    */
+    template <class T>
+    PageKeyPair<T> BTreeIndex::insertLeaf(PageId pageNum, const void *key, const RecordId rid,
+                                          const char* included, bool leftmost, bool rightmost)
+    {
+        Page* page;
+        bufMgr->readPage(file, pageNum, page);
+        
+        // figure out where to insert the new record
+        LeafNode<T>* leaf = (LeafNode<T>*) page;
+        T k = keyFromBytes<T>(key);
+        int numKeys = leaf->header.numKeys;
+
+        // a full leaf moves its long runs of duplicates to posting lists first, which may leave it room
+        if (numKeys >= leafOccupancy)
+        {
+            numKeys = packDuplicates(leaf->keyArray, leaf->ridArray, numKeys);
+            leaf->header.numKeys = numKeys;
+        }
+        int posting = findPostingList(leaf, searchLowerBound(leaf->keyArray, numKeys, k), k);
+        int index = entryUpperBound(leaf, numKeys, k, rid);
+
+        PageKeyPair<T> pair;
+        pair.set(Page::INVALID_NUMBER, T());
+
+        if (posting >= 0)
+        {
+            addToPostingList(leaf->ridArray[posting].pageNumber(), rid);
+        }
+        else if (numKeys < leafOccupancy)
+        {
+            // Leaf isn't full, shift over elements to the right and add to leaf
+            std::copy_backward(leaf->keyArray + index, leaf->keyArray + numKeys, leaf->keyArray + numKeys + 1);
+            std::copy_backward(leaf->ridArray + index, leaf->ridArray + numKeys, leaf->ridArray + numKeys + 1);
+            moveIncluded(leaf, index, leaf, index + 1, numKeys - index);
+            leaf->keyArray[index] = k;
+            leaf->ridArray[index] = rid;
+            storeIncluded(leaf, index, included);
+            leaf->header.numKeys++;
+        }
+        else
+        {
+            // leaf is full, split into two leaves
+
+			// create the new leaf
+            Page* split;
+            PageId splitID;
+            allocNode(splitID, split);
+            LeafNode<T>* splitNode = (LeafNode<T>*) split;
+            splitNode->header.initialize(0);
+            splitNode->header.rightSibPageNo = leaf->header.rightSibPageNo;
+            splitNode->header.leftSibPageNo = pageNum;
+            leaf->header.rightSibPageNo = splitID;
+            setLeftSibling(splitNode->header.rightSibPageNo, splitID);
+
+            // the current leaf keeps the first half of the entries, including the new one,
+            // unless the new entry goes past either end of the tree
+            int leftCount = (numKeys + 2) / 2;
+            if (rightmost && index == numKeys)
+            {
+                leftCount = numKeys;
+            }
+            else if (leftmost && index == 0)
+            {
+                leftCount = 1;
+            }
+
+            if (index < leftCount)
+            {
+				// copies the second half of the leaf to the new leaf
+                std::copy(leaf->keyArray + leftCount - 1, leaf->keyArray + numKeys, splitNode->keyArray);
+                std::copy(leaf->ridArray + leftCount - 1, leaf->ridArray + numKeys, splitNode->ridArray);
+                moveIncluded(leaf, leftCount - 1, splitNode, 0, numKeys - leftCount + 1);
+
+				// shifts the elements greater than the element we are inserting right
+                std::copy_backward(leaf->keyArray + index, leaf->keyArray + leftCount - 1, leaf->keyArray + leftCount);
+                std::copy_backward(leaf->ridArray + index, leaf->ridArray + leftCount - 1, leaf->ridArray + leftCount);
+                moveIncluded(leaf, index, leaf, index + 1, leftCount - 1 - index);
+                leaf->keyArray[index] = k;
+                leaf->ridArray[index] = rid;
+                storeIncluded(leaf, index, included);
+            }
+            else
+            {
+                // copy the second half of the current leaf into the new leaf, with the new entry in place
+                int splitIndex = index - leftCount;
+                std::copy(leaf->keyArray + leftCount, leaf->keyArray + index, splitNode->keyArray);
+                std::copy(leaf->ridArray + leftCount, leaf->ridArray + index, splitNode->ridArray);
+                moveIncluded(leaf, leftCount, splitNode, 0, splitIndex);
+                splitNode->keyArray[splitIndex] = k;
+                splitNode->ridArray[splitIndex] = rid;
+                storeIncluded(splitNode, splitIndex, included);
+                std::copy(leaf->keyArray + index, leaf->keyArray + numKeys, splitNode->keyArray + splitIndex + 1);
+                std::copy(leaf->ridArray + index, leaf->ridArray + numKeys, splitNode->ridArray + splitIndex + 1);
+                moveIncluded(leaf, index, splitNode, splitIndex + 1, numKeys - index);
+            }
+            leaf->header.numKeys = leftCount;
+            splitNode->header.numKeys = numKeys + 1 - leftCount;
+
+            pair.set(splitID, splitNode->keyArray[0]);
+            splitNode->header.lowRid = leafLowRid(leaf->keyArray[leftCount - 1], splitNode->keyArray[0],
+                                                  splitNode->ridArray[0]);
+            bufMgr->unPinPage(file, splitID, true);
+        }
+
+        // the leaf split off the rightmost leaf is the new rightmost one
+        if (leftmost)
+        {
+            leftmostLeafPageNo = pageNum;
+        }
+        if (rightmost)
+        {
+            rightmostLeafPageNo = (pair.pageNo != Page::INVALID_NUMBER) ? pair.pageNo : pageNum;
+        }
+
+        // unpin pages
+        bufMgr->unPinPage(file, pageNum, true);
+        return pair;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::appendToEdgeLeaf
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    bool BTreeIndex::appendToEdgeLeaf(const T& key, const RecordId rid, const char* included)
+    {
+        // the key goes to the end of the rightmost leaf if it is larger than any key in the tree, and to the
+        // start of the leftmost leaf if it is smaller. A key equal to the one at the end may have a posting
+        // list there, so duplicates are left to the descent
+        PageId pageNum = rightmostLeafPageNo;
+        if (pageNum != Page::INVALID_NUMBER)
+        {
+            latches[pageNum].lock();
+            Page* page;
+            bufMgr->readPage(file, pageNum, page);
+            LeafNode<T>* leaf = (LeafNode<T>*) page;
+            int numKeys = leaf->header.numKeys;
+
+            // the cached page stops being the rightmost leaf if it split before it was latched
+            if (leaf->header.rightSibPageNo == Page::INVALID_NUMBER &&
+                    numKeys > 0 && numKeys < leafOccupancy && leaf->keyArray[numKeys - 1] < key)
+            {
+                leaf->keyArray[numKeys] = key;
+                leaf->ridArray[numKeys] = rid;
+                storeIncluded(leaf, numKeys, included);
+                leaf->header.numKeys++;
+                bufMgr->unPinPage(file, pageNum, true);
+                latches[pageNum].unlock();
+                return true;
+            }
+            bufMgr->unPinPage(file, pageNum, false);
+            latches[pageNum].unlock();
+        }
+
+        // the leftmost leaf keeps its page when it splits
+        pageNum = leftmostLeafPageNo;
+        if (pageNum != Page::INVALID_NUMBER)
+        {
+            latches[pageNum].lock();
+            Page* page;
+            bufMgr->readPage(file, pageNum, page);
+            LeafNode<T>* leaf = (LeafNode<T>*) page;
+            int numKeys = leaf->header.numKeys;
+            if (numKeys > 0 && numKeys < leafOccupancy && key < leaf->keyArray[0])
+            {
+                std::copy_backward(leaf->keyArray, leaf->keyArray + numKeys, leaf->keyArray + numKeys + 1);
+                std::copy_backward(leaf->ridArray, leaf->ridArray + numKeys, leaf->ridArray + numKeys + 1);
+                moveIncluded(leaf, 0, leaf, 1, numKeys);
+                leaf->keyArray[0] = key;
+                leaf->ridArray[0] = rid;
+                storeIncluded(leaf, 0, included);
+                leaf->header.numKeys++;
+                bufMgr->unPinPage(file, pageNum, true);
+                latches[pageNum].unlock();
+                return true;
+            }
+            bufMgr->unPinPage(file, pageNum, false);
+            latches[pageNum].unlock();
+        }
+        return false;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::insertBatch
+// -----------------------------------------------------------------------------
+
+    void BTreeIndex::insertBatch(const void* const* keys, const RecordId* rids, std::size_t numEntries)
+    {
+        std::lock_guard<NodeLatch> guard(structureLatch);
+        structureVersion++;
+        (this->*keyOps->insertBatch)(keys, rids, numEntries);
+    }
+
+    template <class T>
+    void BTreeIndex::insertBatchTyped(const void* const* keys, const RecordId* rids, std::size_t numEntries)
+    {
+        if (numEntries == 0)
+        {
+            return;
+        }
+
+        // runs of a covering index carry no included values, its entries go in one at a time
+        if (includedSize > 0)
+        {
+            for (std::size_t i = 0; i < numEntries; i++)
+            {
+                insertEntryTyped<T>(keys[i], rids[i]);
+            }
+            return;
+        }
+
+        // the leaves at either end may be split, they are found again by the next insert reaching them
+        leftmostLeafPageNo = Page::INVALID_NUMBER;
+        rightmostLeafPageNo = Page::INVALID_NUMBER;
+
+        std::vector<RIDKeyPair<T> > entries(numEntries);
+        for (std::size_t i = 0; i < numEntries; i++)
+        {
+            entries[i].set(rids[i], keyFromBytes<T>(keys[i]));
+            addStatistics<T>(entries[i].key);
+        }
+        std::sort(entries.begin(), entries.end());
+
+        std::vector<PageKeyPair<T> > splits;
+        if (rootIsLeaf)
+        {
+            insertLeafRun<T>(rootPageNum, &entries[0], &entries[0] + numEntries, splits);
+        }
+        else
+        {
+            insertNodeRun<T>(rootPageNum, &entries[0], &entries[0] + numEntries, splits);
+        }
+
+        // the root may have been split into more nodes than a new root can hold,
+        // add levels until a single node is left at the top
+        bool rootChanged = !splits.empty();
+        while (!splits.empty())
+        {
+            Page* oldRoot;
+            bufMgr->readPage(file, rootPageNum, oldRoot);
+            int rootLevel = ((NodeHeader*) oldRoot)->level + 1;
+            bufMgr->unPinPage(file, rootPageNum, false);
+
+            std::vector<T> rootKeys;
+            std::vector<PageId> rootChildren(1, rootPageNum);
+            for (std::size_t i = 0; i < splits.size(); i++)
+            {
+                rootKeys.push_back(splits[i].key);
+                rootChildren.push_back(splits[i].pageNo);
+            }
+            splits.clear();
+            std::vector<std::uint64_t> rootCounts;
+            for (std::size_t i = 0; counted && i < rootChildren.size(); i++)
+            {
+                rootCounts.push_back(subtreeEntries<T>(rootChildren[i]));
+            }
+
+            Page* page;
+            PageId pageNum;
+            allocNode(pageNum, page);
+            NonLeafNode<T>* node = (NonLeafNode<T>*) page;
+            node->header.initialize(rootLevel);
+            fillNode<T>(pageNum, node, rootKeys, rootChildren, rootCounts, splits);
+            bufMgr->unPinPage(file, pageNum, true);
+
+            rootPageNum = pageNum;
+            rootIsLeaf = false;
+        }
+
+        if (rootChanged)
+        {
+            updateMetaPage();
+        }
+    }
+
+    template <class T>
+    void BTreeIndex::insertNodeRun(PageId pageNum, const RIDKeyPair<T>* begin, const RIDKeyPair<T>* end,
+                                   std::vector<PageKeyPair<T> >& splits)
+    {
+        Page* page;
+        bufMgr->readPage(file, pageNum, page);
+        NonLeafNode<T>* node = (NonLeafNode<T>*) page;
+        int numKeys = node->header.numKeys;
+
+        // child i takes the entries with keys in (keyArray[i - 1], keyArray[i]], those equal to a separator
+        // split by the low record id of the child on its right, as insertNode() routes them. The nodes split
+        // off a child go right after it. The counts of the children that took entries are taken again from them
+        std::vector<T> keys;
+        std::vector<PageId> children;
+        std::vector<std::uint64_t> counts;
+        bool split = false;
+        const RIDKeyPair<T>* runBegin = begin;
+        for (int i = 0; i <= numKeys; i++)
+        {
+            const RIDKeyPair<T>* runEnd = end;
+            if (i < numKeys)
+            {
+                const T& separator = node->keyArray[i];
+                runEnd = std::upper_bound(runBegin, end, separator,
+                        [](const T& key, const RIDKeyPair<T>& entry) { return key < entry.key; });
+                if (runEnd != runBegin && !((runEnd - 1)->key < separator))
+                {
+                    RIDKeyPair<T> fence;
+                    fence.set(lowRidOf(node->pageNoArray[i + 1]), separator);
+                    runEnd = std::lower_bound(runBegin, runEnd, fence);
+                }
+            }
+
+            children.push_back(node->pageNoArray[i]);
+            if (counted)
+            {
+                counts.push_back(childCount(node, i));
+            }
+            if (runBegin != runEnd)
+            {
+                std::vector<PageKeyPair<T> > childSplits;
+                if (node->header.level == 1)
+                {
+                    insertLeafRun<T>(node->pageNoArray[i], runBegin, runEnd, childSplits);
+                }
+                else
+                {
+                    insertNodeRun<T>(node->pageNoArray[i], runBegin, runEnd, childSplits);
+                }
+                for (std::size_t s = 0; s < childSplits.size(); s++)
+                {
+                    keys.push_back(childSplits[s].key);
+                    children.push_back(childSplits[s].pageNo);
+                }
+                if (counted)
+                {
+                    counts.resize(children.size() - childSplits.size() - 1);
+                    for (std::size_t c = counts.size(); c < children.size(); c++)
+                    {
+                        counts.push_back(subtreeEntries<T>(children[c]));
+                    }
+                }
+                split = split || !childSplits.empty();
+            }
+            if (i < numKeys)
+            {
+                keys.push_back(node->keyArray[i]);
+            }
+            runBegin = runEnd;
+        }
+
+        // children of node were not split, nothing to add here but their counts
+        if (!split)
+        {
+            for (std::size_t c = 0; c < counts.size(); c++)
+            {
+                setChildCount(node, c, counts[c]);
+            }
+            bufMgr->unPinPage(file, pageNum, counted);
+            return;
+        }
+
+        fillNode<T>(pageNum, node, keys, children, counts, splits);
+        bufMgr->unPinPage(file, pageNum, true);
+    }
+
+    template <class T>
+    void BTreeIndex::insertLeafRun(PageId pageNum, const RIDKeyPair<T>* begin, const RIDKeyPair<T>* end,
+                                   std::vector<PageKeyPair<T> >& splits)
+    {
+        Page* page;
+        bufMgr->readPage(file, pageNum, page);
+        LeafNode<T>* leaf = (LeafNode<T>*) page;
+        int numKeys = leaf->header.numKeys;
+
+        // new entries with a key that has a posting list in the leaf join it, the others are merged in by key
+        // and record id like insertLeaf() places them
+        std::vector<RIDKeyPair<T> > merged;
+        merged.reserve(end - begin);
+        for (const RIDKeyPair<T>* entry = begin; entry != end; entry++)
+        {
+            int posting = findPostingList(leaf, searchLowerBound(leaf->keyArray, numKeys, entry->key), entry->key);
+            if (posting >= 0)
+            {
+                addToPostingList(leaf->ridArray[posting].pageNumber(), entry->rid);
+            }
+            else
+            {
+                merged.push_back(*entry);
+            }
+        }
+        int numNew = merged.size();
+
+        if (numKeys + numNew <= leafOccupancy)
+        {
+            // merge in place from the back, so that every entry moves once
+            int index = numKeys - 1;
+            int pos = numKeys + numNew - 1;
+            for (int e = numNew - 1; e >= 0; e--, pos--)
+            {
+                const RIDKeyPair<T>& entry = merged[e];
+                while (index >= 0 && entryBefore(entry.key, entry.rid, leaf->keyArray[index], leaf->ridArray[index]))
+                {
+                    leaf->keyArray[pos] = leaf->keyArray[index];
+                    leaf->ridArray[pos] = leaf->ridArray[index];
+                    index--;
+                    pos--;
+                }
+                leaf->keyArray[pos] = entry.key;
+                leaf->ridArray[pos] = entry.rid;
+            }
+            leaf->header.numKeys = numKeys + numNew;
+            bufMgr->unPinPage(file, pageNum, true);
+            return;
+        }
+
+        std::vector<T> keys;
+        std::vector<PackedRecordId> ridList;
+        keys.reserve(numKeys + numNew);
+        ridList.reserve(numKeys + numNew);
+        int index = 0;
+        for (int e = 0; e < numNew; e++)
+        {
+            const RIDKeyPair<T>& entry = merged[e];
+            while (index < numKeys && entryBefore(leaf->keyArray[index], leaf->ridArray[index], entry.key, entry.rid))
+            {
+                keys.push_back(leaf->keyArray[index]);
+                ridList.push_back(leaf->ridArray[index]);
+                index++;
+            }
+            keys.push_back(entry.key);
+            ridList.push_back(entry.rid);
+        }
+        keys.insert(keys.end(), leaf->keyArray + index, leaf->keyArray + numKeys);
+        ridList.insert(ridList.end(), leaf->ridArray + index, leaf->ridArray + numKeys);
+
+        // spread the entries evenly over as few leaves as hold them, the first one being this leaf,
+        // once long runs of duplicates are moved to posting lists
+        int total = packDuplicates(&keys[0], &ridList[0], keys.size());
+        int pieces = (total + leafOccupancy - 1) / leafOccupancy;
+        LeafNode<T>* current = leaf;
+        PageId currentNum = pageNum;
+        int start = 0;
+        for (int p = 0; p < pieces; p++)
+        {
+            int count = total / pieces + (p < total % pieces);
+            if (p > 0)
+            {
+                Page* splitPage;
+                PageId splitID;
+                allocNode(splitID, splitPage);
+                LeafNode<T>* splitLeaf = (LeafNode<T>*) splitPage;
+                splitLeaf->header.initialize(0);
+                splitLeaf->header.rightSibPageNo = current->header.rightSibPageNo;
+                splitLeaf->header.leftSibPageNo = currentNum;
+                current->header.rightSibPageNo = splitID;
+                if (currentNum != pageNum)
+                {
+                    bufMgr->unPinPage(file, currentNum, true);
+                }
+                current = splitLeaf;
+                currentNum = splitID;
+
+                PageKeyPair<T> pair;
+                pair.set(splitID, keys[start]);
+                splits.push_back(pair);
+                splitLeaf->header.lowRid = leafLowRid(keys[start - 1], keys[start], ridList[start]);
+            }
+            current->header.numKeys = count;
+            std::copy(keys.begin() + start, keys.begin() + start + count, current->keyArray);
+            std::copy(ridList.begin() + start, ridList.begin() + start + count, current->ridArray);
+            start += count;
+        }
+        if (currentNum != pageNum)
+        {
+            setLeftSibling(current->header.rightSibPageNo, currentNum);
+            bufMgr->unPinPage(file, currentNum, true);
+        }
+        bufMgr->unPinPage(file, pageNum, true);
+    }
+
+    template <class T>
+    void BTreeIndex::fillNode(PageId pageNum, NonLeafNode<T>* node, const std::vector<T>& keys, const std::vector<PageId>& children,
+                              const std::vector<std::uint64_t>& counts, std::vector<PageKeyPair<T> >& splits)
+    {
+        // each node holds up to nodeOccupancy + 1 children, and the key between two
+        // consecutive nodes is pushed up rather than kept in either
+        int total = children.size();
+        int pieces = (total + nodeOccupancy) / (nodeOccupancy + 1);
+        NonLeafNode<T>* current = node;
+        PageId currentNum = pageNum;
+        int start = 0;
+        for (int p = 0; p < pieces; p++)
+        {
+            int count = total / pieces + (p < total % pieces);
+            if (p > 0)
+            {
+                Page* splitPage;
+                PageId splitID;
+                allocNode(splitID, splitPage);
+                NonLeafNode<T>* splitNode = (NonLeafNode<T>*) splitPage;
+                splitNode->header.initialize(node->header.level);
+                splitNode->header.rightSibPageNo = current->header.rightSibPageNo;
+                splitNode->header.leftSibPageNo = currentNum;
+                current->header.rightSibPageNo = splitID;
+                if (currentNum != pageNum)
+                {
+                    bufMgr->unPinPage(file, currentNum, true);
+                }
+                current = splitNode;
+                currentNum = splitID;
+
+                PageKeyPair<T> pair;
+                pair.set(splitID, keys[start - 1]);
+                splits.push_back(pair);
+                splitNode->header.lowRid = lowRidOf(children[start]);
+            }
+            current->header.numKeys = count - 1;
+            std::copy(keys.begin() + start, keys.begin() + start + count - 1, current->keyArray);
+            std::copy(children.begin() + start, children.begin() + start + count, current->pageNoArray);
+            for (int c = 0; counted && c < count; c++)
+            {
+                setChildCount(current, c, counts[start + c]);
+            }
+            start += count;
+        }
+        if (currentNum != pageNum)
+        {
+            setLeftSibling(current->header.rightSibPageNo, currentNum);
+            bufMgr->unPinPage(file, currentNum, true);
+        }
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::deleteEntry
+// -----------------------------------------------------------------------------
+
+    void BTreeIndex::deleteEntry(const void *key, const RecordId rid)
+    {
+        std::lock_guard<NodeLatch> guard(structureLatch);
+        structureVersion++;
+        (this->*keyOps->deleteEntry)(key, rid);
+    }
+
+    template <class T>
+    void BTreeIndex::deleteEntryTyped(const void *key, const RecordId rid)
+    {
+        // the leaves at either end may be merged away
+        leftmostLeafPageNo = Page::INVALID_NUMBER;
+        rightmostLeafPageNo = Page::INVALID_NUMBER;
+
+        T k = keyFromBytes<T>(key);
+        DeleteResult result;
+        if (rootIsLeaf)
+        {
+            result = deleteLeaf<T>(rootPageNum, k, rid);
+        }
+        else
+        {
+            result = deleteNode<T>(rootPageNum, k, rid);
+        }
+
+        if (result == ENTRY_NOT_FOUND)
+        {
+            throw NoSuchKeyFoundException();
+        }
+        removeStatistics<T>(k);
+
+        // the root may be left with a single child after two of its children merged,
+        // that child becomes the new root so the tree gets one level shallower
+        if (!rootIsLeaf && result == NODE_UNDERFULL)
+        {
+            Page* page;
+            bufMgr->readPage(file, rootPageNum, page);
+            NonLeafNode<T>* root = (NonLeafNode<T>*) page;
+            if (root->header.numKeys > 0)
+            {
+                bufMgr->unPinPage(file, rootPageNum, false);
+                return;
+            }
+
+            PageId oldRootNum = rootPageNum;
+            rootPageNum = root->pageNoArray[0];
+            rootIsLeaf = (root->header.level == 1);
+            freeNode(oldRootNum, page);
+        }
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::deleteNode
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    BTreeIndex::DeleteResult BTreeIndex::deleteNode(PageId pageNum, const T& key, const RecordId rid)
+    {
+        Page* page;
+        bufMgr->readPage(file, pageNum, page);
+        NonLeafNode<T>* node = (NonLeafNode<T>*) page;
+
+        // the first child that may hold the key. Duplicates of the key continue
+        // into the next children for as long as the separators are equal to it
+        int numKeys = node->header.numKeys;
+        int index = searchLowerBound(node->keyArray, numKeys, key);
+        DeleteResult result;
+        while (true)
+        {
+            if (node->header.level == 1)
+            {
+                result = deleteLeaf<T>(node->pageNoArray[index], key, rid);
+            }
+            else
+            {
+                result = deleteNode<T>(node->pageNoArray[index], key, rid);
+            }
+
+            if (result != ENTRY_NOT_FOUND || index >= numKeys || node->keyArray[index] != key)
+            {
+                break;
+            }
+            index++;
+        }
+
+        if (counted && result != ENTRY_NOT_FOUND)
+        {
+            setChildCount(node, index, childCount(node, index) - 1);
+        }
+        if (result != NODE_UNDERFULL)
+        {
+            bufMgr->unPinPage(file, pageNum, counted && result == ENTRY_DELETED);
+            return result;
+        }
+
+        // the child is underfull, borrow from or merge with one of its siblings
+        rebalanceChild<T>(node, index);
+        result = (node->header.numKeys < nodeOccupancy / 2) ? NODE_UNDERFULL : ENTRY_DELETED;
+        bufMgr->unPinPage(file, pageNum, true);
+        return result;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::deleteLeaf
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    BTreeIndex::DeleteResult BTreeIndex::deleteLeaf(PageId pageNum, const T& key, const RecordId rid)
+    {
+        Page* page;
+        bufMgr->readPage(file, pageNum, page);
+        LeafNode<T>* leaf = (LeafNode<T>*) page;
+
+        // look for the record among the duplicates of the key and in their posting lists. An entry
+        // whose posting list is left empty is deleted
+        int numKeys = leaf->header.numKeys;
+        int index = searchLowerBound(leaf->keyArray, numKeys, key);
+        while (index < numKeys && leaf->keyArray[index] == key && leaf->ridArray[index] != rid)
+        {
+            bool emptied;
+            if (leaf->ridArray[index].isPostingList() &&
+                    removeFromPostingList(leaf->ridArray[index].pageNumber(), rid, emptied))
+            {
+                if (!emptied)
+                {
+                    bufMgr->unPinPage(file, pageNum, false);
+                    return ENTRY_DELETED;
+                }
+                break;
+            }
+            index++;
+        }
+
+        if (index >= numKeys || leaf->keyArray[index] != key)
+        {
+            bufMgr->unPinPage(file, pageNum, false);
+            return ENTRY_NOT_FOUND;
+        }
+
+        // shift the following entries left over the one deleted
+        std::copy(leaf->keyArray + index + 1, leaf->keyArray + numKeys, leaf->keyArray + index);
+        std::copy(leaf->ridArray + index + 1, leaf->ridArray + numKeys, leaf->ridArray + index);
+        moveIncluded(leaf, index + 1, leaf, index, numKeys - index - 1);
+        leaf->header.numKeys--;
+
+        DeleteResult result = (leaf->header.numKeys < leafOccupancy / 2) ? NODE_UNDERFULL : ENTRY_DELETED;
+        bufMgr->unPinPage(file, pageNum, true);
+        return result;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::rebalanceChild
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    void BTreeIndex::rebalanceChild(NonLeafNode<T>* parent, int index)
+    {
+        // a node with a single child has no sibling to work with
+        int numKeys = parent->header.numKeys;
+        if (numKeys == 0)
+        {
+            return;
+        }
+
+        // pair the child with its left sibling, or its right one if it is the first child
+        int left = (index > 0) ? index - 1 : index;
+        PageId leftNum = parent->pageNoArray[left];
+        PageId rightNum = parent->pageNoArray[left + 1];
+        Page* leftPage;
+        Page* rightPage;
+        bufMgr->readPage(file, leftNum, leftPage);
+        bufMgr->readPage(file, rightNum, rightPage);
+
+        bool merged;
+        std::uint64_t total = counted ? childCount(parent, left) + childCount(parent, left + 1) : 0;
+        if (parent->header.level == 1)
+        {
+            LeafNode<T>* leftLeaf = (LeafNode<T>*) leftPage;
+            merged = rebalanceLeaves<T>(leftLeaf, (LeafNode<T>*) rightPage, parent->keyArray[left]);
+            if (counted && !merged)
+            {
+                setChildCount(parent, left, leafEntries(leftLeaf, leftLeaf->header.numKeys));
+            }
+        }
+        else
+        {
+            NonLeafNode<T>* leftNode = (NonLeafNode<T>*) leftPage;
+            merged = rebalanceNodes<T>(leftNode, (NonLeafNode<T>*) rightPage, parent->keyArray[left]);
+            if (counted && !merged)
+            {
+                setChildCount(parent, left, nodeEntries(leftNode));
+            }
+        }
+        bufMgr->unPinPage(file, leftNum, true);
+
+        // the entries that moved between the two children move between their counts
+        if (counted)
+        {
+            if (merged)
+            {
+                setChildCount(parent, left, total);
+            }
+            else
+            {
+                setChildCount(parent, left + 1, total - childCount(parent, left));
+            }
+        }
+
+        if (!merged)
+        {
+            bufMgr->unPinPage(file, rightNum, true);
+            return;
+        }
+
+        // the right node is gone, drop it and its separator from the parent
+        PageId nextNum = ((NodeHeader*) rightPage)->rightSibPageNo;
+        freeNode(rightNum, rightPage);
+        setLeftSibling(nextNum, leftNum);
+        std::copy(parent->keyArray + left + 1, parent->keyArray + numKeys, parent->keyArray + left);
+        std::copy(parent->pageNoArray + left + 2, parent->pageNoArray + numKeys + 1, parent->pageNoArray + left + 1);
+        moveChildCounts(parent, left + 2, parent, left + 1, numKeys - left - 1);
+        parent->header.numKeys--;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::rebalanceLeaves
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    bool BTreeIndex::rebalanceLeaves(LeafNode<T>* left, LeafNode<T>* right, T& separator)
+    {
+        int leftKeys = left->header.numKeys;
+        int rightKeys = right->header.numKeys;
+        int total = leftKeys + rightKeys;
+
+        // everything fits in the left leaf, move the right one over
+        if (total <= leafOccupancy)
+        {
+            std::copy(right->keyArray, right->keyArray + rightKeys, left->keyArray + leftKeys);
+            std::copy(right->ridArray, right->ridArray + rightKeys, left->ridArray + leftKeys);
+            moveIncluded(right, 0, left, leftKeys, rightKeys);
+            left->header.numKeys = packDuplicates(left->keyArray, left->ridArray, total, false);
+            left->header.rightSibPageNo = right->header.rightSibPageNo;
+            return true;
+        }
+
+        // share the entries evenly, moving the ones in excess across the boundary
+        int leftCount = (total + 1) / 2;
+        if (leftKeys < leftCount)
+        {
+            int moved = leftCount - leftKeys;
+            std::copy(right->keyArray, right->keyArray + moved, left->keyArray + leftKeys);
+            std::copy(right->ridArray, right->ridArray + moved, left->ridArray + leftKeys);
+            moveIncluded(right, 0, left, leftKeys, moved);
+            std::copy(right->keyArray + moved, right->keyArray + rightKeys, right->keyArray);
+            std::copy(right->ridArray + moved, right->ridArray + rightKeys, right->ridArray);
+            moveIncluded(right, moved, right, 0, rightKeys - moved);
+        }
+        else
+        {
+            int moved = leftKeys - leftCount;
+            std::copy_backward(right->keyArray, right->keyArray + rightKeys, right->keyArray + rightKeys + moved);
+            std::copy_backward(right->ridArray, right->ridArray + rightKeys, right->ridArray + rightKeys + moved);
+            moveIncluded(right, 0, right, moved, rightKeys);
+            std::copy(left->keyArray + leftCount, left->keyArray + leftKeys, right->keyArray);
+            std::copy(left->ridArray + leftCount, left->ridArray + leftKeys, right->ridArray);
+            moveIncluded(left, leftCount, right, 0, moved);
+        }
+        // a key may now have entries on either side of a posting list of its own, which takes them in
+        left->header.numKeys = packDuplicates(left->keyArray, left->ridArray, leftCount, false);
+        right->header.numKeys = packDuplicates(right->keyArray, right->ridArray, total - leftCount, false);
+
+        leftCount = left->header.numKeys;
+        separator = right->keyArray[0];
+        right->header.lowRid = leafLowRid(left->keyArray[leftCount - 1], right->keyArray[0], right->ridArray[0]);
+        return false;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::rebalanceNodes
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    bool BTreeIndex::rebalanceNodes(NonLeafNode<T>* left, NonLeafNode<T>* right, T& separator)
+    {
+        int leftKeys = left->header.numKeys;
+        int rightKeys = right->header.numKeys;
+
+        // everything fits in the left node, pull the separator down between the two halves
+        if (leftKeys + rightKeys + 1 <= nodeOccupancy)
+        {
+            left->keyArray[leftKeys] = separator;
+            std::copy(right->keyArray, right->keyArray + rightKeys, left->keyArray + leftKeys + 1);
+            std::copy(right->pageNoArray, right->pageNoArray + rightKeys + 1, left->pageNoArray + leftKeys + 1);
+            moveChildCounts(right, 0, left, leftKeys + 1, rightKeys + 1);
+            left->header.numKeys = leftKeys + rightKeys + 1;
+            left->header.rightSibPageNo = right->header.rightSibPageNo;
+            return true;
+        }
+
+        // lay out the keys of both nodes around the separator and split them again in the middle
+        std::vector<T> keys(left->keyArray, left->keyArray + leftKeys);
+        keys.push_back(separator);
+        keys.insert(keys.end(), right->keyArray, right->keyArray + rightKeys);
+        std::vector<PageId> children(left->pageNoArray, left->pageNoArray + leftKeys + 1);
+        children.insert(children.end(), right->pageNoArray, right->pageNoArray + rightKeys + 1);
+        std::vector<std::uint64_t> counts;
+        for (int i = 0; counted && i <= leftKeys; i++)
+        {
+            counts.push_back(childCount(left, i));
+        }
+        for (int i = 0; counted && i <= rightKeys; i++)
+        {
+            counts.push_back(childCount(right, i));
+        }
+
+        int mid = keys.size() / 2;
+        left->header.numKeys = mid;
+        std::copy(keys.begin(), keys.begin() + mid, left->keyArray);
+        std::copy(children.begin(), children.begin() + mid + 1, left->pageNoArray);
+
+        right->header.numKeys = keys.size() - mid - 1;
+        std::copy(keys.begin() + mid + 1, keys.end(), right->keyArray);
+        std::copy(children.begin() + mid + 1, children.end(), right->pageNoArray);
+        right->header.lowRid = lowRidOf(children[mid + 1]);
+        for (std::size_t c = 0; c < counts.size(); c++)
+        {
+            if ((int) c <= mid)
+            {
+                setChildCount(left, c, counts[c]);
+            }
+            else
+            {
+                setChildCount(right, c - mid - 1, counts[c]);
+            }
+        }
+
+        separator = keys[mid];
+        return false;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::openScan
+// -----------------------------------------------------------------------------
+
+    ScanCursor BTreeIndex::openScan(const void* lowValParm,
+                                    const Operator lowOpParm,
+                                    const void* highValParm,
+                                    const Operator highOpParm,
+                                    const std::size_t offset,
+                                    const ScanDirection direction)
+    {
+        ScanCursor cursor;
+        if (!tryOpenScan(cursor, lowValParm, lowOpParm, highValParm, highOpParm, offset, direction))
+        {
+            throw NoSuchKeyFoundException();
+        }
+        return cursor;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::tryOpenScan
+// -----------------------------------------------------------------------------
+
+    bool BTreeIndex::tryOpenScan(ScanCursor& cursor,
+                                 const void* lowValParm,
+                                 const Operator lowOpParm,
+                                 const void* highValParm,
+                                 const Operator highOpParm,
+                                 const std::size_t offset,
+                                 const ScanDirection direction)
+    {
+		// check if operators are valid
+        if (lowOpParm != GT && lowOpParm != GTE)
+        {
+            throw BadOpcodesException();
+        }
+
+        if (highOpParm != LT && highOpParm != LTE)
+        {
+            throw BadOpcodesException();
+        }
+
+        SharedLatchGuard guard(structureLatch);
+
+        // moving an idle cursor in ends the scan already executing
+        cursor = ScanCursor();
+        cursor.index = this;
+        cursor.lowOp = lowOpParm;
+        cursor.highOp = highOpParm;
+        cursor.descending = (direction == DESCENDING);
+
+        return (this->*keyOps->startScan)(cursor, lowValParm, highValParm, offset);
+    }
+
+    template <class T>
+    bool BTreeIndex::startScanTyped(ScanCursor& cursor, const void* lowValParm, const void* highValParm,
+                                    std::size_t offset)
+    {
+        // the entries in range among those tied with a STRING bound longer than the key prefix are in no
+        // particular place, so the offset is only found from the root when both bounds are whole keys
+        setScanBounds<T>(cursor, lowValParm, highValParm);
+        if (counted && offset > 0 && isCompleteKey(cursor.scanLowVal<T>()) && isCompleteKey(cursor.scanHighVal<T>()))
+        {
+            return startScanAt<T>(cursor, offset);
+        }
+
+		// find the first entry >= the lower bound of our range, or the last one <= the upper bound of a descending
+		// scan, reading ahead the leaves after it once the scan gets to them
+        cursor.readaheadWindow = MIN_READAHEAD_LEAVES;
+        findScanStart<T>(cursor);
+        if (!seekMatch<T>(cursor))
+        {
+            latches[cursor.currentPageNum].unlockShared();
+            bufMgr->unPinPage(file, cursor.currentPageNum, false);
+            return false;
+        }
+        cursor.returnedAny = false;
+        parkScan(cursor);
+        cursor.scanExecuting = true;
+        if (offset == 0)
+        {
+            return true;
+        }
+
+        // without counts the entries skipped are stepped over, and the scan goes on if any entry is left after them
+        const std::size_t batchSize = 256;
+        std::vector<RecordId> skipped(std::min(offset, batchSize));
+        while (offset > 0)
+        {
+            std::size_t count = scanNextBatchTyped<T>(cursor, &skipped[0], std::min(offset, batchSize), NULL);
+            if (count == 0)
+            {
+                cursor.release();
+                return false;
+            }
+            offset -= count;
+        }
+        resumeScan<T>(cursor);
+        bool found = seekMatch<T>(cursor);
+        parkScan(cursor);
+        if (!found)
+        {
+            cursor.release();
+        }
+        return found;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::startScanAt
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    bool BTreeIndex::startScanAt(ScanCursor& cursor, const std::size_t offset)
+    {
+        const T& lowVal = cursor.scanLowVal<T>();
+        const T& highVal = cursor.scanHighVal<T>();
+        std::uint64_t below = countBelowKey<T>(lowVal, cursor.lowValString.c_str(), cursor.lowOp == GT);
+        std::uint64_t upTo = countBelowKey<T>(highVal, cursor.highValString.c_str(), cursor.highOp == LTE);
+        if (below + offset >= upTo)
+        {
+            return false;
+        }
+
+        // the entry before the first one returned, in the order of the scan, is in range. The cursor is left past it
+        std::uint64_t position = cursor.descending ? upTo - offset : below + offset - 1;
+        int slot;
+        std::uint64_t listIndex;
+        cursor.currentPageNum = locateEntry<T>(position, slot, listIndex, cursor.readaheadParentNum, cursor.readaheadChild);
+        latches[cursor.currentPageNum].lockShared();
+        bufMgr->readPage(file, cursor.currentPageNum, cursor.currentPageData);
+        cursor.readaheadWindow = MIN_READAHEAD_LEAVES;
+        cursor.leavesAhead = 0;
+        cursor.postingPageNum = Page::INVALID_NUMBER;
+
+        LeafNode<T>* leaf = (LeafNode<T>*) cursor.currentPageData;
+        cursor.scanLastKey<T>() = leaf->keyArray[slot];
+        cursor.nextEntry = slot;
+        if (leaf->ridArray[slot].isPostingList())
+        {
+            PageId headNum = leaf->ridArray[slot].pageNumber();
+            cursor.lastRid = postingListEntry(headNum, listIndex);
+            if (!seekPostingList(cursor, headNum, cursor.lastRid))
+            {
+                cursor.nextEntry += cursor.descending ? -1 : 1;
+            }
+        }
+        else
+        {
+            cursor.lastRid = leaf->ridArray[slot];
+            cursor.nextEntry += cursor.descending ? -1 : 1;
+        }
+        cursor.returnedAny = true;
+
+        if (!seekMatch<T>(cursor))
+        {
+            latches[cursor.currentPageNum].unlockShared();
+            bufMgr->unPinPage(file, cursor.currentPageNum, false);
+            return false;
+        }
+        parkScan(cursor);
+        cursor.scanExecuting = true;
+        return true;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::findLeaf
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    void BTreeIndex::findLeaf(const T& key, ScanCursor& cursor)
+    {
+        bool leftmost;
+        bool rightmost;
+        latchLeaf<T>(key, NULL, false, false, cursor.currentPageNum, leftmost, rightmost, cursor.readaheadParentNum,
+                     cursor.readaheadChild);
+        bufMgr->readPage(file, cursor.currentPageNum, cursor.currentPageData);
+        cursor.leavesAhead = 0;
+        cursor.postingPageNum = Page::INVALID_NUMBER;
+
+		// find the first entry >= key
+        LeafNode<T>* leaf = (LeafNode<T>*) cursor.currentPageData;
+        cursor.nextEntry = searchLowerBound(leaf->keyArray, leaf->header.numKeys, key);
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::findLastLeaf
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    void BTreeIndex::findLastLeaf(const T& key, const bool inclusive, ScanCursor& cursor)
+    {
+        // entries < key are left of the leftmost leaf that may hold key or in it, entries <= key are
+        // left of the rightmost one or in it
+        bool leftmost;
+        bool rightmost;
+        latchLeaf<T>(key, NULL, false, inclusive, cursor.currentPageNum, leftmost, rightmost, cursor.readaheadParentNum,
+                     cursor.readaheadChild);
+        bufMgr->readPage(file, cursor.currentPageNum, cursor.currentPageData);
+        cursor.leavesAhead = 0;
+        cursor.postingPageNum = Page::INVALID_NUMBER;
+
+        LeafNode<T>* leaf = (LeafNode<T>*) cursor.currentPageData;
+        int numKeys = leaf->header.numKeys;
+        cursor.nextEntry = (inclusive ? searchUpperBound(leaf->keyArray, numKeys, key) :
+                searchLowerBound(leaf->keyArray, numKeys, key)) - 1;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::findScanStart
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    void BTreeIndex::findScanStart(ScanCursor& cursor)
+    {
+        // the entries tied with a high bound longer than the key prefix may be on either side of it
+        if (cursor.descending)
+        {
+            const T& highVal = cursor.scanHighVal<T>();
+            findLastLeaf<T>(highVal, cursor.highOp == LTE || !isCompleteKey(highVal), cursor);
+        }
+        else
+        {
+            findLeaf<T>(cursor.scanLowVal<T>(), cursor);
+        }
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::latchLeaf
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    void BTreeIndex::latchLeaf(const T& key, const RecordId* rid, const bool exclusive, const bool last, PageId& pageNum,
+                               bool& leftmost, bool& rightmost, PageId& parentNum, int& childIndex)
+    {
+        for (int attempt = 0; attempt < MAX_OPTIMISTIC_DESCENTS; attempt++)
+        {
+            if (latchLeafOptimistic<T>(key, rid, exclusive, last, pageNum, leftmost, rightmost, parentNum, childIndex))
+            {
+                return;
+            }
+            std::this_thread::yield();
+        }
+        latchLeafCoupled<T>(key, rid, exclusive, last, pageNum, leftmost, rightmost, parentNum, childIndex);
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::latchLeafOptimistic
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    bool BTreeIndex::latchLeafOptimistic(const T& key, const RecordId* rid, const bool exclusive, const bool last,
+                                         PageId& pageNum, bool& leftmost, bool& rightmost, PageId& parentNum, int& childIndex)
+    {
+        // the root latch stands for the parent of the root, and the page number of the root is what it holds
+        NodeLatch* latch = &rootLatch;
+        std::uint64_t version;
+        if (!latch->readVersion(version))
+        {
+            return false;
+        }
+        PageId childNum = rootPageNum;
+        bool childIsLeaf = rootIsLeaf;
+        leftmost = true;
+        rightmost = true;
+        parentNum = Page::INVALID_NUMBER;
+        childIndex = 0;
+
+        while (true)
+        {
+            // what was read from the parent is only used once the parent is known not to have changed
+            if (!latch->validate(version))
+            {
+                return false;
+            }
+
+            NodeLatch& childLatch = latches[childNum];
+            if (childIsLeaf)
+            {
+                if (exclusive)
+                {
+                    childLatch.lock();
+                }
+                else
+                {
+                    childLatch.lockShared();
+                }
+
+                // the leaf may have split before it was latched, which its parent would show
+                if (!latch->validate(version))
+                {
+                    if (exclusive)
+                    {
+                        childLatch.unlock();
+                    }
+                    else
+                    {
+                        childLatch.unlockShared();
+                    }
+                    return false;
+                }
+                pageNum = childNum;
+                return true;
+            }
+
+            std::uint64_t childVersion;
+            if (!childLatch.readVersion(childVersion) || !latch->validate(version))
+            {
+                return false;
+            }
+            latch = &childLatch;
+            version = childVersion;
+
+            // a writer may be changing the node while it is read, so nothing read from it is used
+            // before it is validated, and the search stays within the node whatever it reads
+            Page* page;
+            bufMgr->readPage(file, childNum, page);
+            NonLeafNode<T>* node = (NonLeafNode<T>*) page;
+            int numKeys = std::max(0, std::min((int) node->header.numKeys, nodeOccupancy));
+            int index;
+            if (rid != NULL)
+            {
+                index = childForEntry(node, numKeys, key, *rid, latch, version);
+                if (index < 0)
+                {
+                    bufMgr->unPinPage(file, childNum, false);
+                    return false;
+                }
+            }
+            else
+            {
+                index = last ? searchUpperBound(node->keyArray, numKeys, key) : searchLowerBound(node->keyArray, numKeys, key);
+            }
+            PageId nextNum = node->pageNoArray[index];
+            childIsLeaf = (node->header.level == 1);
+            leftmost = leftmost && index == 0;
+            rightmost = rightmost && index == numKeys;
+            bufMgr->unPinPage(file, childNum, false);
+            parentNum = childNum;
+            childIndex = index;
+            childNum = nextNum;
+        }
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::latchLeafCoupled
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    void BTreeIndex::latchLeafCoupled(const T& key, const RecordId* rid, const bool exclusive, const bool last,
+                                      PageId& pageNum, bool& leftmost, bool& rightmost, PageId& parentNum, int& childIndex)
+    {
+        // each node is latched before the latch of its parent is let go, so that a split cannot move the key away in between
+        leftmost = true;
+        rightmost = true;
+        parentNum = Page::INVALID_NUMBER;
+        childIndex = 0;
+        rootLatch.lockShared();
+        pageNum = rootPageNum;
+        bool isLeaf = rootIsLeaf;
+        if (isLeaf && exclusive)
+        {
+            latches[pageNum].lock();
+        }
+        else
+        {
+            latches[pageNum].lockShared();
+        }
+        rootLatch.unlockShared();
+
+        while (!isLeaf)
+        {
+            Page* page;
+            bufMgr->readPage(file, pageNum, page);
+            NonLeafNode<T>* node = (NonLeafNode<T>*) page;
+
+            // figure out which child to traverse to, taking the leftmost one that may hold the key since
+            // duplicates can span leaves, or the rightmost one, or the one whose entries the record id falls among
+            int numKeys = node->header.numKeys;
+            int index;
+            if (rid != NULL)
+            {
+                index = childForEntry(node, numKeys, key, *rid, NULL, 0);
+            }
+            else
+            {
+                index = last ? searchUpperBound(node->keyArray, numKeys, key) : searchLowerBound(node->keyArray, numKeys, key);
+            }
+            PageId childNum = node->pageNoArray[index];
+            isLeaf = (node->header.level == 1);
+            leftmost = leftmost && index == 0;
+            rightmost = rightmost && index == numKeys;
+
+            if (isLeaf && exclusive)
+            {
+                latches[childNum].lock();
+            }
+            else
+            {
+                latches[childNum].lockShared();
+            }
+            bufMgr->unPinPage(file, pageNum, false);
+            latches[pageNum].unlockShared();
+            parentNum = pageNum;
+            childIndex = index;
+            pageNum = childNum;
+        }
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::lookup
+// -----------------------------------------------------------------------------
+
+    std::size_t BTreeIndex::lookup(const void* key, std::vector<RecordId>& outRids)
+    {
+        std::vector<std::size_t> counts;
+        lookupMany(&key, 1, outRids, counts);
+        return counts.back();
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::lookupMany
+// -----------------------------------------------------------------------------
+
+    void BTreeIndex::lookupMany(const void* const* keys, std::size_t numKeys,
+                                std::vector<RecordId>& outRids, std::vector<std::size_t>& counts)
+    {
+        SharedLatchGuard guard(structureLatch);
+        (this->*keyOps->lookupMany)(keys, numKeys, outRids, counts);
+    }
+
+    template <class T>
+    void BTreeIndex::lookupManyTyped(const void* const* keys, std::size_t numKeys,
+                                     std::vector<RecordId>& outRids, std::vector<std::size_t>& counts)
+    {
+        // the cursor is only used to walk the entries of each key, the leaf it is on is pinned and latched here
+        ScanCursor cursor;
+        cursor.index = this;
+        cursor.lowOp = GTE;
+        cursor.highOp = LTE;
+        cursor.currentPageNum = Page::INVALID_NUMBER;
+
+        for (std::size_t i = 0; i < numKeys; i++)
+        {
+            setScanBounds<T>(cursor, keys[i], keys[i]);
+            const T& key = cursor.scanLowVal<T>();
+
+            // the first entry >= key is in the current leaf if the leaf holds a larger key, and the leaves
+            // to its left do not hold key, which they cannot once the first key of the leaf is smaller
+            bool reuse = false;
+            if (cursor.currentPageNum != Page::INVALID_NUMBER)
+            {
+                LeafNode<T>* leaf = (LeafNode<T>*) cursor.currentPageData;
+                int numLeafKeys = leaf->header.numKeys;
+                reuse = numLeafKeys > 0 && leaf->keyArray[0] < key && !(leaf->keyArray[numLeafKeys - 1] < key);
+                if (!reuse)
+                {
+                    latches[cursor.currentPageNum].unlockShared();
+                    bufMgr->unPinPage(file, cursor.currentPageNum, false);
+                }
+            }
+            if (reuse)
+            {
+                LeafNode<T>* leaf = (LeafNode<T>*) cursor.currentPageData;
+                cursor.nextEntry = searchLowerBound(leaf->keyArray, leaf->header.numKeys, key);
+            }
+            else
+            {
+                findLeaf<T>(key, cursor);
+            }
+
+            std::size_t count = 0;
+            while (seekMatch<T>(cursor))
+            {
+                LeafNode<T>* leaf = (LeafNode<T>*) cursor.currentPageData;
+                PackedRecordId entry = leaf->ridArray[cursor.nextEntry];
+                std::size_t before = outRids.size();
+                if (entry.isPostingList())
+                {
+                    readPostingList(entry.pageNumber(), outRids);
+                }
+                else
+                {
+                    outRids.push_back(entry);
+                }
+                cursor.nextEntry++;
+                count += outRids.size() - before;
+            }
+            counts.push_back(count);
+        }
+
+        if (cursor.currentPageNum != Page::INVALID_NUMBER)
+        {
+            latches[cursor.currentPageNum].unlockShared();
+            bufMgr->unPinPage(file, cursor.currentPageNum, false);
+        }
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::countRange
+// -----------------------------------------------------------------------------
+
+    std::size_t BTreeIndex::countRange(const void* lowVal, const Operator lowOp, const void* highVal,
+                                       const Operator highOp)
+    {
+        if (lowOp != GT && lowOp != GTE)
+        {
+            throw BadOpcodesException();
+        }
+
+        if (highOp != LT && highOp != LTE)
+        {
+            throw BadOpcodesException();
+        }
+
+        // without counts the range is scanned
+        if (!counted)
+        {
+            std::size_t count = 0;
+            ScanCursor cursor;
+            if (tryOpenScan(cursor, lowVal, lowOp, highVal, highOp))
+            {
+                RecordId rids[256];
+                std::size_t taken;
+                while ((taken = cursor.scanNextBatch(rids, 256)) > 0)
+                {
+                    count += taken;
+                }
+                cursor.endScan();
+            }
+            return count;
+        }
+
+        SharedLatchGuard guard(structureLatch);
+        return (this->*keyOps->countRange)(lowVal, lowOp, highVal, highOp);
+    }
+
+    template <class T>
+    std::size_t BTreeIndex::countRangeTyped(const void* lowValParm, const Operator lowOp, const void* highValParm,
+                                            const Operator highOp)
+    {
+        T lowVal = keyFromBytes<T>(lowValParm);
+        T highVal = keyFromBytes<T>(highValParm);
+        if (highVal < lowVal)
+        {
+            throw BadScanrangeException();
+        }
+
+        std::uint64_t below = countBelowKey<T>(lowVal, (const char*) lowValParm, lowOp == GT);
+        std::uint64_t upTo = countBelowKey<T>(highVal, (const char*) highValParm, highOp == LTE);
+        return (upTo > below) ? upTo - below : 0;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::rank
+// -----------------------------------------------------------------------------
+
+    std::size_t BTreeIndex::rank(const void* key)
+    {
+        if (!counted)
+        {
+            throw BadIndexInfoException(file->filename() + ": index is not counted");
+        }
+
+        SharedLatchGuard guard(structureLatch);
+        return (this->*keyOps->countBelow)(key);
+    }
+
+    template <class T>
+    std::size_t BTreeIndex::countBelowTyped(const void* key)
+    {
+        return countBelowKey<T>(keyFromBytes<T>(key), (const char*) key, false);
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::select
+// -----------------------------------------------------------------------------
 
-        }
-        catch (FileNotFoundException& e)
+    bool BTreeIndex::select(const std::size_t position, RecordId& outRid)
+    {
+        if (!counted)
         {
-            // File does not exist, create one
-            file = new BlobFile(outIndexName, true);
+            throw BadIndexInfoException(file->filename() + ": index is not counted");
+        }
 
-            // allocate pages for meta page and root node
-            Page* headerPage;
-            bufMgr->allocPage(file, headerPageNum, headerPage);
+        SharedLatchGuard guard(structureLatch);
+        return (this->*keyOps->select)(position, outRid);
+    }
 
-            Page* rootPage;
-            bufMgr->allocPage(file, rootPageNum, rootPage);
+    template <class T>
+    bool BTreeIndex::selectTyped(std::size_t position, RecordId& outRid)
+    {
+        if (position >= subtreeEntries<T>(rootPageNum))
+        {
+            return false;
+        }
 
-            // set data in meta page
-            IndexMetaInfo* metaInfo = (IndexMetaInfo*) headerPage;
-            metaInfo->attrByteOffset = attrByteOffset;
-            metaInfo->attrType = attrType;
-            metaInfo->rootPageNo = rootPageNum;
-            strncpy(metaInfo->relationName, relationName.c_str(), relationName.length());
-            metaInfo->rootIsLeaf = true;
+        int slot;
+        std::uint64_t listIndex;
+        PageId parentNum;
+        int childIndex;
+        PageId pageNum = locateEntry<T>(position, slot, listIndex, parentNum, childIndex);
+        Page* page;
+        bufMgr->readPage(file, pageNum, page);
+        PackedRecordId entry = ((LeafNode<T>*) page)->ridArray[slot];
+        bufMgr->unPinPage(file, pageNum, false);
+        outRid = entry.isPostingList() ? postingListEntry(entry.pageNumber(), listIndex) : (RecordId) entry;
+        return true;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::countBelowKey
+// -----------------------------------------------------------------------------
 
-            // initialize root node
-            LeafNodeInt* root = (LeafNodeInt*) rootPage;
-            // set right sibling page number to max int value to denote no right sibling
-            root->rightSibPageNo = MAX_INT;
-            // set entries of key array to max int value to denote no key in that index
-            for (int i = 0; i < leafOccupancy; i++)
+    template <class T>
+    std::uint64_t BTreeIndex::countBelowKey(const T& key, const char* value, const bool inclusive)
+    {
+        // the children left of the one the key falls in only hold smaller keys, or equal ones when inclusive,
+        // and the ones right of it only larger keys. Writers of a counted index have it to themselves, so the
+        // nodes are read without latches. A prefix leads to the leftmost leaf that may hold it
+        bool complete = isCompleteKey(key);
+        bool upper = inclusive && complete;
+        std::uint64_t count = 0;
+        PageId pageNum = rootPageNum;
+        bool isLeaf = rootIsLeaf;
+        while (!isLeaf)
+        {
+            Page* page;
+            bufMgr->readPage(file, pageNum, page);
+            NonLeafNode<T>* node = (NonLeafNode<T>*) page;
+            int numKeys = node->header.numKeys;
+            int index = upper ? searchUpperBound(node->keyArray, numKeys, key) :
+                    searchLowerBound(node->keyArray, numKeys, key);
+            for (int i = 0; i < index; i++)
             {
-                root->keyArray[i] = MAX_INT;
+                count += childCount(node, i);
             }
+            PageId childNum = node->pageNoArray[index];
+            isLeaf = (node->header.level == 1);
+            bufMgr->unPinPage(file, pageNum, false);
+            pageNum = childNum;
+        }
 
-            rootIsLeaf = true;
-
-            bufMgr->unPinPage(file, headerPageNum, true);
-            bufMgr->unPinPage(file, rootPageNum, true);
-
-            FileScan fscan(relationName, bufMgr);
+        Page* page;
+        bufMgr->readPage(file, pageNum, page);
+        LeafNode<T>* leaf = (LeafNode<T>*) page;
+        int numKeys = leaf->header.numKeys;
+        int index = upper ? searchUpperBound(leaf->keyArray, numKeys, key) :
+                searchLowerBound(leaf->keyArray, numKeys, key);
+        count += leafEntries(leaf, index);
 
-            // Insert into B+ tree
-            while(true)
+        // the entries tied with a value longer than the prefix may fall on either side of it, in any order, so
+        // each one is compared with the value in full. They follow the smaller keys, over as many leaves as
+        // they take. Such keys have no posting lists
+        std::string fullValue = complete ? std::string() : std::string(value);
+        while (!complete)
+        {
+            if (index == leaf->header.numKeys)
             {
-                try
-                {
-                    RecordId rid;
-                    fscan.scanNext(rid);
-                    std::string recordStr = fscan.getRecord();
-                    const char *record = recordStr.c_str();
-                    insertEntry(record + attrByteOffset, rid);
-                }
-                catch(EndOfFileException& e)
+                PageId nextNum = leaf->header.rightSibPageNo;
+                if (nextNum == Page::INVALID_NUMBER)
                 {
                     break;
                 }
+                bufMgr->unPinPage(file, pageNum, false);
+                pageNum = nextNum;
+                bufMgr->readPage(file, pageNum, page);
+                leaf = (LeafNode<T>*) page;
+                index = 0;
+                continue;
+            }
+            if (!(leaf->keyArray[index] == key))
+            {
+                break;
             }
+            int cmp = compareFullKey(leaf->ridArray[index], fullValue);
+            count += inclusive ? cmp <= 0 : cmp < 0;
+            index++;
         }
+        bufMgr->unPinPage(file, pageNum, false);
+        return count;
     }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::BTreeIndex -- Constructor with specified node/leaf capacities
+// BTreeIndex::locateEntry
 // -----------------------------------------------------------------------------
-    BTreeIndex::BTreeIndex(const std::string & relationName,
-                           std::string & outIndexName,
-                           BufMgr *bufMgrIn,
-                           const int attrByteOffset,
-                           const Datatype attrType, const int nodeOccupancy, const int leafOccupancy)
-    {
-        std::ostringstream idxStr;
-        idxStr << relationName << '.' << attrByteOffset;
-        outIndexName = idxStr.str();
-
-        bufMgr = bufMgrIn;
-        this->leafOccupancy = leafOccupancy;
-        this->nodeOccupancy = nodeOccupancy;
-        attributeType = attrType;
-        this->attrByteOffset = attrByteOffset;
-        scanExecuting = false;
 
-        // Check to see if file exist
-        try
+    template <class T>
+    PageId BTreeIndex::locateEntry(std::uint64_t position, int& slot, std::uint64_t& listIndex, PageId& parentNum,
+                                   int& childIndex)
+    {
+        PageId pageNum = rootPageNum;
+        bool isLeaf = rootIsLeaf;
+        parentNum = Page::INVALID_NUMBER;
+        childIndex = 0;
+        while (!isLeaf)
         {
-            // file exists, open file
-            file = new BlobFile(outIndexName, false);
-
-            // get root info from meta page
-            headerPageNum = file->getFirstPageNo();
-            Page* headerPage;
-            bufMgr->readPage(file, headerPageNum, headerPage);
-            IndexMetaInfo* metaInfo = (IndexMetaInfo*) headerPage;
-            rootPageNum = metaInfo->rootPageNo;
-            bufMgr->unPinPage(file, headerPageNum, false);
-
-            rootIsLeaf = metaInfo->rootIsLeaf;
+            Page* page;
+            bufMgr->readPage(file, pageNum, page);
+            NonLeafNode<T>* node = (NonLeafNode<T>*) page;
+            int numKeys = node->header.numKeys;
+            int index = 0;
+            while (index < numKeys && position >= childCount(node, index))
+            {
+                position -= childCount(node, index);
+                index++;
+            }
+            PageId childNum = node->pageNoArray[index];
+            isLeaf = (node->header.level == 1);
+            bufMgr->unPinPage(file, pageNum, false);
+            parentNum = pageNum;
+            childIndex = index;
+            pageNum = childNum;
         }
-        catch (FileNotFoundException& e)
-        {
-            // File does not exist, create it
-            file = new BlobFile(outIndexName, true);
-
-            // allocate pages for meta info and root noe
-            Page* headerPage;
-            bufMgr->allocPage(file, headerPageNum, headerPage);
-
-            Page* rootPage;
-            bufMgr->allocPage(file, rootPageNum, rootPage);
-
-            // set info in meta page
-            IndexMetaInfo* metaInfo = (IndexMetaInfo*) headerPage;
-            metaInfo->attrByteOffset = attrByteOffset;
-            metaInfo->attrType = attrType;
-            metaInfo->rootPageNo = rootPageNum;
-            strncpy(metaInfo->relationName, relationName.c_str(), relationName.length());
 
-            // create root node
-            LeafNodeInt* root = (LeafNodeInt*) rootPage;
-            // set right sibling page number to max int value to denote no right sibling
-            root->rightSibPageNo = MAX_INT;
-            // set entries of key array to max int value to denote no key in that index
-            for (int i = 0; i < leafOccupancy; i++)
+        Page* page;
+        bufMgr->readPage(file, pageNum, page);
+        LeafNode<T>* leaf = (LeafNode<T>*) page;
+        int numKeys = leaf->header.numKeys;
+        slot = 0;
+        while (slot < numKeys - 1)
+        {
+            std::uint64_t entries = leaf->ridArray[slot].isPostingList() ?
+                    postingListSize(leaf->ridArray[slot].pageNumber()) : 1;
+            if (position < entries)
             {
-                root->keyArray[i] = MAX_INT;
+                break;
             }
+            position -= entries;
+            slot++;
+        }
+        listIndex = position;
+        bufMgr->unPinPage(file, pageNum, false);
+        return pageNum;
+    }
 
-            rootIsLeaf = true;
-            metaInfo->rootIsLeaf = true;
+// -----------------------------------------------------------------------------
+// BTreeIndex::subtreeEntries
+// -----------------------------------------------------------------------------
 
-            bufMgr->unPinPage(file, headerPageNum, true);
-            bufMgr->unPinPage(file, rootPageNum, true);
+    template <class T>
+    std::uint64_t BTreeIndex::subtreeEntries(const PageId pageNum)
+    {
+        Page* page;
+        bufMgr->readPage(file, pageNum, page);
+        std::uint64_t count;
+        if (((NodeHeader*) page)->level == 0)
+        {
+            LeafNode<T>* leaf = (LeafNode<T>*) page;
+            count = leafEntries(leaf, leaf->header.numKeys);
+        }
+        else
+        {
+            count = nodeEntries((NonLeafNode<T>*) page);
+        }
+        bufMgr->unPinPage(file, pageNum, false);
+        return count;
+    }
 
-            FileScan fscan(relationName, bufMgr);
+// -----------------------------------------------------------------------------
+// BTreeIndex::leafEntries
+// -----------------------------------------------------------------------------
 
-            // Insert into B+ tree
-            while(true)
+    template <class T>
+    std::uint64_t BTreeIndex::leafEntries(LeafNode<T>* leaf, const int end)
+    {
+        std::uint64_t count = end;
+        for (int i = 0; i < end; i++)
+        {
+            if (leaf->ridArray[i].isPostingList())
             {
-                try
-                {
-                    RecordId rid;
-                    fscan.scanNext(rid);
-                    std::string recordStr = fscan.getRecord();
-                    const char *record = recordStr.c_str();
-                    insertEntry(record + attrByteOffset, rid);
-                }
-                catch(EndOfFileException& e)
-                {
-                    break;
-                }
+                count += postingListSize(leaf->ridArray[i].pageNumber()) - 1;
             }
         }
+        return count;
     }
 
-
 // -----------------------------------------------------------------------------
-// BTreeIndex::~BTreeIndex -- destructor
+// BTreeIndex::setScanBounds
 // -----------------------------------------------------------------------------
 
-    BTreeIndex::~BTreeIndex()
+    template <class T>
+    void BTreeIndex::setScanBounds(ScanCursor& cursor, const void* lowValParm, const void* highValParm)
     {
-        scanExecuting = false;
+        T& lowVal = cursor.scanLowVal<T>();
+        T& highVal = cursor.scanHighVal<T>();
+        lowVal = keyFromBytes<T>(lowValParm);
+        highVal = keyFromBytes<T>(highValParm);
 
-        bufMgr->flushFile(file);
-        delete file;
+        // check for bad scan range
+        if (highVal < lowVal)
+        {
+            throw BadScanrangeException();
+        }
     }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::insertEntry
+// BTreeIndex::scanNextTyped
 // -----------------------------------------------------------------------------
 
-    void BTreeIndex::insertEntry(const void *key, const RecordId rid)
+    template <class T>
+    bool BTreeIndex::scanNextTyped(ScanCursor& cursor, RecordId& outRid, void* included)
     {
-        // Splitting logic
-        /*
-        If the tree is empty insert the root node
-        Else determine if the value should go to left or right of the root
-        */
-        /*
-        1) Search for appropriate location to add an entry
-        2) Check if the node has the space for a new entry
-            a) if there is no space split the entry into two entries. If there is space then insert and terminate
-            b) Is this entry a leaf node?
-                i) If yes then copy the middle node into the parent entry
-                ii) If no then move the middle node to the parent entry
-            c) insert index entry pointing towards the new half of the split entry into the parent entry
+        resumeScan<T>(cursor);
+        if (!seekMatch<T>(cursor))
+        {
+            parkScan(cursor);
+            return false;
+        }
 
-         */
-        PageKeyPair<int> split;
-        if (rootIsLeaf)
+        LeafNode<T>* leaf = (LeafNode<T>*) cursor.currentPageData;
+        cursor.scanLastKey<T>() = leaf->keyArray[cursor.nextEntry];
+        PackedRecordId entry = leaf->ridArray[cursor.nextEntry];
+        if (entry.isPostingList())
         {
-            split = insertLeaf(rootPageNum, key, rid);
+            nextPostingRids(cursor, entry.pageNumber(), &outRid, 1);
         }
         else
         {
-            split = insertNode(rootPageNum, key, rid);
+            outRid = entry;
+            if (included != NULL && includedSize > 0)
+            {
+                memcpy(included, leafIncluded(leaf, cursor.nextEntry), includedSize);
+            }
+            cursor.nextEntry += cursor.descending ? -1 : 1;
         }
+        cursor.lastRid = outRid;
+        cursor.returnedAny = true;
 
-		// check if the root is to be split
-        if (split.key != MAX_INT)
-        {
-			// create new root node
-            Page* page;
-            PageId pageNum;
+        parkScan(cursor);
+        return true;
+    }
 
-            bufMgr->allocPage(file, pageNum, page);
+// -----------------------------------------------------------------------------
+// BTreeIndex::scanNextBatchTyped
+// -----------------------------------------------------------------------------
 
-            NonLeafNodeInt* node = (NonLeafNodeInt*) page;
-            node->keyArray[0] = split.key;
-            node->pageNoArray[0] = rootPageNum;
-            node->pageNoArray[1] = split.pageNo;
+    template <class T>
+    std::size_t BTreeIndex::scanNextBatchTyped(ScanCursor& cursor, RecordId* outRids, std::size_t maxRids,
+                                               void* included)
+    {
+        const T& lowVal = cursor.scanLowVal<T>();
+        const T& highVal = cursor.scanHighVal<T>();
+        std::size_t count = 0;
+        resumeScan<T>(cursor);
+        while (count < maxRids && seekMatch<T>(cursor))
+        {
+            LeafNode<T>* leaf = (LeafNode<T>*) cursor.currentPageData;
+            int numKeys = leaf->header.numKeys;
+            int start = cursor.nextEntry;
+            cursor.scanLastKey<T>() = leaf->keyArray[start];
+            cursor.returnedAny = true;
 
-            rootPageNum = pageNum;
+            // the record ids of a key with a posting list come from the list
+            if (leaf->ridArray[start].isPostingList())
+            {
+                count += nextPostingRids(cursor, leaf->ridArray[start].pageNumber(), outRids + count, maxRids - count);
+                cursor.lastRid = outRids[count - 1];
+                continue;
+            }
 
-            for (int i = 1; i < nodeOccupancy; i++)
+            // a descending scan takes the entries from the current one down to the low bound the same way,
+            // returning them last first
+            if (cursor.descending)
             {
-                node->keyArray[i] = MAX_INT;
+                int first;
+                if (!isCompleteKey(highVal) && compareKeys(leaf->keyArray[start], highVal) == 0)
+                {
+                    first = start;
+                }
+                else
+                {
+                    if (cursor.lowOp == GTE && isCompleteKey(lowVal))
+                    {
+                        first = searchLowerBound(leaf->keyArray, start + 1, lowVal);
+                    }
+                    else
+                    {
+                        first = searchUpperBound(leaf->keyArray, start + 1, lowVal);
+                    }
+                    first = std::min(first, start);
+                }
+
+                int taken = std::min((std::size_t) (start - first + 1), maxRids - count);
+                for (int i = start - 1; i > start - taken; i--)
+                {
+                    if (leaf->ridArray[i].isPostingList())
+                    {
+                        taken = start - i;
+                        break;
+                    }
+                }
+                std::reverse_copy(leaf->ridArray + start + 1 - taken, leaf->ridArray + start + 1, outRids + count);
+                for (int i = 0; included != NULL && includedSize > 0 && i < taken; i++)
+                {
+                    memcpy((char*) included + (count + i) * includedSize, leafIncluded(leaf, start - i), includedSize);
+                }
+                cursor.nextEntry -= taken;
+                count += taken;
+
+                cursor.scanLastKey<T>() = leaf->keyArray[cursor.nextEntry + 1];
+                cursor.lastRid = leaf->ridArray[cursor.nextEntry + 1];
+                continue;
             }
 
-            if (rootIsLeaf)
+            // the entries from the current one up to the high bound all match, except for the ones
+            // tied with a bound longer than the key prefix which have to be checked one at a time
+            int end;
+            if (!isCompleteKey(lowVal) && compareKeys(leaf->keyArray[start], lowVal) == 0)
             {
-                node->level = 1;
-                rootIsLeaf = false;
+                end = start + 1;
             }
             else
             {
-                node->level = 0;
+                if (cursor.highOp == LTE && isCompleteKey(highVal))
+                {
+                    end = start + searchUpperBound(leaf->keyArray + start, numKeys - start, highVal);
+                }
+                else
+                {
+                    end = start + searchLowerBound(leaf->keyArray + start, numKeys - start, highVal);
+                }
+                end = std::max(end, start + 1);
             }
 
-            //  update root page number in the header
-            Page* headerPage;
-            bufMgr->readPage(file, headerPageNum, headerPage);
-            IndexMetaInfo* metaPage = (IndexMetaInfo*) headerPage;
-            metaPage -> rootPageNo = rootPageNum;
-            metaPage -> rootIsLeaf = false;
+            int taken = std::min((std::size_t) (end - start), maxRids - count);
+            for (int i = start + 1; i < start + taken; i++)
+            {
+                if (leaf->ridArray[i].isPostingList())
+                {
+                    taken = i - start;
+                    break;
+                }
+            }
+            std::copy(leaf->ridArray + start, leaf->ridArray + start + taken, outRids + count);
+            if (included != NULL && includedSize > 0)
+            {
+                memcpy((char*) included + count * includedSize, leafIncluded(leaf, start), taken * includedSize);
+            }
+            cursor.nextEntry += taken;
+            count += taken;
 
-            bufMgr->unPinPage(file, pageNum, true);
-            bufMgr->unPinPage(file, headerPageNum, true);
+            cursor.scanLastKey<T>() = leaf->keyArray[cursor.nextEntry - 1];
+            cursor.lastRid = leaf->ridArray[cursor.nextEntry - 1];
         }
-
-        return;
+        parkScan(cursor);
+        return count;
     }
 
-    // -----------------------------------------------------------------------------
-    // BTreeIndex::insertNode
-    // -----------------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+// BTreeIndex::resumeScan
+// -----------------------------------------------------------------------------
 
-    PageKeyPair<int> BTreeIndex::insertNode(PageId pageNum, const void *key, const RecordId rid)
+    template <class T>
+    void BTreeIndex::resumeScan(ScanCursor& cursor)
     {
-        Page* page;
-        bufMgr->readPage(file, pageNum, page);
-        NonLeafNodeInt* node = (NonLeafNodeInt*) page;
-
-		// find the smallest entry in the node with a key >= the element we are inserting
-        int index = 0;
-        int k = *((int*) key);
-        while (index < nodeOccupancy && node->keyArray[index] < k)
+        latches[cursor.currentPageNum].lockShared();
+        if (latches[cursor.currentPageNum].version() == cursor.leafVersion &&
+                structureVersion == cursor.structureVersion)
         {
-            index++;
+            return;
         }
 
-        // Determine if the current node is at the level above the leaf nodes
-        PageKeyPair<int> split;
-        if (node-> level == 1)
-        {
-            split = insertLeaf(node->pageNoArray[index], key, rid);
-        }
-        else
+        // entries may have moved to other leaves, look for the position again from the root
+        latches[cursor.currentPageNum].unlockShared();
+        bufMgr->unPinPage(file, cursor.currentPageNum, false);
+        if (!cursor.returnedAny)
         {
-            split = insertNode(node->pageNoArray[index], key, rid);
+            findScanStart<T>(cursor);
+            return;
         }
 
-        PageKeyPair<int> pair;
-        // determine if children of node were split
-        if (split.key != MAX_INT)
-        {
-            // determine if this node needs to split
-            if (node->keyArray[nodeOccupancy - 1] != MAX_INT)
-            {
-                //split node using logic described in insertEntry()
+        findEntry<T>(cursor);
+    }
 
-                Page* splitPage;
-                PageId splitID;
-                bufMgr->allocPage(file, splitID, splitPage);
-                
-                // create new node for splitting
-                NonLeafNodeInt* splitNode = (NonLeafNodeInt*) splitPage;
-                splitNode->level = node->level;
+// -----------------------------------------------------------------------------
+// BTreeIndex::findEntry
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    void BTreeIndex::findEntry(ScanCursor& cursor)
+    {
+        // the descent by key and record id ends in the leaf that holds the last entry returned, or would hold it
+        const T& key = cursor.scanLastKey<T>();
+        bool leftmost;
+        bool rightmost;
+        latchLeaf<T>(key, &cursor.lastRid, false, false, cursor.currentPageNum, leftmost, rightmost,
+                     cursor.readaheadParentNum, cursor.readaheadChild);
+        bufMgr->readPage(file, cursor.currentPageNum, cursor.currentPageData);
+        cursor.leavesAhead = 0;
+        cursor.postingPageNum = Page::INVALID_NUMBER;
 
-                for (int i = 0; i < nodeOccupancy; i++)
+        // step over the entries tied with the key up to the last record id returned, in the direction of the
+        // scan. The next one may be in the middle of a posting list, or past the end of the leaf
+        LeafNode<T>* leaf = (LeafNode<T>*) cursor.currentPageData;
+        int numKeys = leaf->header.numKeys;
+        if (cursor.descending)
+        {
+            int index = searchUpperBound(leaf->keyArray, numKeys, key) - 1;
+            while (index >= 0 && !(leaf->keyArray[index] < key))
+            {
+                PackedRecordId entry = leaf->ridArray[index];
+                if (entry.isPostingList() ? seekPostingList(cursor, entry.pageNumber(), cursor.lastRid) :
+                        ridBefore(entry, cursor.lastRid))
                 {
-                    splitNode->keyArray[i] = MAX_INT;
+                    break;
                 }
+                index--;
+            }
+            cursor.nextEntry = index;
+            return;
+        }
+
+        int index = searchLowerBound(leaf->keyArray, numKeys, key);
+        while (index < numKeys && !(key < leaf->keyArray[index]))
+        {
+            PackedRecordId entry = leaf->ridArray[index];
+            if (entry.isPostingList() ? seekPostingList(cursor, entry.pageNumber(), cursor.lastRid) :
+                    ridBefore(cursor.lastRid, entry))
+            {
+                break;
+            }
+            index++;
+        }
+        cursor.nextEntry = index;
+    }
 
-                int mid = (nodeOccupancy) / 2;
+// -----------------------------------------------------------------------------
+// BTreeIndex::parkScan
+// -----------------------------------------------------------------------------
 
-                // determine how to split and which key to push up 
-                // based on location of node inserted
-                if (index == mid)
-                {
-                    // copies right half of entries to new leaf
-                    for (int i = mid; i < nodeOccupancy; i++)
-                    {
-                        splitNode->keyArray[i - mid] = node->keyArray[i];
-                        splitNode->pageNoArray[i - mid + 1] = node->pageNoArray[i + 1];
-                    }
-                    splitNode->pageNoArray[0] = split.pageNo;
-                    
-                    for (int i = mid; i < nodeOccupancy; i++)
-                    {
-                        node->keyArray[i] = MAX_INT;
-                    }
+    void BTreeIndex::parkScan(ScanCursor& cursor)
+    {
+        cursor.leafVersion = latches[cursor.currentPageNum].version();
+        cursor.structureVersion = structureVersion;
+        latches[cursor.currentPageNum].unlockShared();
+    }
 
-                    pair.set(splitID, split.key);
-                }
-                else if (index < mid)
-                {
-                    // copies right half of entries to new leaf
-                    for (int i = mid; i < nodeOccupancy; i++)
-                    {
-                        splitNode->keyArray[i - mid] = node->keyArray[i];
-                        splitNode->pageNoArray[i - mid + 1] = node->pageNoArray[i + 1];
-                    }
+// -----------------------------------------------------------------------------
+// BTreeIndex::moveRight
+// -----------------------------------------------------------------------------
 
-                    splitNode->pageNoArray[0] = node->pageNoArray[mid];
+    template <class T>
+    void BTreeIndex::moveRight(ScanCursor& cursor)
+    {
+        // the sibling is latched before the current leaf is let go, so that no split falls in between
+        PageId sibNum = ((NodeHeader*) cursor.currentPageData)->rightSibPageNo;
+        latches[sibNum].lockShared();
+        bufMgr->unPinPage(file, cursor.currentPageNum, false);
+        latches[cursor.currentPageNum].unlockShared();
+        cursor.currentPageNum = sibNum;
+        bufMgr->readPage(file, cursor.currentPageNum, cursor.currentPageData);
+        cursor.nextEntry = 0;
 
-                    pair.set(splitID, node->keyArray[mid - 1]);
+        // the scan reached one of the leaves read ahead, top the window up once half of it is used
+        if (cursor.readaheadWindow > 0)
+        {
+            cursor.leavesAhead = std::max(cursor.leavesAhead - 1, 0);
+            if (cursor.leavesAhead <= cursor.readaheadWindow / 2)
+            {
+                readAhead<T>(cursor);
+            }
+        }
+    }
 
-                    // shift elements over in current leaf that are greater than the one we are inserting
-                    for (int i = mid - 2; i >= index; i--)
-                    {
-                        node->keyArray[i + 1] = node->keyArray[i];
-                        node->pageNoArray[i + 2] = node->pageNoArray[i + 1];
-                    }
+// -----------------------------------------------------------------------------
+// BTreeIndex::moveLeft
+// -----------------------------------------------------------------------------
 
-                    for (int i = mid; i < nodeOccupancy; i++)
-                    {
-                        node->keyArray[i] = MAX_INT;
-                    }
+    template <class T>
+    void BTreeIndex::moveLeft(ScanCursor& cursor)
+    {
+        // the sibling may split once the current leaf is let go, putting new leaves in between. Leaves are
+        // not merged while a scan call runs, so the right siblings of the old sibling lead back to the current leaf
+        PageId currentNum = cursor.currentPageNum;
+        PageId sibNum = ((NodeHeader*) cursor.currentPageData)->leftSibPageNo;
+        bufMgr->unPinPage(file, currentNum, false);
+        latches[currentNum].unlockShared();
+        latches[sibNum].lockShared();
+        bufMgr->readPage(file, sibNum, cursor.currentPageData);
+        PageId nextNum;
+        while ((nextNum = ((NodeHeader*) cursor.currentPageData)->rightSibPageNo) != currentNum)
+        {
+            latches[nextNum].lockShared();
+            bufMgr->unPinPage(file, sibNum, false);
+            latches[sibNum].unlockShared();
+            sibNum = nextNum;
+            bufMgr->readPage(file, sibNum, cursor.currentPageData);
+        }
+        cursor.currentPageNum = sibNum;
+        cursor.nextEntry = ((NodeHeader*) cursor.currentPageData)->numKeys - 1;
 
-                    node->keyArray[index] = split.key;
-                    node->pageNoArray[index + 1] = split.pageNo;
+        if (cursor.readaheadWindow > 0)
+        {
+            cursor.leavesAhead = std::max(cursor.leavesAhead - 1, 0);
+            if (cursor.leavesAhead <= cursor.readaheadWindow / 2)
+            {
+                readAhead<T>(cursor);
+            }
+        }
+    }
 
-                }
-                else
-                {
-                    pair.set(splitID, node->keyArray[mid]);
-                    mid++;
-                    splitNode->pageNoArray[0] = node->pageNoArray[mid];
-                    // copies right half of entries to new leaf
-                    for (int i = mid; i < index; i++)
-                    {
-                        splitNode->keyArray[i - mid] = node->keyArray[i];
-                        splitNode->pageNoArray[i - mid + 1] = node->pageNoArray[i + 1];
-                    }
+// -----------------------------------------------------------------------------
+// BTreeIndex::readAhead
+// -----------------------------------------------------------------------------
 
-                    splitNode->keyArray[index - mid] = split.key;
-                    splitNode->pageNoArray[index - mid + 1] = split.pageNo;
+    template <class T>
+    void BTreeIndex::readAhead(ScanCursor& cursor)
+    {
+        // the leaves after the ones already read ahead are the next children of their parent and then of the
+        // right siblings of the parent, or the previous children and the left siblings for a descending scan.
+        // The parents are read optimistically, since latching a node above the current leaf could deadlock
+        // with an insert. Whatever a concurrent split changes only makes the readahead miss a leaf or read an
+        // extra one
+        PageId pageNos[MAX_READAHEAD_LEAVES];
+        int count = 0;
+        int wanted = cursor.readaheadWindow - cursor.leavesAhead;
+        PageId parentNum = cursor.readaheadParentNum;
+        int child = cursor.readaheadChild;
+        while (count < wanted && parentNum != Page::INVALID_NUMBER)
+        {
+            NodeLatch& latch = latches[parentNum];
+            std::uint64_t version;
+            if (!latch.readVersion(version))
+            {
+                break;
+            }
 
-                    for (int i = index; i < nodeOccupancy; i++)
-                    {
-                        splitNode->keyArray[i - mid + 1] = node->keyArray[i];
-                        splitNode->pageNoArray[i - mid + 2] = node->pageNoArray[i + 1];
-                    }
+            Page* page;
+            bufMgr->readPage(file, parentNum, page);
+            NonLeafNode<T>* node = (NonLeafNode<T>*) page;
+            int numKeys = std::max(0, std::min((int) node->header.numKeys, nodeOccupancy));
+            int taken;
+            PageId sibNum;
+            if (cursor.descending)
+            {
+                // a child past the last one stands for the end of the parent
+                child = std::min(child, numKeys + 1);
+                taken = std::max(0, std::min(wanted - count, child));
+                std::reverse_copy(node->pageNoArray + child - taken, node->pageNoArray + child, pageNos + count);
+                sibNum = node->header.leftSibPageNo;
+            }
+            else
+            {
+                taken = std::max(0, std::min(wanted - count, numKeys - child));
+                std::copy(node->pageNoArray + child + 1, node->pageNoArray + child + 1 + taken, pageNos + count);
+                sibNum = node->header.rightSibPageNo;
+            }
+            bool isParent = (node->header.level == 1);
+            bufMgr->unPinPage(file, parentNum, false);
+            if (!latch.validate(version) || !isParent)
+            {
+                break;
+            }
 
-                    for (int i = mid - 1; i < nodeOccupancy; i++)
-                    {
-                        node->keyArray[i] = MAX_INT;
-                    }
+            count += taken;
+            if (cursor.descending)
+            {
+                child -= taken;
+                if (child <= 0)
+                {
+                    parentNum = sibNum;
+                    child = nodeOccupancy + 1;
                 }
-                bufMgr->unPinPage(file, splitID, true);
             }
             else
             {
-                // shift keys right
-                for (int i = nodeOccupancy - 2; i >= index; i--)
+                child += taken;
+                if (child >= numKeys)
                 {
-                    node->keyArray[i + 1] = node->keyArray[i];
-                    node->pageNoArray[i + 2] = node->pageNoArray[i + 1];
+                    parentNum = sibNum;
+                    child = -1;
                 }
-                node->keyArray[index] = split.key;
-                node->pageNoArray[index + 1] = split.pageNo;
-
-                pair.set(MAX_INT, MAX_INT);
             }
-            bufMgr->unPinPage(file, pageNum, true);
         }
-        else
+
+        if (count > 0)
         {
-            pair.set(MAX_INT, MAX_INT);
-            bufMgr->unPinPage(file, pageNum, false);
+            bufMgr->prefetchPages(file, pageNos, count);
         }
-        return pair;
+        cursor.readaheadParentNum = parentNum;
+        cursor.readaheadChild = child;
+        cursor.leavesAhead += count;
+
+        // scans that keep going read further and further ahead
+        cursor.readaheadWindow = std::min(2 * cursor.readaheadWindow, MAX_READAHEAD_LEAVES);
     }
 
-    /*
-    Helper method for the insertNode, manages adding a leaf to the b+ tree.
-    */
-    PageKeyPair<int> BTreeIndex::insertLeaf(PageId pageNum, const void *key, const RecordId rid)
+// -----------------------------------------------------------------------------
+// BTreeIndex::seekMatch
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    bool BTreeIndex::seekMatch(ScanCursor& cursor)
     {
-        Page* page;
-        bufMgr->readPage(file, pageNum, page);
-        
-        // figure out where to insert the new record
-        LeafNodeInt* leaf = (LeafNodeInt*) page;
-        int index = 0;
-        int k = *((int*) key);
-        while(index < leafOccupancy && leaf->keyArray[index] < k)
+        if (cursor.descending)
         {
-            index++;
+            return seekMatchDescending<T>(cursor);
         }
 
-		// if the leaf is full, split into two leaves
-        PageKeyPair<int> pair;
-        if (leaf->keyArray[leafOccupancy - 1] != MAX_INT)
-        {
-            //split node
+        const T& lowVal = cursor.scanLowVal<T>();
+        const T& highVal = cursor.scanHighVal<T>();
+        LeafNode<T>* leaf = (LeafNode<T>*) cursor.currentPageData;
 
-			// create the new leaf
-            Page* split;
-            PageId splitID;
-            bufMgr->allocPage(file, splitID, split);
-            LeafNodeInt* splitNode = (LeafNodeInt*) split;
-            splitNode->rightSibPageNo = leaf -> rightSibPageNo;
-            leaf->rightSibPageNo = splitID;
+        while (true)
+        {
+            // If at the end of a leaf, go to next page
+            if (cursor.nextEntry >= leaf->header.numKeys)
+            {
+                // No more pages in tree, scan is completed
+                if (leaf->header.rightSibPageNo == Page::INVALID_NUMBER)
+                {
+                    return false;
+                }
+                moveRight<T>(cursor);
+                leaf = (LeafNode<T>*) cursor.currentPageData;
+                continue;
+            }
 
-            for (int i = 0; i < leafOccupancy; i++)
+            // keys are sorted, so the scan is over at the first key past the high bound. Keys tied
+            // with a bound longer than the key prefix may fall on either side of it, in any order,
+            // so each of them is checked against the full value instead
+            const T& key = leaf->keyArray[cursor.nextEntry];
+            int highCmp = compareKeys(key, highVal);
+            if (highCmp > 0 || (highCmp == 0 && cursor.highOp == LT && isCompleteKey(highVal)))
             {
-                splitNode-> keyArray[i] = MAX_INT;
+                return false;
             }
 
-            int mid = (leafOccupancy - 1) / 2;
+            bool inRange = true;
+            if (highCmp == 0 && !isCompleteKey(highVal))
+            {
+                int cmp = compareFullKey(leaf->ridArray[cursor.nextEntry], cursor.highValString);
+                inRange = (cursor.highOp == LT) ? cmp < 0 : cmp <= 0;
+            }
 
-            if (index <= mid)
+            // entries are never below the low bound, but may be equal to it
+            if (inRange && compareKeys(key, lowVal) == 0)
             {
-				// copies the second half of the leaf to the new leaf
-                for (int i = mid; i < leafOccupancy; i++)
+                if (isCompleteKey(lowVal))
                 {
-                    splitNode->keyArray[i - mid] = leaf->keyArray[i];
-                    splitNode->ridArray[i - mid] = leaf->ridArray[i];
+                    inRange = (cursor.lowOp == GTE);
                 }
-
-				// shifts the elements greater than the element we are inserting right
-                for (int i = mid - 1; i >= index; i--)
+                else
                 {
-                    leaf->keyArray[i + 1] = leaf->keyArray[i];
-                    leaf->ridArray[i + 1] = leaf->ridArray[i];
+                    int cmp = compareFullKey(leaf->ridArray[cursor.nextEntry], cursor.lowValString);
+                    inRange = (cursor.lowOp == GT) ? cmp > 0 : cmp >= 0;
                 }
+            }
+
+            if (inRange)
+            {
+                return true;
+            }
+            cursor.nextEntry++;
+        }
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::seekMatchDescending
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    bool BTreeIndex::seekMatchDescending(ScanCursor& cursor)
+    {
+        const T& lowVal = cursor.scanLowVal<T>();
+        const T& highVal = cursor.scanHighVal<T>();
+        LeafNode<T>* leaf = (LeafNode<T>*) cursor.currentPageData;
 
-                for (int i = mid + 1; i < leafOccupancy; i++)
+        while (true)
+        {
+            // before the first entry of a leaf, go to the previous one
+            if (cursor.nextEntry < 0)
+            {
+                if (leaf->header.leftSibPageNo == Page::INVALID_NUMBER)
                 {
-                    leaf->keyArray[i] = MAX_INT;
+                    return false;
                 }
+                moveLeft<T>(cursor);
+                leaf = (LeafNode<T>*) cursor.currentPageData;
+                continue;
+            }
 
-                leaf->keyArray[index] = k;
-                leaf->ridArray[index] = rid;
+            // the scan is over at the first key past the low bound, keys tied with a bound longer than
+            // the key prefix being checked against the full value as in seekMatch()
+            const T& key = leaf->keyArray[cursor.nextEntry];
+            int lowCmp = compareKeys(key, lowVal);
+            if (lowCmp < 0 || (lowCmp == 0 && cursor.lowOp == GT && isCompleteKey(lowVal)))
+            {
+                return false;
             }
-            else
+
+            bool inRange = true;
+            if (lowCmp == 0 && !isCompleteKey(lowVal))
             {
-                mid++;
-                // copy the second half of the current leaf into the new leaf
-                for (int i = mid; i < index; i++)
-                {
-                    splitNode->keyArray[i - mid] = leaf->keyArray[i];
-                    splitNode->ridArray[i - mid] = leaf->ridArray[i];
-                }
-                splitNode->keyArray[index - mid] = k;
-                splitNode->ridArray[index - mid] = rid;
-                for (int i = index; i < leafOccupancy; i++)
+                int cmp = compareFullKey(leaf->ridArray[cursor.nextEntry], cursor.lowValString);
+                inRange = (cursor.lowOp == GT) ? cmp > 0 : cmp >= 0;
+            }
+
+            // entries are never above the high bound, but may be equal to it
+            if (inRange && compareKeys(key, highVal) == 0)
+            {
+                if (isCompleteKey(highVal))
                 {
-                    splitNode->keyArray[i - mid + 1] = leaf->keyArray[i];
-                    splitNode->ridArray[i - mid + 1] = leaf->ridArray[i];
+                    inRange = (cursor.highOp == LTE);
                 }
-
-                // reset keys in current leaf
-                for (int i = mid; i < leafOccupancy; i++)
+                else
                 {
-                    leaf->keyArray[i] = MAX_INT;
+                    int cmp = compareFullKey(leaf->ridArray[cursor.nextEntry], cursor.highValString);
+                    inRange = (cursor.highOp == LT) ? cmp < 0 : cmp <= 0;
                 }
             }
 
-            pair.set(splitID, splitNode->keyArray[0]);
-            bufMgr->unPinPage(file, splitID, true);
+            if (inRange)
+            {
+                return true;
+            }
+            cursor.nextEntry--;
         }
-        else
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::compareFullKey
+// -----------------------------------------------------------------------------
+
+    int BTreeIndex::compareFullKey(const RecordId& rid, const std::string& value)
+    {
+        std::string record = readRecord(rid);
+        const char* attr = record.c_str() + attrByteOffset;
+        std::string full(attr, strnlen(attr, record.size() - attrByteOffset));
+        return full.compare(value);
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::readRecord
+// -----------------------------------------------------------------------------
+
+    std::string BTreeIndex::readRecord(const RecordId& rid)
+    {
         {
-            // Leaf isn't full, shift over elements to the right and add to leaf
-            for (int i = leafOccupancy - 2; i >= index; i--)
+            std::lock_guard<std::mutex> lock(relationFileMutex);
+            if (relationFile == NULL)
             {
-                leaf->keyArray[i + 1] = leaf->keyArray[i];
-                leaf->ridArray[i + 1] = leaf->ridArray[i];
+                relationFile = new PageFile(relationName, false);
             }
-            leaf->keyArray[index] = k;
-            leaf->ridArray[index] = rid;
-
-            pair.set(MAX_INT, MAX_INT);    
         }
 
-        // unpin pages
-        bufMgr->unPinPage(file, pageNum, true);
-        return pair;
+        Page* page;
+        bufMgr->readPage(relationFile, rid.page_number, page);
+        std::string record = page->getRecord(rid);
+        bufMgr->unPinPage(relationFile, rid.page_number, false);
+        return record;
+    }
+
+// -----------------------------------------------------------------------------
+// BTreeIndex::readIncluded
+// -----------------------------------------------------------------------------
+
+    void BTreeIndex::readIncluded(const RecordId& rid, char* out)
+    {
+        std::string record = readRecord(rid);
+        for (std::size_t c = 0; c < includedColumns.size(); c++)
+        {
+            // columns past the end of a short record read as zeros
+            const IncludedColumn& column = includedColumns[c];
+            int available = std::max(0, std::min(column.length, (int) record.size() - column.byteOffset));
+            if (available > 0)
+            {
+                memcpy(out, record.data() + column.byteOffset, available);
+            }
+            memset(out + available, 0, column.length - available);
+            out += column.length;
+        }
     }
 
 // -----------------------------------------------------------------------------
@@ -564,158 +4531,243 @@ namespace badgerdb
                                const void* highValParm,
                                const Operator highOpParm)
     {
-		// check if operators are valid
-        if (lowOpParm != GT && lowOpParm != GTE)
+        if (!tryStartScan(lowValParm, lowOpParm, highValParm, highOpParm))
         {
-            throw BadOpcodesException();
+            throw NoSuchKeyFoundException();
         }
+    }
 
-        if (highOpParm != LT && highOpParm != LTE)
-        {
-            throw BadOpcodesException();
-        }
+// -----------------------------------------------------------------------------
+// BTreeIndex::tryStartScan
+// -----------------------------------------------------------------------------
 
-        lowValInt = *((int*) lowValParm);
-        highValInt = *((int*) highValParm);
+    bool BTreeIndex::tryStartScan(const void* lowValParm,
+                                  const Operator lowOpParm,
+                                  const void* highValParm,
+                                  const Operator highOpParm)
+    {
+        return tryOpenScan(scan, lowValParm, lowOpParm, highValParm, highOpParm);
+    }
 
-        // check for bad scan range
-        if (lowValInt > highValInt)
-        {
-            throw BadScanrangeException();
-        }
-        lowOp = lowOpParm;
-        highOp = highOpParm;
+// -----------------------------------------------------------------------------
+// BTreeIndex::scanNext
+// -----------------------------------------------------------------------------
 
-        // treat all GT parameters as GTE parameters
-        if (lowOp == GT)
-        {
-            lowValInt++;
-        }
+    void BTreeIndex::scanNext(RecordId& outRid, void* included)
+    {
+        scan.scanNext(outRid, included);
+    }
 
-        Page* page;
-        PageId pageNum = rootPageNum;
-        bufMgr->readPage(file, pageNum, page);
-        
-		// if the root isn't a leaf node, traverse the B+ tree until we reach a leaf
-        if (!rootIsLeaf)
-        {
-            NonLeafNodeInt* node = (NonLeafNodeInt*) page;
-            while(true)
-            {
-                // figure out which child to traverse to
-                int index = 0;
-                while (index < nodeOccupancy && node->keyArray[index] <= lowValInt)
-                {
-                    index++;
-                }
-                bufMgr->unPinPage(file, pageNum, false);
-                pageNum = node->pageNoArray[index];
-                bufMgr->readPage(file, pageNum, page);
+// -----------------------------------------------------------------------------
+// BTreeIndex::tryScanNext
+// -----------------------------------------------------------------------------
 
-                if (node-> level == 1)
-                {
-                    break;
-                }
-                node = (NonLeafNodeInt*) page;
-            }
-        }
+    bool BTreeIndex::tryScanNext(RecordId& outRid, void* included)
+    {
+        return scan.tryScanNext(outRid, included);
+    }
 
-        LeafNodeInt* leaf = (LeafNodeInt*) page;
-        int index = 0;
-		// find the first node >= the lower bound of our range
-        while(index < leafOccupancy && leaf->keyArray[index] < lowValInt)
-        {
-            index++;
-        }
+// -----------------------------------------------------------------------------
+// BTreeIndex::scanNextBatch
+// -----------------------------------------------------------------------------
 
-		// every element in our B+ tree is below the range we are searching for
-        if (index >= leafOccupancy)
-        {
-            bufMgr->unPinPage(file, pageNum, false);
-            throw NoSuchKeyFoundException();
-        }
+    std::size_t BTreeIndex::scanNextBatch(RecordId* outRids, std::size_t maxRids, void* included)
+    {
+        return scan.scanNextBatch(outRids, maxRids, included);
+    }
 
-		//  No elements within the range
-        if (highOp == LT && leaf->keyArray[index] >= highValInt)
-        {
-            bufMgr->unPinPage(file, pageNum, false);
-            throw NoSuchKeyFoundException();
-        }
+    // -----------------------------------------------------------------------------
+    // BTreeIndex::endScan
+    // -----------------------------------------------------------------------------
+    //
+    void BTreeIndex::endScan()
+    {
+        scan.endScan();
+    }
 
-        if (highOp == LTE && leaf->keyArray[index] > highValInt)
-        {
-            bufMgr->unPinPage(file, pageNum, false);
-            throw NoSuchKeyFoundException();
-        }
+// -----------------------------------------------------------------------------
+// ScanCursor::ScanCursor -- Constructors
+// -----------------------------------------------------------------------------
+
+    ScanCursor::ScanCursor()
+    {
+        // every member is set, so that moving a cursor that never scanned copies defined values
+        index = NULL;
+        scanExecuting = false;
+        nextEntry = 0;
+        currentPageNum = Page::INVALID_NUMBER;
+        currentPageData = NULL;
+        lowValInt = 0;
+        lowValDouble = 0;
+        highValInt = 0;
+        highValDouble = 0;
+        lowValStringKey = StringKey();
+        highValStringKey = StringKey();
+        lowValCompositeKey = CompositeKey();
+        highValCompositeKey = CompositeKey();
+        postingPageNum = Page::INVALID_NUMBER;
+        postingEntry = 0;
+        leafVersion = 0;
+        structureVersion = 0;
+        returnedAny = false;
+        lastKeyInt = 0;
+        lastKeyDouble = 0;
+        lastKeyStringKey = StringKey();
+        lastKeyCompositeKey = CompositeKey();
+        lastRid = RecordId();
+        readaheadWindow = 0;
+        readaheadParentNum = Page::INVALID_NUMBER;
+        readaheadChild = 0;
+        leavesAhead = 0;
+        lowOp = GTE;
+        highOp = LTE;
+        descending = false;
+    }
 
-		// mark which entry is the first in range
-        nextEntry = index;
-        currentPageNum = pageNum;
-        currentPageData = page;
-        scanExecuting = true;
+    ScanCursor::ScanCursor(ScanCursor&& other)
+        : ScanCursor()
+    {
+        *this = std::move(other);
     }
 
 // -----------------------------------------------------------------------------
-// BTreeIndex::scanNext
+// ScanCursor::operator=
 // -----------------------------------------------------------------------------
 
-    void BTreeIndex::scanNext(RecordId& outRid)
+    ScanCursor& ScanCursor::operator=(ScanCursor&& other)
     {
-        // Check to ensure we have active scan
-        if (!scanExecuting)
+        if (this == &other)
         {
-            throw ScanNotInitializedException();
+            return *this;
+        }
+        if (scanExecuting)
+        {
+            release();
         }
 
-        LeafNodeInt* leaf = (LeafNodeInt*) currentPageData;
+        index = other.index;
+        scanExecuting = other.scanExecuting;
+        nextEntry = other.nextEntry;
+        currentPageNum = other.currentPageNum;
+        currentPageData = other.currentPageData;
+        lowValInt = other.lowValInt;
+        lowValDouble = other.lowValDouble;
+        lowValString.swap(other.lowValString);
+        highValInt = other.highValInt;
+        highValDouble = other.highValDouble;
+        highValString.swap(other.highValString);
+        lowValStringKey = other.lowValStringKey;
+        highValStringKey = other.highValStringKey;
+        lowValCompositeKey = other.lowValCompositeKey;
+        highValCompositeKey = other.highValCompositeKey;
+        leafVersion = other.leafVersion;
+        structureVersion = other.structureVersion;
+        returnedAny = other.returnedAny;
+        lastKeyInt = other.lastKeyInt;
+        lastKeyDouble = other.lastKeyDouble;
+        lastKeyStringKey = other.lastKeyStringKey;
+        lastKeyCompositeKey = other.lastKeyCompositeKey;
+        lastRid = other.lastRid;
+        postingPageNum = other.postingPageNum;
+        postingEntry = other.postingEntry;
+        readaheadWindow = other.readaheadWindow;
+        readaheadParentNum = other.readaheadParentNum;
+        readaheadChild = other.readaheadChild;
+        leavesAhead = other.leavesAhead;
+        lowOp = other.lowOp;
+        highOp = other.highOp;
+        descending = other.descending;
+
+        // the pin on the current leaf now belongs to this cursor
+        other.scanExecuting = false;
+        return *this;
+    }
+
+// -----------------------------------------------------------------------------
+// ScanCursor::~ScanCursor -- destructor
+// -----------------------------------------------------------------------------
 
-        // If at the end of a leaf, go to next page
-        if (nextEntry >= leafOccupancy || leaf->keyArray[nextEntry] == MAX_INT)
+    ScanCursor::~ScanCursor()
+    {
+        if (scanExecuting)
         {
-            // No more pages in tree, scan is completed
-            if (leaf->rightSibPageNo == (PageId) MAX_INT)
+            try
+            {
+                release();
+            }
+            catch(...)
             {
-                throw IndexScanCompletedException();
             }
-            bufMgr->unPinPage(file, currentPageNum, false);
-            currentPageNum = leaf->rightSibPageNo;
-            bufMgr->readPage(file, currentPageNum, currentPageData);
-            
-            leaf = (LeafNodeInt*) currentPageData;
-            nextEntry = 0;
         }
+    }
+
+// -----------------------------------------------------------------------------
+// ScanCursor::scanNext
+// -----------------------------------------------------------------------------
 
-        // check if scan is completed
-        if (highOp == LT && leaf->keyArray[nextEntry] >= highValInt)
+    void ScanCursor::scanNext(RecordId& outRid, void* included)
+    {
+        if (!tryScanNext(outRid, included))
         {
             throw IndexScanCompletedException();
         }
+    }
+
+// -----------------------------------------------------------------------------
+// ScanCursor::tryScanNext
+// -----------------------------------------------------------------------------
 
-        if (highOp == LTE && leaf->keyArray[nextEntry] > highValInt)
+    bool ScanCursor::tryScanNext(RecordId& outRid, void* included)
+    {
+        // Check to ensure we have active scan
+        if (!scanExecuting)
         {
-            throw IndexScanCompletedException();
+            throw ScanNotInitializedException();
         }
 
-        outRid = leaf->ridArray[nextEntry];
+        SharedLatchGuard guard(index->structureLatch);
+        return (index->*index->keyOps->scanNext)(*this, outRid, included);
+    }
+
+// -----------------------------------------------------------------------------
+// ScanCursor::scanNextBatch
+// -----------------------------------------------------------------------------
+
+    std::size_t ScanCursor::scanNextBatch(RecordId* outRids, std::size_t maxRids, void* included)
+    {
+        if (!scanExecuting)
+        {
+            throw ScanNotInitializedException();
+        }
 
-        nextEntry++;
+        SharedLatchGuard guard(index->structureLatch);
+        return (index->*index->keyOps->scanNextBatch)(*this, outRids, maxRids, included);
     }
 
-    // -----------------------------------------------------------------------------
-    // BTreeIndex::endScan
-    // -----------------------------------------------------------------------------
-    //
-    void BTreeIndex::endScan()
+// -----------------------------------------------------------------------------
+// ScanCursor::endScan
+// -----------------------------------------------------------------------------
+
+    void ScanCursor::endScan()
     {
         if (!scanExecuting)
         {
             throw ScanNotInitializedException();
         }
 
-        bufMgr->unPinPage(file, currentPageNum, false);
+        release();
+    }
+
+// -----------------------------------------------------------------------------
+// ScanCursor::release
+// -----------------------------------------------------------------------------
+
+    void ScanCursor::release()
+    {
         scanExecuting = false;
+        index->bufMgr->unPinPage(index->file, currentPageNum, false);
     }
-    
+
     // -----------------------------------------------------------------------------
     // BTreeIndex::getNodesStatus
     // -----------------------------------------------------------------------------
@@ -11,15 +11,21 @@
 #include <string>
 #include "string.h"
 #include <sstream>
+#include <vector>
+#include <atomic>
+#include <mutex>
 
 #include "types.h"
 #include "page.h"
 #include "file.h"
 #include "buffer.h"
+#include "latch.h"
 
 namespace badgerdb
 {
 
+template <class T> class ExternalSort;
+
 /**
  * @brief Datatype enumeration type.
  */
@@ -27,7 +33,8 @@ enum Datatype
 {
 	INTEGER = 0,
 	DOUBLE = 1,
-	STRING = 2
+	STRING = 2,
+	COMPOSITE = 3	/* Several attributes, see KeyAttribute */
 };
 
 /**
@@ -41,18 +48,386 @@ enum Operator
 	GT		/* Greater Than */
 };
 
+/**
+ * @brief Order in which a scan returns the entries in its range. Passed to BTreeIndex::openScan() method.
+ */
+enum ScanDirection
+{
+	ASCENDING,	/* From the low bound up */
+	DESCENDING	/* From the high bound down */
+};
+
 
 /**
- * @brief Number of key slots in B+Tree leaf for INTEGER key.
+ * @brief Slot number of the record ids of leaf entries that refer to a posting list instead of a record.
+ * No page of a relation has that many slots.
  */
-//                                                  sibling ptr             key               rid
-const  int INTARRAYLEAFSIZE = ( Page::SIZE - sizeof( PageId ) ) / ( sizeof( int ) + sizeof( RecordId ) );
+const SlotId POSTINGLISTSLOT = 0xFFFF;
 
 /**
- * @brief Number of key slots in B+Tree non-leaf for INTEGER key.
+ * @brief Record id as stored in the leaves, in 6 bytes rather than the 8 of RecordId, whose padding is left out.
+ * The page number is split in two halves so that the entries need no more than 2-byte alignment.
+ * Converts to and from RecordId.
+ *
+ * This is not a compressed format, every entry keeps a whole page number and slot. Leaves hold about a fifth
+ * more INTEGER entries than with RecordId, and less than a tenth more STRING or COMPOSITE ones.
+ */
+struct PackedRecordId{
+	std::uint16_t pageLow;
+	std::uint16_t pageHigh;
+	SlotId slot;
+
+	PackedRecordId() = default;
+
+  /**
+   * Returns the entry referring to the posting list whose first page has the given page number.
+   */
+	static PackedRecordId postingList( PageId headPageNo )
+	{
+		PackedRecordId packed;
+		packed.pageLow = (std::uint16_t) headPageNo;
+		packed.pageHigh = (std::uint16_t) ( headPageNo >> 16 );
+		packed.slot = POSTINGLISTSLOT;
+		return packed;
+	}
+
+  /**
+   * Returns whether the entry refers to a posting list, whose first page is then pageNumber().
+   */
+	bool isPostingList() const
+	{
+		return slot == POSTINGLISTSLOT;
+	}
+
+	PageId pageNumber() const
+	{
+		return ( (PageId) pageHigh << 16 ) | pageLow;
+	}
+
+	PackedRecordId( const RecordId& rid )
+		: pageLow( (std::uint16_t) rid.page_number ), pageHigh( (std::uint16_t) ( rid.page_number >> 16 ) ),
+			slot( rid.slot_number )
+	{
+	}
+
+	operator RecordId() const
+	{
+		RecordId rid;
+		rid.page_number = pageNumber();
+		rid.slot_number = slot;
+		rid.padding = 0;
+		return rid;
+	}
+};
+
+static_assert( sizeof( PackedRecordId ) == 6, "Packed record ids take 6 bytes." );
+
+inline bool operator==( const PackedRecordId& packed, const RecordId& rid )
+{
+	return packed.pageLow == (std::uint16_t) rid.page_number &&
+		packed.pageHigh == (std::uint16_t) ( rid.page_number >> 16 ) && packed.slot == rid.slot_number;
+}
+
+inline bool operator!=( const PackedRecordId& packed, const RecordId& rid )
+{
+	return !( packed == rid );
+}
+
+/**
+ * @brief Version of the on-disk format of index nodes and of the meta page.
+ * Index files written with a different version are rejected when opened.
+ */
+const std::uint16_t NODEFORMATVERSION = 12;
+
+/**
+ * @brief Header at the start of every node of the tree, leaf or not.
+ */
+struct NodeHeader{
+  /**
+   * Format version the node was written with, NODEFORMATVERSION.
+   */
+	std::uint16_t version;
+
+  /**
+   * 1 if the node is a leaf, 0 otherwise.
+   */
+	std::uint8_t isLeaf;
+
+  /**
+   * Unused, keeps the following fields aligned.
+   */
+	std::uint8_t reserved;
+
+  /**
+   * Level of the node in the tree, counted from the leaves which are at level 0.
+   * Non-leaf nodes at level 1 have leaves as children.
+   */
+	std::int32_t level;
+
+  /**
+   * Number of keys stored in the node. Slots past it hold no data.
+   */
+	std::int32_t numKeys;
+
+  /**
+   * Page number of the node on the right side at the same level, Page::INVALID_NUMBER if there is none.
+	 * This linking of leaves allows to easily move from one leaf to the next leaf during index scan.
+   */
+	PageId rightSibPageNo;
+
+  /**
+   * Page number of the node on the left side at the same level, Page::INVALID_NUMBER if there is none.
+   * Descending scans follow it from one leaf to the one before.
+   */
+	PageId leftSibPageNo;
+
+  /**
+   * Smallest record id under the node of the entries whose key is equal to the separator on its left in the
+   * parent. The entries under the nodes on its left come before the pair, in the order of key and then record
+   * id which the duplicates of a key are kept in. Page 0 slot 0 if the node on the left holds no such key.
+   */
+	PackedRecordId lowRid;
+
+  /**
+   * Unused, keeps the keys following the header aligned for 8-byte types.
+   */
+	std::uint8_t padding[ 6 ];
+
+  /**
+   * Sets up the header of an empty node.
+   * @param nodeLevel	Level of the node, 0 for a leaf
+   */
+	void initialize( const int nodeLevel )
+	{
+		version = NODEFORMATVERSION;
+		isLeaf = ( nodeLevel == 0 );
+		reserved = 0;
+		level = nodeLevel;
+		numKeys = 0;
+		rightSibPageNo = Page::INVALID_NUMBER;
+		leftSibPageNo = Page::INVALID_NUMBER;
+		lowRid.pageLow = 0;
+		lowRid.pageHigh = 0;
+		lowRid.slot = 0;
+		memset( padding, 0, sizeof( padding ) );
+	}
+};
+
+/**
+ * @brief Number of leading bytes of a STRING attribute stored inline in the nodes as its key.
+ */
+const int STRINGKEYSIZE = 16;
+
+/**
+ * @brief Key of a STRING attribute as stored in the nodes: the first STRINGKEYSIZE bytes of the
+ * null terminated string, padded with zero bytes. Comparing these bytes with memcmp orders keys the
+ * same way as the strings they come from, except that strings sharing their first STRINGKEYSIZE bytes
+ * compare equal. Scan bounds and counts resolve such ties by comparing with the full string stored in
+ * the record, but the entries themselves are ordered by key prefix, then by record id: scans return the
+ * entries of strings sharing their prefix in record id order, not in the order of the full strings.
+ */
+struct StringKey{
+  /**
+   * Leading bytes of the string, zero padded.
+   */
+	unsigned char bytes[ STRINGKEYSIZE ];
+
+  /**
+   * Builds the key of a null terminated string, reading at most STRINGKEYSIZE bytes of it.
+   */
+	static StringKey fromString( const char* str )
+	{
+		StringKey key;
+		strncpy( (char*) key.bytes, str, STRINGKEYSIZE );
+		return key;
+	}
+
+  /**
+   * Returns whether the whole string fits into the key, in which case keys that compare equal
+   * come from equal strings.
+   */
+	bool isComplete() const
+	{
+		return bytes[ STRINGKEYSIZE - 1 ] == 0;
+	}
+};
+
+inline bool operator<( const StringKey& k1, const StringKey& k2 )
+{
+	return memcmp( k1.bytes, k2.bytes, STRINGKEYSIZE ) < 0;
+}
+
+inline bool operator==( const StringKey& k1, const StringKey& k2 )
+{
+	return memcmp( k1.bytes, k2.bytes, STRINGKEYSIZE ) == 0;
+}
+
+inline bool operator!=( const StringKey& k1, const StringKey& k2 )
+{
+	return !( k1 == k2 );
+}
+
+/**
+ * @brief Number of bytes of the key of a COMPOSITE index.
+ */
+const int COMPOSITEKEYSIZE = 32;
+
+/**
+ * @brief Maximum number of attributes of the key of a COMPOSITE index.
+ */
+const int MAXKEYATTRIBUTES = 4;
+
+/**
+ * @brief One attribute of the key of a COMPOSITE index.
+ */
+struct KeyAttribute{
+  /**
+   * Offset of the attribute inside the record.
+   */
+	int byteOffset;
+
+  /**
+   * Datatype of the attribute, INTEGER, DOUBLE or STRING.
+   */
+	Datatype type;
+
+  /**
+   * Number of bytes of a STRING attribute that are part of the key, ignored for other types. The attribute
+   * is compared as a string of that many bytes, padded with zero bytes.
+   */
+	int length;
+};
+
+/**
+ * @brief Key of a COMPOSITE index as stored in the nodes: the values of its attributes in order, each encoded
+ * so that comparing the bytes with memcmp orders keys the way their values compare, attribute after attribute.
+ * INTEGER and DOUBLE values are stored big endian with their sign flipped, STRING values as their leading
+ * KeyAttribute::length bytes. Bytes past the attributes are zero.
+ */
+struct CompositeKey{
+  /**
+   * Encoded attributes, zero padded.
+   */
+	unsigned char bytes[ COMPOSITEKEYSIZE ];
+};
+
+inline bool operator<( const CompositeKey& k1, const CompositeKey& k2 )
+{
+	return memcmp( k1.bytes, k2.bytes, COMPOSITEKEYSIZE ) < 0;
+}
+
+inline bool operator==( const CompositeKey& k1, const CompositeKey& k2 )
+{
+	return memcmp( k1.bytes, k2.bytes, COMPOSITEKEYSIZE ) == 0;
+}
+
+inline bool operator!=( const CompositeKey& k1, const CompositeKey& k2 )
+{
+	return !( k1 == k2 );
+}
+
+/**
+ * @brief Attributes of the key of a COMPOSITE index, which builds its keys from records and from values.
+ *
+ * Keys passed to a COMPOSITE index, to insert, delete, look up or bound a scan, are CompositeKey built by
+ * makeKey(). A key built from the leading attributes only is the lowest or the highest of all keys starting
+ * with them, so that a scan between the two covers the keys with the same leading attributes, and a scan
+ * bounded by keys that differ in their last attribute only covers a range of it.
+ */
+class CompositeKeyFormat
+{
+ private:
+	/**
+	 * Attributes of the key, in order.
+	 */
+	std::vector<KeyAttribute> attributes;
+
+	/**
+	 * Number of bytes the encoded attributes take.
+	 */
+	int size;
+
+	/**
+	 * Number of bytes an attribute takes in the key.
+	 */
+	static int encodedLength( const KeyAttribute& attribute );
+
+	/**
+	 * Encodes the value of an attribute into the key.
+	 * @param value		Pointer to integer / double / char string
+	 * @param out			Where the encoded value goes, encodedLength() bytes
+	 */
+	static void encode( const KeyAttribute& attribute, const void* value, unsigned char* out );
+
+ public:
+	/**
+	 * Format of a key made of no attributes, for indexes on a single attribute.
+	 */
+	CompositeKeyFormat() : size( 0 ) {}
+
+	/**
+	 * @param attributes	Attributes of the key, in order
+	 * @throws BadIndexInfoException If there are no attributes or more than MAXKEYATTRIBUTES, if one has
+	 * an unknown type or a bad length, or if they do not fit in COMPOSITEKEYSIZE bytes.
+	 */
+	explicit CompositeKeyFormat( const std::vector<KeyAttribute>& attributes );
+
+	/**
+	 * Returns the attributes of the key, in order.
+	 */
+	const std::vector<KeyAttribute>& getAttributes() const { return attributes; }
+
+	/**
+	 * Builds the key of a record.
+	 * @param record	Record of the relation
+	 */
+	CompositeKey keyOfRecord( const char* record ) const;
+
+	/**
+	 * Builds a key from the values of its leading attributes.
+	 * @param values			Pointers to integer / double / char string values of the first numValues attributes
+	 * @param numValues		Number of values, at most the number of attributes
+	 * @param highest			Whether the key is the highest rather than the lowest of the keys starting with the values
+	 */
+	CompositeKey makeKey( const void* const* values, const int numValues, const bool highest = false ) const;
+};
+
+/**
+ * @brief Reads a key of type T from the attribute of a record, or from a key passed to the index.
+ * @param bytes		Pointer to integer/double/char string
+ */
+template <class T>
+inline T keyFromBytes( const void* bytes )
+{
+	T key;
+	memcpy( &key, bytes, sizeof( T ) );
+	return key;
+}
+
+template <>
+inline StringKey keyFromBytes<StringKey>( const void* bytes )
+{
+	return StringKey::fromString( (const char*) bytes );
+}
+
+/**
+ * @brief Builds the key of type T of a record.
+ * @param record						Record of the relation
+ * @param attrByteOffset		Offset of the attribute the index is built on
+ * @param format						Attributes of the key of a COMPOSITE index
  */
-//                                                     level     extra pageNo                  key       pageNo
-const  int INTARRAYNONLEAFSIZE = ( Page::SIZE - sizeof( int ) - sizeof( PageId ) ) / ( sizeof( int ) + sizeof( PageId ) );
+template <class T>
+inline T keyFromRecord( const char* record, const int attrByteOffset, const CompositeKeyFormat& format )
+{
+	return keyFromBytes<T>( record + attrByteOffset );
+}
+
+template <>
+inline CompositeKey keyFromRecord<CompositeKey>( const char* record, const int attrByteOffset,
+		const CompositeKeyFormat& format )
+{
+	return format.keyOfRecord( record );
+}
 
 /**
  * @brief Structure to store a key-rid pair. It is used to pass the pair to functions that 
@@ -86,259 +461,1664 @@ public:
 	}
 };
 
-/**
- * @brief Overloaded operator to compare the key values of two rid-key pairs
- * and if they are the same compares to see if the first pair has
- * a smaller rid.pageNo value.
-*/
-template <class T>
-bool operator<( const RIDKeyPair<T>& r1, const RIDKeyPair<T>& r2 )
-{
-	if( r1.key != r2.key )
-		return r1.key < r2.key;
-	else
-		return r1.rid.page_number < r2.rid.page_number;
-}
+/**
+ * @brief Overloaded operator to compare the key values of two rid-key pairs
+ * and if they are the same compares to see if the first pair has
+ * a smaller rid.pageNo value, then a smaller rid.slot_number value.
+*/
+template <class T>
+bool operator<( const RIDKeyPair<T>& r1, const RIDKeyPair<T>& r2 )
+{
+	if( r1.key != r2.key )
+		return r1.key < r2.key;
+	else if( r1.rid.page_number != r2.rid.page_number )
+		return r1.rid.page_number < r2.rid.page_number;
+	else
+		return r1.rid.slot_number < r2.rid.slot_number;
+}
+
+/**
+ * @brief An attribute of the relation whose value a covering index stores in its leaves next to the record id
+ * of each entry, so that scans can return it without reading the record.
+*/
+struct IncludedColumn{
+  /**
+   * Offset of the attribute inside the record.
+   */
+	int byteOffset;
+
+  /**
+   * Length of the attribute in bytes.
+   */
+	int length;
+};
+
+/**
+ * @brief Maximum number of included columns of an index.
+ */
+const int MAXINCLUDEDCOLUMNS = 8;
+
+/**
+ * @brief Number of buckets of the histogram of the keys of an index.
+ */
+const int HISTOGRAMBUCKETS = 64;
+
+/**
+ * @brief Number of bits of the hash of a key that pick a register of the sketch of distinct keys.
+ */
+const int SKETCHBITS = 10;
+
+/**
+ * @brief Number of registers of the sketch of distinct keys.
+ */
+const int SKETCHREGISTERS = 1 << SKETCHBITS;
+
+/**
+ * @brief Statistics of the keys of an index, kept in its meta page, from which the number of entries in a
+ * range is estimated without reading the tree.
+ *
+ * The histogram is equi-depth: bulk loading splits the sorted entries into numBuckets buckets of as many entries
+ * each. Bucket b holds the keys from bounds[b] to bounds[b + 1], both included, each bound being the bytes of a key.
+ * Inserts and deletes keep the counts of the buckets up to date, the bounds only move to take in keys past either
+ * end. Distinct keys are counted by a HyperLogLog sketch, which deletes leave as it is.
+*/
+struct KeyStatistics{
+  /**
+   * Number of entries in the index.
+   */
+	std::uint64_t numEntries;
+
+  /**
+   * Number of buckets of the histogram in use, 0 until the index has an entry.
+   */
+	std::int32_t numBuckets;
+
+  /**
+   * Number of entries in each bucket.
+   */
+	std::uint64_t bucketCounts[ HISTOGRAMBUCKETS ];
+
+  /**
+   * Smallest key, then the largest key of each bucket.
+   */
+	unsigned char bounds[ HISTOGRAMBUCKETS + 1 ][ COMPOSITEKEYSIZE ];
+
+  /**
+   * Registers of the sketch, each the largest rank of the hashes of the keys that fall into it.
+   */
+	std::uint8_t sketch[ SKETCHREGISTERS ];
+};
+
+/**
+ * @brief Number of shards the threads count their changes to the statistics of the keys in.
+ */
+const int STATISTICSSHARDS = 16;
+
+/**
+ * @brief Changes to the statistics of the keys counted by the threads of a shard since they were last folded
+ * into KeyStatistics, so that threads inserting at the same time do not wait on each other to count their keys.
+ */
+struct StatisticsShard{
+  /**
+   * Guards the shard.
+   */
+	std::mutex mutex;
+
+  /**
+   * Number of entries added, less the ones removed.
+   */
+	std::int64_t numEntries;
+
+  /**
+   * Number of entries added to each bucket, less the ones removed.
+   */
+	std::int64_t bucketCounts[ HISTOGRAMBUCKETS ];
+
+  /**
+   * Registers of the sketch for the keys added.
+   */
+	std::uint8_t sketch[ SKETCHREGISTERS ];
+
+  /**
+   * Whether a key was added, low and high then holding the smallest and the largest one.
+   */
+	bool hasKeys;
+
+	unsigned char low[ COMPOSITEKEYSIZE ];
+
+	unsigned char high[ COMPOSITEKEYSIZE ];
+
+  /**
+   * Empties the shard.
+   */
+	void clear()
+	{
+		numEntries = 0;
+		memset( bucketCounts, 0, sizeof( bucketCounts ) );
+		memset( sketch, 0, sizeof( sketch ) );
+		hasKeys = false;
+	}
+};
+
+/**
+ * @brief The meta page, which holds metadata for Index file, is always first page of the btree index file and is cast
+ * to the following structure to store or retrieve information from it.
+ * Contains the relation name for which the index is created, the byte offset
+ * of the key value on which the index is made, the type of the key and the page no
+ * of the root page. Root page starts as page 2 but since a split can occur
+ * at the root the root page may get moved up and get a new page no.
+*/
+struct IndexMetaInfo{
+  /**
+   * Name of base relation.
+   */
+	char relationName[20];
+
+  /**
+   * Offset of attribute, over which index is built, inside the record stored in pages.
+   */
+	int attrByteOffset;
+
+  /**
+   * Type of the attribute over which index is built.
+   */
+	Datatype attrType;
+
+  /**
+   * Page number of root page of the B+ Tree inside the file index file.
+   */
+	PageId rootPageNo;
+
+  /**
+   * Whether the root of the tree is a leaf
+   */
+  bool rootIsLeaf;
+
+  /**
+   * Format version of the nodes of the index, NODEFORMATVERSION.
+   */
+	std::uint16_t formatVersion;
+
+  /**
+   * Page number of the first page of the list of free pages, Page::INVALID_NUMBER if it is empty.
+   */
+	PageId freeListHead;
+
+  /**
+   * Number of included columns stored in the leaves.
+   */
+	int numIncluded;
+
+  /**
+   * Included columns stored in the leaves, in the order their values are stored.
+   */
+	IncludedColumn included[MAXINCLUDEDCOLUMNS];
+
+  /**
+   * Number of attributes of the key of a COMPOSITE index, 0 for other indexes.
+   */
+	int numKeyAttributes;
+
+  /**
+   * Attributes of the key of a COMPOSITE index, in order.
+   */
+	KeyAttribute keyAttributes[MAXKEYATTRIBUTES];
+
+  /**
+   * Statistics of the keys, as of the last time the meta page was written.
+   */
+	KeyStatistics statistics;
+
+  /**
+   * Whether the non-leaf nodes keep the number of entries under each of their children.
+   */
+	bool counted;
+
+  /**
+   * Capacity of the nodes the index was built with. The counts of the children follow that many page numbers,
+   * so the index is opened with it whatever capacity is asked for.
+   */
+	int nodeOccupancy;
+
+  /**
+   * Capacity of the leaves the index was built with. The values of the included columns follow that many
+   * record ids, so the index is opened with it whatever capacity is asked for.
+   */
+	int leafOccupancy;
+};
+
+static_assert( sizeof( IndexMetaInfo ) <= Page::SIZE, "Meta page must fit in a page." );
+
+/**
+ * @brief Structure of a page of the index file that held a node freed by a merge. Free pages are
+ * chained from IndexMetaInfo::freeListHead and handed out again before the file is grown.
+ */
+struct FreePageInfo{
+  /**
+   * Page number of the next free page, Page::INVALID_NUMBER if this is the last one.
+   */
+	PageId nextFreePageNo;
+};
+
+/*
+Each node is a page, so once we read the page in we just cast the pointer to the page to this struct and use it to access the parts
+These structures basically are the format in which the information is stored in the pages for the index file depending on what kind of 
+node they are. Both start with a NodeHeader telling what kind of node the page holds and how many keys are in use.
+The layouts are templated on the key type, so the number of key slots is fixed at compile time for each type.
+*/
+
+/**
+ * @brief Structure for all non-leaf nodes with keys of type T.
+*/
+template <class T>
+struct NonLeafNode{
+  /**
+   * Number of key slots in the node.
+   */
+	//                                                          header         extra pageNo            key         pageNo
+	static constexpr int CAPACITY = ( Page::SIZE - sizeof( NodeHeader ) - sizeof( PageId ) ) / ( sizeof( T ) + sizeof( PageId ) );
+
+  /**
+   * Header of the node. header.numKeys keys are in use, with one more child page number.
+   */
+	NodeHeader header;
+
+  /**
+   * Stores separator keys. A separator is not smaller than any key under the child on its left, and not
+   * greater than any key under the child on its right.
+   */
+	T keyArray[ CAPACITY ];
+
+  /**
+   * Stores page numbers of child pages which themselves are other non-leaf/leaf nodes in the tree.
+   */
+	PageId pageNoArray[ CAPACITY + 1 ];
+};
+
+
+/**
+ * @brief Structure for all leaf nodes with keys of type T.
+ * Every leaf uses this fixed layout, keys and record ids are stored whole without any compressed encoding.
+*/
+template <class T>
+struct LeafNode{
+  /**
+   * Number of key slots in the leaf.
+   */
+	//                                                   header                key            rid
+	static constexpr int CAPACITY = ( Page::SIZE - sizeof( NodeHeader ) ) / ( sizeof( T ) + sizeof( PackedRecordId ) );
+
+  /**
+   * Header of the node. header.numKeys <key, rid> pairs are in use, header.rightSibPageNo links to the next leaf.
+   * In a covering index, the values of the included columns of the entries follow the first leafOccupancy
+   * record ids, and leafOccupancy is lowered to leave room for them.
+   */
+	NodeHeader header;
+
+  /**
+   * Stores keys.
+   */
+	T keyArray[ CAPACITY ];
+
+  /**
+   * Stores RecordIds.
+   */
+	PackedRecordId ridArray[ CAPACITY ];
+};
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is of INTEGER type.
+*/
+typedef NonLeafNode<int> NonLeafNodeInt;
+
+/**
+ * @brief Structure for all leaf nodes when the key is of INTEGER type.
+*/
+typedef LeafNode<int> LeafNodeInt;
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is of DOUBLE type.
+*/
+typedef NonLeafNode<double> NonLeafNodeDouble;
+
+/**
+ * @brief Structure for all leaf nodes when the key is of DOUBLE type.
+*/
+typedef LeafNode<double> LeafNodeDouble;
+
+/**
+ * @brief Structure for all non-leaf nodes when the key is of STRING type.
+*/
+typedef NonLeafNode<StringKey> NonLeafNodeString;
+
+/**
+ * @brief Structure for all leaf nodes when the key is of STRING type.
+*/
+typedef LeafNode<StringKey> LeafNodeString;
+
+/**
+ * @brief Structure for all non-leaf nodes of a COMPOSITE index.
+*/
+typedef NonLeafNode<CompositeKey> NonLeafNodeComposite;
+
+/**
+ * @brief Structure for all leaf nodes of a COMPOSITE index.
+*/
+typedef LeafNode<CompositeKey> LeafNodeComposite;
+
+/**
+ * @brief Number of key slots in B+Tree leaf for INTEGER key.
+ */
+const int INTARRAYLEAFSIZE = LeafNodeInt::CAPACITY;
+
+/**
+ * @brief Number of key slots in B+Tree non-leaf for INTEGER key.
+ */
+const int INTARRAYNONLEAFSIZE = NonLeafNodeInt::CAPACITY;
+
+/**
+ * @brief Number of key slots in B+Tree leaf for DOUBLE key.
+ */
+const int DOUBLEARRAYLEAFSIZE = LeafNodeDouble::CAPACITY;
+
+/**
+ * @brief Number of key slots in B+Tree non-leaf for DOUBLE key.
+ */
+const int DOUBLEARRAYNONLEAFSIZE = NonLeafNodeDouble::CAPACITY;
+
+/**
+ * @brief Number of key slots in B+Tree leaf for STRING key.
+ */
+const int STRINGARRAYLEAFSIZE = LeafNodeString::CAPACITY;
+
+/**
+ * @brief Number of key slots in B+Tree non-leaf for STRING key.
+ */
+const int STRINGARRAYNONLEAFSIZE = NonLeafNodeString::CAPACITY;
+
+static_assert( sizeof( NonLeafNodeInt ) <= Page::SIZE, "Non-leaf node must fit in a page." );
+static_assert( sizeof( LeafNodeInt ) <= Page::SIZE, "Leaf node must fit in a page." );
+static_assert( sizeof( NonLeafNodeDouble ) <= Page::SIZE, "Non-leaf node must fit in a page." );
+static_assert( sizeof( LeafNodeDouble ) <= Page::SIZE, "Leaf node must fit in a page." );
+static_assert( sizeof( NonLeafNodeString ) <= Page::SIZE, "Non-leaf node must fit in a page." );
+static_assert( sizeof( LeafNodeString ) <= Page::SIZE, "Leaf node must fit in a page." );
+static_assert( sizeof( NonLeafNodeComposite ) <= Page::SIZE, "Non-leaf node must fit in a page." );
+static_assert( sizeof( LeafNodeComposite ) <= Page::SIZE, "Leaf node must fit in a page." );
+
+/**
+ * @brief Page of the posting list of a key with many duplicates. A leaf stores such a key once, with the
+ * record id of the entry replaced by PackedRecordId::postingList() of the first page of the list, and the
+ * list holds the record ids of the entries in order of page and slot, over as many pages as they need.
+ * Posting pages are changed and read under the latch of the leaf that refers to them.
+*/
+struct PostingPage{
+  /**
+   * Number of record ids in a page.
+   */
+	static constexpr int CAPACITY = ( Page::SIZE - sizeof( NodeHeader ) - sizeof( PageId ) - sizeof( std::uint64_t ) ) / sizeof( PackedRecordId );
+
+  /**
+   * Header of the page, at level -1. header.numKeys record ids are in use, header.rightSibPageNo and
+   * header.leftSibPageNo link to the next and previous pages of the list.
+   */
+	NodeHeader header;
+
+  /**
+   * Number of record ids in the whole list. Only kept in the first page.
+   */
+	std::uint64_t totalRids;
+
+  /**
+   * Last page of the list. Only kept in the first page.
+   */
+	PageId lastPageNo;
+
+  /**
+   * Stores RecordIds, in order.
+   */
+	PackedRecordId ridArray[ CAPACITY ];
+};
+
+static_assert( sizeof( PostingPage ) <= Page::SIZE, "Posting page must fit in a page." );
+
+
+class BTreeIndex;
+
+/**
+ * @brief Position and range of one scan over a BTreeIndex. A cursor keeps the leaf it is on pinned
+ * until it moves past it or the scan ends, so any number of cursors can scan the same index at
+ * once, each at its own pace. Cursors are returned by BTreeIndex::openScan() and can be moved but not
+ * copied. They must be ended or destroyed before the index is.
+ *
+ * The leaf is only latched during a call. If it changed by the next call, the cursor finds its place
+ * again from the root, after the last entry it returned. A cursor is used by one thread at a time.
+ */
+class ScanCursor {
+
+  friend class BTreeIndex;
+
+ private:
+
+  /**
+   * Index being scanned.
+   */
+	BTreeIndex	*index;
+
+  /**
+   * True if the scan has been started and not ended yet.
+   */
+	bool		scanExecuting;
+
+  /**
+   * Index of next entry to be scanned in current leaf being scanned.
+   */
+	int			nextEntry;
+
+  /**
+   * Page number of current page being scanned.
+   */
+	PageId	currentPageNum;
+
+  /**
+   * Current Page being scanned.
+   */
+	Page		*currentPageData;
+
+  /**
+   * Low INTEGER value for scan.
+   */
+	int			lowValInt;
+
+  /**
+   * Low DOUBLE value for scan.
+   */
+	double	lowValDouble;
+
+  /**
+   * Low STRING value for scan.
+   */
+	std::string	lowValString;
+
+  /**
+   * High INTEGER value for scan.
+   */
+	int			highValInt;
+
+  /**
+   * High DOUBLE value for scan.
+   */
+	double	highValDouble;
+
+  /**
+   * High STRING value for scan.
+   */
+	std::string highValString;
+
+  /**
+   * Key of the low STRING value for scan.
+   */
+	StringKey	lowValStringKey;
+
+  /**
+   * Key of the high STRING value for scan.
+   */
+	StringKey	highValStringKey;
+
+  /**
+   * Low and high keys of the scan of a COMPOSITE index.
+   */
+	CompositeKey	lowValCompositeKey;
+	CompositeKey	highValCompositeKey;
+	
+  /**
+   * Page of the posting list of the current entry the next record id is in, and its index in the page.
+   * Page::INVALID_NUMBER unless the scan is partway through a posting list.
+   */
+	PageId	postingPageNum;
+	int			postingEntry;
+
+  /**
+   * Version of the latch of the current leaf when the cursor last left it.
+   */
+	std::uint64_t	leafVersion;
+
+  /**
+   * BTreeIndex::structureVersion when the cursor last left its leaf.
+   */
+	std::uint64_t	structureVersion;
+
+  /**
+   * True once the scan has returned an entry, which lastKey and lastRid then describe.
+   */
+	bool		returnedAny;
+
+  /**
+   * Key of the last entry returned, for keys of each type.
+   */
+	int			lastKeyInt;
+	double	lastKeyDouble;
+	StringKey	lastKeyStringKey;
+	CompositeKey	lastKeyCompositeKey;
+
+  /**
+   * Record id of the last entry returned.
+   */
+	RecordId	lastRid;
+
+  /**
+   * Number of leaves to keep prefetched ahead of the current one. Grows as the scan moves from leaf to leaf,
+   * 0 if the cursor does not read ahead.
+   */
+	int			readaheadWindow;
+
+  /**
+   * Parent of the last leaf prefetched, Page::INVALID_NUMBER if there are no more leaves to prefetch.
+   */
+	PageId	readaheadParentNum;
+
+  /**
+   * Index of the last leaf prefetched among the children of readaheadParentNum.
+   */
+	int			readaheadChild;
+
+  /**
+   * Number of leaves prefetched that the scan has not reached yet.
+   */
+	int			leavesAhead;
+
+  /**
+   * Low Operator. Can only be GT(>) or GTE(>=).
+   */
+	Operator	lowOp;
+
+  /**
+   * High Operator. Can only be LT(<) or LTE(<=).
+   */
+	Operator	highOp;
+
+  /**
+   * True if the scan goes from the high bound down. nextEntry and postingEntry then move backwards, and the
+   * cursor moves to the left siblings of its leaves.
+   */
+	bool		descending;
+
+  /**
+   * Low value of the scan for keys of type T, one of lowValInt, lowValDouble, lowValStringKey or lowValCompositeKey.
+   */
+  template <class T>
+  T& scanLowVal();
+
+  /**
+   * High value of the scan for keys of type T, one of highValInt, highValDouble, highValStringKey or highValCompositeKey.
+   */
+  template <class T>
+  T& scanHighVal();
+
+  /**
+   * Key of the last entry returned for keys of type T, one of lastKeyInt, lastKeyDouble, lastKeyStringKey or lastKeyCompositeKey.
+   */
+  template <class T>
+  T& scanLastKey();
+
+  /**
+   * Unpins the current leaf and marks the scan as ended.
+   */
+	void release();
+
+ public:
+
+  /**
+   * Creates a cursor that is not scanning anything.
+   */
+	ScanCursor();
+
+  /**
+   * Takes over the scan of another cursor, which is left not scanning anything.
+   */
+	ScanCursor(ScanCursor&& other);
+
+  /**
+   * Ends the scan of this cursor, if any, and takes over the scan of another one.
+   */
+	ScanCursor& operator=(ScanCursor&& other);
+
+	ScanCursor(const ScanCursor&) = delete;
+	ScanCursor& operator=(const ScanCursor&) = delete;
+
+  /**
+   * Ends the scan, if any, unpinning its current leaf. Does not throw.
+   */
+	~ScanCursor();
+
+  /**
+	 * Fetch the record id of the next index entry that matches the scan.
+   * @param outRid	RecordId of next record found that satisfies the scan criteria returned in this
+   * @param included	If not NULL, the values of the included columns of the entry are copied here,
+   * BTreeIndex::getIncludedSize() bytes
+	 * @throws ScanNotInitializedException If the cursor is not scanning.
+	 * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
+	**/
+	void scanNext(RecordId& outRid, void* included = NULL);
+
+  /**
+	 * Fetch the record id of the next index entry that matches the scan, without throwing once the scan is completed.
+   * @param outRid	RecordId of next record found that satisfies the scan criteria returned in this
+   * @param included	If not NULL, the values of the included columns of the entry are copied here,
+   * BTreeIndex::getIncludedSize() bytes
+   * @return False if no more records, satisfying the scan criteria, are left to be scanned. The cursor keeps
+   * scanning until endScan().
+	 * @throws ScanNotInitializedException If the cursor is not scanning.
+	**/
+	bool tryScanNext(RecordId& outRid, void* included = NULL);
+
+  /**
+	 * Fetch the record ids of the next index entries that match the scan, in order.
+	 * The end of the range within the current leaf is searched for once, and the record ids up to it are copied
+	 * over as a whole, so a scan costs a few calls per leaf rather than one per entry.
+   * @param outRids	Array the record ids are returned in
+   * @param maxRids	Number of record ids the array can hold
+   * @param included	If not NULL, the values of the included columns of the entries are copied here one entry
+   * after the other, BTreeIndex::getIncludedSize() bytes each
+   * @return Number of record ids returned, less than maxRids only once the scan is completed, 0 if no more
+   * records, satisfying the scan criteria, are left to be scanned.
+	 * @throws ScanNotInitializedException If the cursor is not scanning.
+	**/
+	std::size_t scanNextBatch(RecordId* outRids, std::size_t maxRids, void* included = NULL);
+
+  /**
+	 * Terminate the scan. Unpin the current leaf.
+	 * @throws ScanNotInitializedException If the cursor is not scanning.
+	**/
+	void endScan();
+
+  /**
+   * Returns whether the cursor is scanning.
+   */
+	bool isExecuting() const { return scanExecuting; }
+};
+
+
+/**
+ * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute of a
+ * relation. Scans are driven by ScanCursor objects returned by openScan(), any number of which may be
+ * open at once. startScan(), scanNext() and endScan() drive a single scan kept by the index.
+ *
+ * insertEntry(), lookup(), lookupMany() and the scans of cursors may be called from several threads at
+ * once. Every node has a reader/writer latch. Descents to a leaf read the nodes above it without latching
+ * them, checking the version of each latch once the node is read and starting over if a writer changed
+ * the node in the meantime. After a few such restarts they latch their way down from the root instead,
+ * letting go of a node once they hold its child. Readers latch the leaf for reading and move along the
+ * leaves latching each one before letting go of the previous one. Descending scans go the other way and let
+ * go of a leaf before latching the one on its left, so that siblings are only ever waited for from left
+ * to right. Inserts latch only the leaf for writing,
+ * and start over latching the whole path for writing if the leaf has to be split. They let go of the nodes above any node that has room
+ * for one more key, since no split can reach those. A split latches the right sibling of the node it splits
+ * to point it back to the new node. deleteEntry() and insertBatch() have the index to
+ * themselves while they run. The scan kept by the index, and the index itself, are used by one thread.
+ *
+ * A key with many duplicates is stored once, with a posting list of the record ids of its entries kept in
+ * pages of their own (see PostingPage). The entries of a key move to a posting list when bulk loading
+ * finds at least postingRunLength of them, or when that many fill part of a leaf that would otherwise split.
+ * Covering indexes keep no posting lists, the values of the included columns being stored per entry.
+ *
+ * A counted index keeps in every non-leaf node the number of entries under each child, counting every record
+ * id of the posting lists. Its inserts have the index to themselves like insertBatch(), so that the counts on
+ * the path of a change are updated with it, and its readers need no latch on the nodes they count through.
+*/
+class BTreeIndex {
+
+  friend class ScanCursor;
+
+ private:
+
+  /**
+   * File object for the index file.
+   */
+	File		*file;
+
+  /**
+   * Buffer Manager Instance.
+   */
+	BufMgr	*bufMgr;
+
+  /**
+   * Page number of meta page.
+   */
+	PageId	headerPageNum;
+
+  /**
+   * page number of root page of B+ tree inside index file.
+   */
+	PageId	rootPageNum;
+
+  /**
+   * Name of the base relation.
+   */
+	std::string	relationName;
+
+  /**
+   * The base relation, opened the first time a STRING key has to be compared with the full
+   * string in a record. NULL until then.
+   */
+	File		*relationFile;
+
+  /**
+   * Datatype of attribute over which index is built.
+   */
+	Datatype	attributeType;
+
+  /**
+   * Offset of attribute, over which index is built, inside records. 
+   */
+	int 		attrByteOffset;
+
+  /**
+   * Attributes of the key of a COMPOSITE index, none for other indexes.
+   */
+	CompositeKeyFormat	keyFormat;
+
+  /**
+   * Columns whose values are stored in the leaves next to the record ids, empty unless the index is covering.
+   */
+	std::vector<IncludedColumn>	includedColumns;
+
+  /**
+   * Number of bytes the values of the included columns take in each entry.
+   */
+	int			includedSize;
+
+  /**
+   * Number of keys in leaf node, depending upon the type of key.
+   */
+	int			leafOccupancy;
+
+  /**
+   * Number of keys in non-leaf node, depending upon the type of key.
+   */
+	int			nodeOccupancy;
+
+  /**
+   * Number of entries with the same key a leaf holds before they are moved to a posting list,
+   * 0 if the index keeps no posting lists.
+   */
+	int			postingRunLength;
+
+  /**
+   * Whether the non-leaf nodes keep the number of entries under each of their children, see childCount().
+   */
+	bool		counted;
+
+
+  /**
+   * Scan driven by startScan(), scanNext() and endScan().
+   */
+	ScanCursor	scan;
+
+  /**
+   * Whether or not the roof is a leaf
+   */
+  bool rootIsLeaf;
+
+  /**
+   * Page number of the first free page of the index file, Page::INVALID_NUMBER if there is none.
+   */
+	PageId	freeListHead;
+
+  /**
+   * Page numbers of the leftmost and rightmost leaves, remembered by the last insert that reached them
+   * so that keys beyond either end of the tree can go straight to their leaf. Page::INVALID_NUMBER when
+   * not known.
+   */
+	std::atomic<PageId>	leftmostLeafPageNo;
+	std::atomic<PageId>	rightmostLeafPageNo;
+
+  /**
+   * Latches of the nodes, by page number.
+   */
+	LatchTable	latches;
+
+  /**
+   * Guards rootPageNum and rootIsLeaf, latched before the root node like the parent of the root.
+   */
+	NodeLatch	rootLatch;
+
+  /**
+   * Held in shared mode by every operation on the index, and in exclusive mode by the ones that
+   * restructure the tree without latching nodes, deleteEntry() and insertBatch().
+   */
+	NodeLatch	structureLatch;
+
+  /**
+   * Number of times the tree was restructured with structureLatch held in exclusive mode. Cursors
+   * check it to find out whether the leaf they were on may have been merged away.
+   */
+	std::atomic<std::uint64_t>	structureVersion;
+
+  /**
+   * Guards freeListHead, and the meta page while it is written.
+   */
+	std::mutex	metaMutex;
+
+  /**
+   * Statistics of the keys, written to the meta page with the rest of it once the shards are folded into it.
+   */
+	KeyStatistics	statistics;
+
+  /**
+   * Number of buckets of statistics, set once the bounds between the buckets are. Those bounds stay as they
+   * are from then on, so that the buckets of new keys are found without statsMutex.
+   */
+	std::atomic<int>	histogramBuckets;
+
+  /**
+   * Changes to statistics not folded into it yet. Each thread counts its changes in one of them.
+   */
+	StatisticsShard	statisticsShards[ STATISTICSSHARDS ];
+
+  /**
+   * Guards statistics. Taken after metaMutex and before the mutex of a shard when they are held together.
+   */
+	std::mutex	statsMutex;
+
+  /**
+   * Guards opening relationFile.
+   */
+	std::mutex	relationFileMutex;
+
+  /**
+   * Outcome of deleting an entry from a subtree.
+   */
+	enum DeleteResult {
+		ENTRY_NOT_FOUND,	/* No entry with the key and record id in the subtree */
+		ENTRY_DELETED,		/* Entry deleted, the root of the subtree still holds enough keys */
+		NODE_UNDERFULL		/* Entry deleted, the root of the subtree has to be rebalanced by its parent */
+	};
+
+  /**
+   * Implementations of the operations of the index for one key type.
+   */
+	struct KeyTypeOps {
+		void (BTreeIndex::*build)( const std::string& relationName, const std::string& runPrefix );
+		void (BTreeIndex::*insertEntry)( const void* key, const RecordId rid );
+		void (BTreeIndex::*insertBatch)( const void* const* keys, const RecordId* rids, std::size_t numEntries );
+		void (BTreeIndex::*deleteEntry)( const void* key, const RecordId rid );
+		bool (BTreeIndex::*startScan)( ScanCursor& cursor, const void* lowVal, const void* highVal, std::size_t offset );
+		bool (BTreeIndex::*scanNext)( ScanCursor& cursor, RecordId& outRid, void* included );
+		std::size_t (BTreeIndex::*scanNextBatch)( ScanCursor& cursor, RecordId* outRids, std::size_t maxRids, void* included );
+		void (BTreeIndex::*lookupMany)( const void* const* keys, std::size_t numKeys, std::vector<RecordId>& outRids, std::vector<std::size_t>& counts );
+		double (BTreeIndex::*estimateRange)( const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp );
+		std::size_t (BTreeIndex::*countRange)( const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp );
+		std::size_t (BTreeIndex::*countBelow)( const void* key );
+		bool (BTreeIndex::*select)( std::size_t position, RecordId& outRid );
+		void (BTreeIndex::*foldStatistics)();
+	};
+
+  /**
+   * Operations for the type of the key attribute, chosen once by the constructor so that
+   * nothing has to look at the type again while traversing nodes.
+   */
+	const KeyTypeOps* keyOps;
+
+  /**
+   * Constructor all others delegate to, see the public ones.
+   * @param keyFormat		Attributes of the key of a COMPOSITE index, none for other indexes
+   * @param counted			Whether the non-leaf nodes keep the number of entries under each child
+   */
+	BTreeIndex(const std::string & relationName, std::string & outIndexName,
+						BufMgr *bufMgrIn,	const int attrByteOffset,	const Datatype attrType, const int nodeOccupancy, const int leafOccupancy,
+						const std::vector<IncludedColumn>& includedColumns, const CompositeKeyFormat& keyFormat, const bool counted);
+
+  /**
+   * Returns the operations specialized for keys of type T.
+   */
+  template <class T>
+  static const KeyTypeOps* keyTypeOps();
+
+  /**
+   * Binds the operations for keys of type T and limits the occupancies to what its nodes can hold,
+   * along with the values of the included columns in the leaves and the counts of the children in the nodes.
+   * @param nodeOccupancy       Requested capacity of the nodes of the tree
+   * @param leafOccupancy       Requested capacity of the leaves of the tree
+   */
+  template <class T>
+  void bindKeyType(const int nodeOccupancy, const int leafOccupancy);
+
+  /**
+   * Binds the operations for the type of the key of the index, see bindKeyType<T>().
+   * @param indexName           Name of the index file, for the exception thrown for an unknown type
+   * @param nodeOccupancy       Requested capacity of the nodes of the tree
+   * @param leafOccupancy       Requested capacity of the leaves of the tree
+   */
+  void bindKeyType(const std::string& indexName, const int nodeOccupancy, const int leafOccupancy);
+
+  /**
+   * Stores the range of a scan for keys of type T.
+   * @param cursor	Cursor of the scan
+   * @param lowVal	Low value of range, pointer to integer / double / char string
+   * @param highVal	High value of range, pointer to integer / double / char string
+   * @throws  BadScanrangeException If lowVal > highval
+   */
+  template <class T>
+  static void setScanBounds(ScanCursor& cursor, const void* lowVal, const void* highVal);
+
+  /**
+   * Collects entries for every tuple in the base relation, sorts them and bulk loads the new index.
+   * @param relationName        Name of the base relation
+   * @param runPrefix           Prefix of names of the temporary run files of the sort
+   */
+  template <class T>
+  void build(const std::string& relationName, const std::string& runPrefix);
+
+  /**
+   * insertEntry() for keys of type T.
+   */
+  template <class T>
+  void insertEntryTyped(const void* key, const RecordId rid);
+
+  /**
+   * deleteEntry() for keys of type T.
+   */
+  template <class T>
+  void deleteEntryTyped(const void* key, const RecordId rid);
+
+  /**
+   * Deletes an entry from the subtree of the node with the given page number, rebalancing
+   * the child it was deleted from if that child is left underfull.
+   * @param pageNum page number of the node
+   * @param key			Key of the entry
+   * @param rid			Record ID of the entry
+   */
+  template <class T>
+  DeleteResult deleteNode(PageId pageNum, const T& key, const RecordId rid);
+
+  /**
+   * Deletes an entry from the leaf with the given page number.
+   * @param pageNum page number of the leaf
+   * @param key			Key of the entry
+   * @param rid			Record ID of the entry
+   */
+  template <class T>
+  DeleteResult deleteLeaf(PageId pageNum, const T& key, const RecordId rid);
+
+  /**
+   * Rebalances an underfull child of a node with one of its siblings, by moving entries over
+   * from the sibling or by merging the two if they fit in a single node.
+   * @param parent	Node whose child is underfull
+   * @param index		Index of the child in parent->pageNoArray
+   */
+  template <class T>
+  void rebalanceChild(NonLeafNode<T>* parent, int index);
+
+  /**
+   * Evens out the entries of two adjacent leaves, or moves them all into the left one if they fit.
+   * @param separator	Separator of the leaves in their parent, updated if entries moved
+   * @return True if the leaves were merged and the right one is left empty
+   */
+  template <class T>
+  bool rebalanceLeaves(LeafNode<T>* left, LeafNode<T>* right, T& separator);
+
+  /**
+   * Evens out the keys of two adjacent non-leaf nodes through their separator, or merges them into
+   * the left one if they fit. The counts of the children move with them.
+   * @param separator	Separator of the nodes in their parent, updated if keys moved
+   * @return True if the nodes were merged and the right one is left empty
+   */
+  template <class T>
+  bool rebalanceNodes(NonLeafNode<T>* left, NonLeafNode<T>* right, T& separator);
+
+  /**
+   * Allocates a page for a new node, reusing a free page if there is one.
+   * @param pageNum	Page number of the new node is returned in this
+   * @param page		Pinned page of the new node is returned in this
+   */
+  void allocNode(PageId& pageNum, Page*& page);
+
+  /**
+   * Puts the page of a node that is not used anymore on the list of free pages, and unpins it.
+   * @param pageNum	Page number of the node
+   * @param page		Pinned page of the node
+   */
+  void freeNode(PageId pageNum, Page* page);
+
+  /**
+   * Points a node or a page of a posting list back to the page on its left, latching it for writing while
+   * its header changes.
+   * @param pageNum	Page number of the page, nothing is done if Page::INVALID_NUMBER
+   * @param leftNum	Page number of the page on its left
+   */
+  void setLeftSibling(PageId pageNum, PageId leftNum);
+
+  /**
+   * Writes the root, the head of the list of free pages and the statistics of the keys to the meta page,
+   * holding metaMutex.
+   */
+  void updateMetaPage();
+
+  /**
+   * Returns the low record id of a node, see NodeHeader::lowRid.
+   * @param pageNum	Page number of the node
+   */
+  PackedRecordId lowRidOf(PageId pageNum);
+
+  /**
+   * Returns the low record id of a leaf given its first entry, see NodeHeader::lowRid.
+   * @param leftKey	Last key of the leaf on its left
+   * @param key			First key of the leaf
+   * @param rid			Record id of the first entry of the leaf, which may refer to a posting list
+   */
+  template <class T>
+  PackedRecordId leafLowRid(const T& leftKey, const T& key, const PackedRecordId& rid);
+
+  /**
+   * Returns the index of the child of a non-leaf node whose entries an entry falls among, in the order of key
+   * and then record id, reading the low record ids of the children after the separators equal to the key.
+   * @param numKeys	Number of keys of the node
+   * @param latch		Latch of the node if it is read without holding it, NULL otherwise
+   * @param version	Version of the latch the node was read at
+   * @return -1 if the node changed since the version, before a child it names is read
+   */
+  template <class T>
+  int childForEntry(NonLeafNode<T>* node, const int numKeys, const T& key, const RecordId& rid, NodeLatch* latch,
+                    const std::uint64_t version);
+
+  /**
+   * Returns the index of an entry referring to the posting list of a key in a leaf, or -1 if the key has none there.
+   * @param index		Index of the first entry of the leaf >= key
+   */
+  template <class T>
+  int findPostingList(LeafNode<T>* leaf, int index, const T& key);
+
+  /**
+   * Moves the duplicates of every key with at least postingRunLength entries in a sorted array of entries to a
+   * posting list, or to the posting list the key already has among them, compacting the array. The lists of a
+   * key are joined into one.
+   * @param keys		Keys of the entries
+   * @param rids		Record ids of the entries
+   * @param count		Number of entries
+   * @param newLists	False to only move entries to the lists already there
+   * @return Number of entries left
+   */
+  template <class T>
+  int packDuplicates(T* keys, PackedRecordId* rids, int count, const bool newLists = true);
+
+  /**
+   * Appends record ids, in order and past the ones already there, to the end of a posting list.
+   * @param headNum	First page of the list, set to a new list if it is Page::INVALID_NUMBER
+   * @param rids		Record ids to append
+   */
+  void appendToPostingList(PageId& headNum, const std::vector<RecordId>& rids);
+
+  /**
+   * Adds a record id to a posting list, in its place. A full page is split in two.
+   * @param headNum	First page of the list
+   * @param rid			Record ID to add
+   */
+  void addToPostingList(PageId headNum, const RecordId& rid);
+
+  /**
+   * Removes a record id from a posting list, freeing the pages left empty.
+   * @param headNum	First page of the list
+   * @param rid			Record ID to remove
+   * @param emptied	Set to true if the list is left empty and all its pages are freed
+   * @return False if the record id is not in the list
+   */
+  bool removeFromPostingList(PageId headNum, const RecordId& rid, bool& emptied);
+
+  /**
+   * Appends the record ids of a posting list to a vector.
+   * @param headNum	First page of the list
+   */
+  void readPostingList(PageId headNum, std::vector<RecordId>& outRids);
+
+  /**
+   * Frees all the pages of a posting list.
+   * @param headNum	First page of the list
+   */
+  void freePostingList(PageId headNum);
+
+  /**
+   * Returns the number of record ids in a posting list.
+   * @param headNum	First page of the list
+   */
+  std::uint64_t postingListSize(PageId headNum);
+
+  /**
+   * Returns the record id at an index of a posting list.
+   * @param headNum	First page of the list
+   * @param index		Index of the record id, smaller than the size of the list
+   */
+  RecordId postingListEntry(PageId headNum, std::uint64_t index);
+
+  /**
+   * Copies the next record ids of the posting list of the current entry of a cursor, from the last one back
+   * if the scan is descending. The cursor moves on to the next entry once the list is used up.
+   * @param headNum	First page of the list
+   * @param outRids	Array the record ids are returned in
+   * @param maxRids	Number of record ids the array can hold
+   * @return Number of record ids returned
+   */
+  std::size_t nextPostingRids(ScanCursor& cursor, PageId headNum, RecordId* outRids, std::size_t maxRids);
+
+  /**
+   * Moves a cursor to the first record id of the posting list of its current entry past a record id, in the
+   * direction of its scan, whether or not that record id is in the list.
+   * @param headNum	First page of the list
+   * @param rid			Record ID to move past
+   * @return False, leaving the cursor as it is, if no record id of the list is past it
+   */
+  bool seekPostingList(ScanCursor& cursor, PageId headNum, const RecordId& rid);
+
+  /**
+   * Inserts a new entry in subtree of the node with the given page number
+   * If the node is being split, return the key that will be pushed up and the page number of the new node.
+   * Otherwise, returns a pair whose page number is Page::INVALID_NUMBER
+   * @param pageNum page number of the node
+   * @param key			Key to insert, pointer to integer/double/char string
+   * @param rid			Record ID of a record whose entry is getting inserted into the index.
+   * @param included	Values of the included columns of the record, NULL if the index has none
+   * @param leftmost	Whether the node is the leftmost one of its level
+   * @param rightmost	Whether the node is the rightmost one of its level
+   */
+  template <class T>
+  PageKeyPair<T> insertNode(PageId pageNum, const void *key, const RecordId rid, const char* included,
+		bool leftmost, bool rightmost);
+
+  /**
+   * Inserts a new entry in leaf with the given page number
+   * If the leaf is being split, return the key that will be copied up and the page number of the new leaf.
+   * Otherwise, returns a pair whose page number is Page::INVALID_NUMBER
+   * An entry added past the end of the rightmost leaf, or before the start of the leftmost one, is the
+   * sign of keys inserted in ascending or descending order. A full leaf is then split leaving the old
+   * entries together in one full leaf, instead of two half empty ones that would never fill up.
+   * @param pageNum page number of the leaf
+   * @param key			Key to insert, pointer to integer/double/char string
+   * @param rid			Record ID of a record whose entry is getting inserted into the index.
+   * @param included	Values of the included columns of the record, NULL if the index has none
+   * @param leftmost	Whether the leaf is the leftmost one
+   * @param rightmost	Whether the leaf is the rightmost one
+   */
+  template <class T>
+  PageKeyPair<T> insertLeaf(PageId pageNum, const void *key, const RecordId rid, const char* included,
+		bool leftmost, bool rightmost);
+
+  /**
+   * Adds the entry to the leftmost or rightmost leaf remembered by an earlier insert, if the key is past
+   * every key of the tree on that side and the leaf has room for it.
+   * @return False if the entry has to be inserted from the root
+   */
+  template <class T>
+  bool appendToEdgeLeaf(const T& key, const RecordId rid, const char* included);
+
+  /**
+   * Inserts the entry into its leaf, latching only the leaf for writing.
+   * @return False, having changed nothing, if the leaf is full and has to be split
+   */
+  template <class T>
+  bool insertOptimistic(const void* key, const RecordId rid, const char* included);
+
+  /**
+   * Inserts the entry latching the nodes on the way down for writing, from the lowest one that has
+   * room for one more key, or from the root if none has. Splits the nodes below it as needed.
+   */
+  template <class T>
+  void insertPessimistic(const void* key, const RecordId rid, const char* included);
+
+  /**
+   * insertBatch() for keys of type T.
+   */
+  template <class T>
+  void insertBatchTyped(const void* const* keys, const RecordId* rids, std::size_t numEntries);
+
+  /**
+   * Inserts a run of entries, sorted by key, in the subtree of the node with the given page number.
+   * The run is divided among the children by the keys of the node, so that each child is descended into once.
+   * @param pageNum page number of the node
+   * @param begin		First entry of the run
+   * @param end			End of the run
+   * @param splits	The nodes split off the node, in order, are appended to this with the keys pushed up for them
+   */
+  template <class T>
+  void insertNodeRun(PageId pageNum, const RIDKeyPair<T>* begin, const RIDKeyPair<T>* end, std::vector<PageKeyPair<T> >& splits);
+
+  /**
+   * Merges a run of entries, sorted by key, into the leaf with the given page number.
+   * @param pageNum page number of the leaf
+   * @param begin		First entry of the run
+   * @param end			End of the run
+   * @param splits	The leaves split off the leaf, in order, are appended to this with the keys copied up for them
+   */
+  template <class T>
+  void insertLeafRun(PageId pageNum, const RIDKeyPair<T>* begin, const RIDKeyPair<T>* end, std::vector<PageKeyPair<T> >& splits);
+
+  /**
+   * Lays out the keys and children of a non-leaf node, spreading them evenly over as few new right
+   * siblings of the node as needed when they do not fit in it.
+   * @param pageNum	Page number of the node
+   * @param node			Pinned non-leaf node to fill
+   * @param keys			Keys of the node in order
+   * @param children	Children of the node in order, one more than the keys
+   * @param counts		Numbers of entries under the children in order, only used if the index is counted
+   * @param splits		The new siblings, in order, are appended to this with the keys pushed up for them
+   */
+  template <class T>
+  void fillNode(PageId pageNum, NonLeafNode<T>* node, const std::vector<T>& keys, const std::vector<PageId>& children,
+		const std::vector<std::uint64_t>& counts, std::vector<PageKeyPair<T> >& splits);
+
+  /**
+   * Fetches the next entry of the sorted input of bulkLoad(), counting it in the statistics of the keys.
+   * @param entries		Sorted <key, rid> pairs of every tuple in the base relation
+   * @param next			Next entry is returned in this
+   * @return False once every entry was fetched
+   */
+  template <class T>
+  bool nextSorted(ExternalSort<T>& entries, RIDKeyPair<T>& next);
+
+  /**
+   * Counts the key of a new entry in the shard of statistics of the calling thread, in the bucket of the
+   * histogram its key falls into.
+   */
+  template <class T>
+  void addStatistics(const T& key);
+
+  /**
+   * Takes the key of a deleted entry out of the counts in the shard of statistics of the calling thread.
+   */
+  template <class T>
+  void removeStatistics(const T& key);
+
+  /**
+   * Finds the bucket of the histogram a key is counted in, reading only the bounds between the buckets.
+   *
+   * @param key			Key to find the bucket of
+   * @param numBuckets	Number of buckets the histogram has
+   * @return Index of the first bucket whose largest key is not smaller than the key, or of the last bucket
+   */
+  template <class T>
+  int statisticsBucket(const T& key, const int numBuckets);
 
-/**
- * @brief The meta page, which holds metadata for Index file, is always first page of the btree index file and is cast
- * to the following structure to store or retrieve information from it.
- * Contains the relation name for which the index is created, the byte offset
- * of the key value on which the index is made, the type of the key and the page no
- * of the root page. Root page starts as page 2 but since a split can occur
- * at the root the root page may get moved up and get a new page no.
-*/
-struct IndexMetaInfo{
   /**
-   * Name of base relation.
+   * Bound of the histogram at an index, see KeyStatistics::bounds.
    */
-	char relationName[20];
+  template <class T>
+  T statisticsBound(const int index)
+  {
+		T key;
+		memcpy(&key, statistics.bounds[index], sizeof(T));
+		return key;
+  }
 
   /**
-   * Offset of attribute, over which index is built, inside the record stored in pages.
+   * Counts the bytes of a key in the registers of a sketch of distinct keys.
    */
-	int attrByteOffset;
+  static void addToSketch(std::uint8_t* sketch, const void* key, const int size);
 
   /**
-   * Type of the attribute over which index is built.
+   * Returns the shard of the statistics the calling thread counts its changes in.
    */
-	Datatype attrType;
+  StatisticsShard& statisticsShard();
 
   /**
-   * Page number of root page of the B+ Tree inside the file index file.
+   * Adds the changes counted in the shards to statistics and empties them, statsMutex being held. The outer
+   * buckets stretch to the keys of the shards past their ends.
    */
-	PageId rootPageNo;
+  template <class T>
+  void foldStatisticsTyped();
 
   /**
-   * Whether the root of the tree is a leaf
+   * estimateDistinctKeys() while holding statsMutex.
    */
-  bool rootIsLeaf;
-};
+  double distinctKeys();
 
-/*
-Each node is a page, so once we read the page in we just cast the pointer to the page to this struct and use it to access the parts
-These structures basically are the format in which the information is stored in the pages for the index file depending on what kind of 
-node they are. The level memeber of each non leaf structure seen below is set to 1 if the nodes 
-at this level are just above the leaf nodes. Otherwise set to 0.
-*/
+  /**
+   * estimateRange() for keys of type T, once the operators have been checked.
+   */
+  template <class T>
+  double estimateRangeTyped(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
 
-/**
- * @brief Structure for all non-leaf nodes when the key is of INTEGER type.
-*/
-struct NonLeafNodeInt{
   /**
-   * Level of the node in the tree.
+   * Builds the tree bottom-up from entries sorted by key. Leaves are written left to right and
+   * packed with the entries, then each level of non-leaf nodes is built over the one below it
+   * until a single root remains. The meta page is updated to point to the new root.
+   * Keys with at least postingRunLength entries are stored once, with a posting list of their record ids.
+   * @param entries		Sorted <key, rid> pairs of every tuple in the base relation
    */
-	int level;
+  template <class T>
+  void bulkLoad(ExternalSort<T>& entries);
 
   /**
-   * Stores keys.
+   * tryOpenScan() for keys of type T, once the operators have been checked and stored in the cursor.
    */
-	int keyArray[ INTARRAYNONLEAFSIZE ];
+  template <class T>
+  bool startScanTyped(ScanCursor& cursor, const void* lowVal, const void* highVal, std::size_t offset);
 
   /**
-   * Stores page numbers of child pages which themselves are other non-leaf/leaf nodes in the tree.
+   * startScanTyped() of a counted index skipping at least one entry. The cursor is moved straight to the
+   * entry before the first one returned in the order of the scan, as if the scan had returned it.
    */
-	PageId pageNoArray[ INTARRAYNONLEAFSIZE + 1 ];
-};
+  template <class T>
+  bool startScanAt(ScanCursor& cursor, const std::size_t offset);
 
+  /**
+   * countRange() for keys of type T, once the operators have been checked.
+   */
+  template <class T>
+  std::size_t countRangeTyped(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
 
-/**
- * @brief Structure for all leaf nodes when the key is of INTEGER type.
-*/
-struct LeafNodeInt{
   /**
-   * Stores keys.
+   * rank() for keys of type T.
    */
-	int keyArray[ INTARRAYLEAFSIZE ];
+  template <class T>
+  std::size_t countBelowTyped(const void* key);
 
   /**
-   * Stores RecordIds.
+   * Counts the entries of a counted index with keys smaller than a key, or not greater than it, along the
+   * path from the root to the leaf the key falls in. The entries tied with a STRING prefix are compared
+   * with the full value.
+   * @param key				Key to count up to
+   * @param value			Full value of the key if it is a STRING prefix, not read otherwise
+   * @param inclusive	True to count the entries with the key too
    */
-	RecordId ridArray[ INTARRAYLEAFSIZE ];
+  template <class T>
+  std::uint64_t countBelowKey(const T& key, const char* value, const bool inclusive);
 
   /**
-   * Page number of the leaf on the right side.
-	 * This linking of leaves allows to easily move from one leaf to the next leaf during index scan.
+   * select() for keys of type T.
    */
-	PageId rightSibPageNo;
-};
+  template <class T>
+  bool selectTyped(std::size_t position, RecordId& outRid);
 
+  /**
+   * Finds the entry of a counted index at a position in key order, following the counts down from the root.
+   * @param position		Position of the entry, smaller than the number of entries
+   * @param slot				Index in the leaf of the entry returned in this
+   * @param listIndex		Index of the record id of the entry in the posting list of the slot returned in this,
+   *										0 if the slot holds a single entry
+   * @param parentNum		Page number of the parent of the leaf returned in this, Page::INVALID_NUMBER if the leaf is the root
+   * @param childIndex	Index of the leaf among the children of its parent returned in this
+   * @return Page number of the leaf, not pinned
+   */
+  template <class T>
+  PageId locateEntry(std::uint64_t position, int& slot, std::uint64_t& listIndex, PageId& parentNum, int& childIndex);
 
-/**
- * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute of a
- * relation. This index supports only one scan at a time.
-*/
-class BTreeIndex {
+  /**
+   * Returns the number of entries in the subtree rooted at a node of a counted index.
+   */
+  template <class T>
+  std::uint64_t subtreeEntries(const PageId pageNum);
 
- private:
+  /**
+   * Returns the number of entries of the first slots of a leaf, counting every record id of their posting lists.
+   * @param end			Number of slots to count
+   */
+  template <class T>
+  std::uint64_t leafEntries(LeafNode<T>* leaf, const int end);
 
   /**
-   * File object for the index file.
+   * Returns the number of entries under a non-leaf node of a counted index.
    */
-	File		*file;
+  template <class T>
+  std::uint64_t nodeEntries(NonLeafNode<T>* node)
+  {
+		std::uint64_t count = 0;
+		for (int i = 0; i <= node->header.numKeys; i++)
+		{
+			count += childCount(node, i);
+		}
+		return count;
+  }
 
   /**
-   * Buffer Manager Instance.
+   * Returns the number of entries under the child at an index of a non-leaf node of a counted index. The counts
+   * follow the first nodeOccupancy + 1 page numbers, and nodeOccupancy is lowered to leave room for them.
    */
-	BufMgr	*bufMgr;
+  template <class T>
+  std::uint64_t childCount(NonLeafNode<T>* node, const int index)
+  {
+		std::uint64_t count;
+		memcpy(&count, (char*) (node->pageNoArray + nodeOccupancy + 1) + index * sizeof(count), sizeof(count));
+		return count;
+  }
 
   /**
-   * Page number of meta page.
+   * Sets the number of entries under the child at an index of a non-leaf node of a counted index.
    */
-	PageId	headerPageNum;
+  template <class T>
+  void setChildCount(NonLeafNode<T>* node, const int index, const std::uint64_t count)
+  {
+		memcpy((char*) (node->pageNoArray + nodeOccupancy + 1) + index * sizeof(count), &count, sizeof(count));
+  }
 
   /**
-   * page number of root page of B+ tree inside index file.
+   * Moves the counts of consecutive children of a non-leaf node, along with their page numbers. The ranges
+   * may overlap. Does nothing if the index is not counted.
+   * @param from			Node the children are in
+   * @param fromIndex	Index of the first child in from
+   * @param to				Node the children move to
+   * @param toIndex		Index of the first child in to
+   * @param count			Number of children
    */
-	PageId	rootPageNum;
+  template <class T>
+  void moveChildCounts(NonLeafNode<T>* from, const int fromIndex, NonLeafNode<T>* to, const int toIndex, const int count)
+  {
+		if (counted && count > 0)
+		{
+			memmove((char*) (to->pageNoArray + nodeOccupancy + 1) + toIndex * sizeof(std::uint64_t),
+				(char*) (from->pageNoArray + nodeOccupancy + 1) + fromIndex * sizeof(std::uint64_t),
+				count * sizeof(std::uint64_t));
+		}
+  }
 
   /**
-   * Datatype of attribute over which index is built.
+   * Descends from the root to the leftmost leaf that may hold the key and moves a cursor to its first entry >= key,
+   * leaving that leaf pinned and latched for reading. The cursor reads ahead from the leaf on.
+   * @param key			Key to search for
+   * @param cursor	Cursor moved to the leaf
    */
-	Datatype	attributeType;
+  template <class T>
+  void findLeaf(const T& key, ScanCursor& cursor);
 
   /**
-   * Offset of attribute, over which index is built, inside records. 
+   * Descends from the root to the rightmost leaf that may hold the last entry <= key, or < key if not inclusive,
+   * and moves a cursor to that entry, leaving the leaf pinned and latched for reading. The entry may be in
+   * a leaf further left, in which case the cursor is left before the first entry of its leaf.
+   * @param key				Key to search for
+   * @param inclusive	Whether entries equal to the key are wanted
+   * @param cursor		Cursor moved to the leaf
    */
-	int 		attrByteOffset;
+  template <class T>
+  void findLastLeaf(const T& key, const bool inclusive, ScanCursor& cursor);
 
   /**
-   * Number of keys in leaf node, depending upon the type of key.
+   * Moves a cursor to where its scan starts, the first entry >= its low bound, or the last one <= its high bound
+   * if the scan is descending, see findLeaf() and findLastLeaf().
    */
-	int			leafOccupancy;
+  template <class T>
+  void findScanStart(ScanCursor& cursor);
 
   /**
-   * Number of keys in non-leaf node, depending upon the type of key.
+   * Descends from the root to the leftmost leaf that may hold the key and latches it. The descent reads the
+   * non-leaf nodes optimistically, and latches them on the way down if writers keep getting in the way.
+   * @param key				Key to search for
+   * @param rid				Record id to search for along with the key, in the order duplicates are kept in. NULL to
+   *								search for the key alone
+   * @param exclusive	True to latch the leaf for writing, false for reading
+   * @param last			True to descend to the rightmost leaf that may hold the key instead
+   * @param pageNum		Page number of the leaf returned in this, not pinned
+   * @param leftmost	Whether the leaf is the leftmost one returned in this
+   * @param rightmost	Whether the leaf is the rightmost one returned in this
+   * @param parentNum	Page number of the parent of the leaf returned in this, Page::INVALID_NUMBER if the leaf is the root
+   * @param childIndex	Index of the leaf among the children of its parent returned in this
    */
-	int			nodeOccupancy;
+  template <class T>
+  void latchLeaf(const T& key, const RecordId* rid, const bool exclusive, const bool last, PageId& pageNum, bool& leftmost, bool& rightmost,
+		PageId& parentNum, int& childIndex);
 
+  /**
+   * latchLeaf() reading the non-leaf nodes without latching them, checking their versions after reading them.
+   * @return False, holding no latch, if a writer changed one of the nodes on the way
+   */
+  template <class T>
+  bool latchLeafOptimistic(const T& key, const RecordId* rid, const bool exclusive, const bool last, PageId& pageNum, bool& leftmost, bool& rightmost,
+		PageId& parentNum, int& childIndex);
 
-	// MEMBERS SPECIFIC TO SCANNING
+  /**
+   * latchLeaf() latching each non-leaf node for reading before letting go of its parent.
+   */
+  template <class T>
+  void latchLeafCoupled(const T& key, const RecordId* rid, const bool exclusive, const bool last, PageId& pageNum, bool& leftmost, bool& rightmost,
+		PageId& parentNum, int& childIndex);
 
   /**
-   * True if an index scan has been started.
+   * Latches the current leaf of a cursor for reading at the start of a call. If the leaf changed
+   * since the cursor left it, the cursor is moved to the first entry after the last one it returned.
    */
-	bool		scanExecuting;
+  template <class T>
+  void resumeScan(ScanCursor& cursor);
 
   /**
-   * Index of next entry to be scanned in current leaf being scanned.
+   * Moves a cursor from the root to the first entry after the last one it returned, in the order of key and then
+   * record id and in the direction of its scan, whether or not that entry is still there. The leaf found is
+   * latched for reading.
    */
-	int			nextEntry;
+  template <class T>
+  void findEntry(ScanCursor& cursor);
 
   /**
-   * Page number of current page being scanned.
+   * Remembers the version of the current leaf of a cursor and lets go of its latch at the end of a call.
    */
-	PageId	currentPageNum;
+  void parkScan(ScanCursor& cursor);
 
   /**
-   * Current Page being scanned.
+   * Moves a cursor to the first entry of the right sibling of its current leaf, latching the sibling for reading
+   * before letting go of the current leaf.
    */
-	Page		*currentPageData;
+  template <class T>
+  void moveRight(ScanCursor& cursor);
 
   /**
-   * Low INTEGER value for scan.
+   * Moves a cursor to the last entry of the left sibling of its current leaf. The current leaf is let go
+   * before the sibling is latched, since a split of the sibling latches the current leaf to link it back,
+   * and the leaves such a split put in between are then walked through from the old sibling.
    */
-	int			lowValInt;
+  template <class T>
+  void moveLeft(ScanCursor& cursor);
 
   /**
-   * Low DOUBLE value for scan.
+   * Asks the buffer manager to prefetch the leaves a cursor is about to reach, in the direction of its scan,
+   * enough of them to have its readahead window ahead of it, and widens the window.
    */
-	double	lowValDouble;
+  template <class T>
+  void readAhead(ScanCursor& cursor);
 
   /**
-   * Low STRING value for scan.
+   * lookupMany() for keys of type T.
    */
-	std::string	lowValString;
+  template <class T>
+  void lookupManyTyped(const void* const* keys, std::size_t numKeys, std::vector<RecordId>& outRids, std::vector<std::size_t>& counts);
 
   /**
-   * High INTEGER value for scan.
+   * ScanCursor::tryScanNext() for keys of type T, once it is checked that the cursor is scanning.
    */
-	int			highValInt;
+  template <class T>
+  bool scanNextTyped(ScanCursor& cursor, RecordId& outRid, void* included);
 
   /**
-   * High DOUBLE value for scan.
+   * ScanCursor::scanNextBatch() for keys of type T, once it is checked that the cursor is scanning.
    */
-	double	highValDouble;
+  template <class T>
+  std::size_t scanNextBatchTyped(ScanCursor& cursor, RecordId* outRids, std::size_t maxRids, void* included);
 
   /**
-   * High STRING value for scan.
+   * Moves a scan forward from its current entry to the first one in range, moving to the
+   * right siblings of the current leaf as needed.
+   * @return False if no entry is left in range
    */
-	std::string highValString;
-	
+  template <class T>
+  bool seekMatch(ScanCursor& cursor);
+
   /**
-   * Low Operator. Can only be GT(>) or GTE(>=).
+   * seekMatch() of a descending scan, moving back from the current entry to the first one in range, and to
+   * the left siblings of the current leaf as needed.
+   * @return False if no entry is left in range
    */
-	Operator	lowOp;
+  template <class T>
+  bool seekMatchDescending(ScanCursor& cursor);
 
   /**
-   * High Operator. Can only be LT(<) or LTE(<=).
+   * Returns the values of the included columns of the entry at an index of a leaf.
    */
-	Operator	highOp;
+  template <class T>
+  char* leafIncluded(LeafNode<T>* leaf, const int index)
+  {
+		return (char*) (leaf->ridArray + leafOccupancy) + index * includedSize;
+  }
 
   /**
-   * Whether or not the roof is a leaf
+   * Moves the values of the included columns of consecutive entries of a leaf, along with their record ids.
+   * The ranges may overlap.
+   * @param from			Leaf the entries are in
+   * @param fromIndex	Index of the first entry in from
+   * @param to				Leaf the entries move to
+   * @param toIndex		Index of the first entry in to
+   * @param count			Number of entries
    */
-  bool rootIsLeaf;
+  template <class T>
+  void moveIncluded(LeafNode<T>* from, const int fromIndex, LeafNode<T>* to, const int toIndex, const int count)
+  {
+		if (includedSize > 0 && count > 0)
+		{
+			memmove(leafIncluded(to, toIndex), leafIncluded(from, fromIndex), count * includedSize);
+		}
+  }
 
   /**
-   * Maximum Integer value
+   * Stores the values of the included columns of the entry at an index of a leaf.
+   * @param included	Values of the included columns, NULL if the index has none
    */
-  const int MAX_INT = 2147483647;
+  template <class T>
+  void storeIncluded(LeafNode<T>* leaf, const int index, const char* included)
+  {
+		if (included != NULL)
+		{
+			memcpy(leafIncluded(leaf, index), included, includedSize);
+		}
+  }
 
   /**
-   * Inserts a new entry in subtree of the node with the given page number
-   * If the node is being split, return the key that will be pushed up and the page number of the new node.
-   * Otherwise, returns <MAX_INT, MAX_INT>
-   * @param pageNum page number of the node
-   * @param key			Key to insert, pointer to integer/double/char string
-   * @param rid			Record ID of a record whose entry is getting inserted into the index.
+   * Copies the values of the included columns of a record of the relation.
+   * @param rid			Record ID of the record
+   * @param out			Where the values are copied, includedSize bytes
    */
-  PageKeyPair<int> insertNode(PageId pageNum, const void *key, const RecordId rid);
+  void readIncluded(const RecordId& rid, char* out);
 
   /**
-   * Inserts a new entry in leaf with the given page number
-   * If the leaf is being split, return the key that will be copied up and the page number of the new leaf.
-   * Otherwise, returns <MAX_INT, MAX_INT>
-   * @param pageNum page number of the leaf
-   * @param key			Key to insert, pointer to integer/double/char string
-   * @param rid			Record ID of a record whose entry is getting inserted into the index.
+   * Reads a record of the relation.
+   * @param rid			Record ID of the record
+   */
+  std::string readRecord(const RecordId& rid);
+
+  /**
+   * Compares the full STRING attribute of a record with a value, for keys tied with it on their prefix.
+   * @param rid			Record ID of the record
+   * @param value		Value to compare with
+   * @return A negative number, 0 or a positive number if the attribute is smaller than, equal to or greater than the value
    */
-  PageKeyPair<int> insertLeaf(PageId pageNum, const void *key, const RecordId rid);
+  int compareFullKey(const RecordId& rid, const std::string& value);
 	
  public:
 
   /**
    * BTreeIndex Constructor. 
 	 * Check to see if the corresponding index file exists. If so, open the file.
-	 * If not, create it and insert entries for every tuple in the base relation using FileScan class.
+	 * If not, create it, collect entries for every tuple in the base relation using FileScan class,
+	 * sort them with ExternalSort and bulk load the tree bottom-up.
    *
    * @param relationName        Name of file.
    * @param outIndexName        Return the name of index file.
    * @param bufMgrIn						Buffer Manager Instance
    * @param attrByteOffset			Offset of attribute, over which index is to be built, in the record
    * @param attrType						Datatype of attribute over which index is built
-   * @throws  BadIndexInfoException     If the index file already exists for the corresponding attribute, but values in metapage(relationName, attribute byte offset, attribute type etc.) do not match with values received through constructor parameters.
+   * @throws  BadIndexInfoException     If the index file already exists for the corresponding attribute, but values in metapage(relationName, attribute byte offset, attribute type, format version etc.) do not match with values received through constructor parameters.
    */
 	BTreeIndex(const std::string & relationName, std::string & outIndexName,
 						BufMgr *bufMgrIn,	const int attrByteOffset,	const Datatype attrType);
@@ -346,19 +2126,81 @@ class BTreeIndex {
   /**
    * BTreeIndex Constructor with specified node and leaf orders. Used for testing purposes only.
 	 * Check to see if the corresponding index file exists. If so, open the file.
-	 * If not, create it and insert entries for every tuple in the base relation using FileScan class.
+	 * If not, create it, collect entries for every tuple in the base relation using FileScan class,
+	 * sort them with ExternalSort and bulk load the tree bottom-up.
+   *
+   * @param relationName        Name of file.
+   * @param outIndexName        Return the name of index file.
+   * @param bufMgrIn						Buffer Manager Instance
+   * @param attrByteOffset			Offset of attribute, over which index is to be built, in the record
+   * @param attrType						Datatype of attribute over which index is built
+   * @param nodeOccupancy       The capacity of the nodes of the tree, at most what a node holds for the key type
+   * @param leafOccupancy       The capacity of the leaves of the tree, at most what a leaf holds for the key type
+   * @param includedColumns     Columns whose values are stored in the leaves, none by default
+   * @throws  BadIndexInfoException     If the index file already exists for the corresponding attribute, but values in metapage(relationName, attribute byte offset, attribute type, format version, included columns etc.) do not match with values received through constructor parameters.
+   */
+	BTreeIndex(const std::string & relationName, std::string & outIndexName,
+						BufMgr *bufMgrIn,	const int attrByteOffset,	const Datatype attrType, const int nodeOccupancy, const int leafOccupancy,
+						const std::vector<IncludedColumn>& includedColumns = std::vector<IncludedColumn>());
+
+  /**
+   * BTreeIndex Constructor for a covering index. The values of the included columns of every record are stored
+   * in the leaves next to its record id, so that scans return them without reading the records. Leaves hold
+   * fewer entries to make room for them.
+   *
+   * @param relationName        Name of file.
+   * @param outIndexName        Return the name of index file.
+   * @param bufMgrIn						Buffer Manager Instance
+   * @param attrByteOffset			Offset of attribute, over which index is to be built, in the record
+   * @param attrType						Datatype of attribute over which index is built
+   * @param includedColumns     Columns whose values are stored in the leaves, at most MAXINCLUDEDCOLUMNS
+   * @throws  BadIndexInfoException     If the included columns are not valid or do not leave room for two entries
+   * in a leaf, or if the index file already exists but values in its metapage do not match the parameters.
+   */
+	BTreeIndex(const std::string & relationName, std::string & outIndexName,
+						BufMgr *bufMgrIn,	const int attrByteOffset,	const Datatype attrType,
+						const std::vector<IncludedColumn>& includedColumns);
+
+  /**
+   * BTreeIndex Constructor for a counted index. Every non-leaf node keeps the number of entries under each of
+   * its children, so that countRange(), rank(), select() and scans opened at an offset descend the tree by
+   * counts instead of walking the leaves. Nodes hold fewer children to make room for the counts, and inserts
+   * have the index to themselves like insertBatch(), since they update the counts all the way from the root.
    *
    * @param relationName        Name of file.
    * @param outIndexName        Return the name of index file.
    * @param bufMgrIn						Buffer Manager Instance
    * @param attrByteOffset			Offset of attribute, over which index is to be built, in the record
    * @param attrType						Datatype of attribute over which index is built
-   * @param nodeOccupancy       The capacity of the nodes of the tree
-   * @param leafOccupancy       The capacity of the leaves of the tree
-   * @throws  BadIndexInfoException     If the index file already exists for the corresponding attribute, but values in metapage(relationName, attribute byte offset, attribute type etc.) do not match with values received through constructor parameters.
+   * @param counted							Whether the nodes keep counts, false makes it a plain index
+   * @param nodeOccupancy       The capacity of the nodes of the tree, at most what a node holds with its counts
+   * @param leafOccupancy       The capacity of the leaves of the tree, at most what a leaf holds
+   * @throws  BadIndexInfoException     If the index file already exists but values in its metapage do not match
+   * the parameters, including whether it is counted.
+   */
+	BTreeIndex(const std::string & relationName, std::string & outIndexName,
+						BufMgr *bufMgrIn,	const int attrByteOffset,	const Datatype attrType, const bool counted,
+						const int nodeOccupancy = INTARRAYNONLEAFSIZE, const int leafOccupancy = INTARRAYLEAFSIZE);
+
+  /**
+   * BTreeIndex Constructor for a COMPOSITE index, whose key is made of several attributes of the relation.
+   * Keys passed to the index are built with CompositeKeyFormat::makeKey() from the same attributes.
+   * The name of the index file lists the offsets of all attributes.
+   *
+   * @param relationName        Name of file.
+   * @param outIndexName        Return the name of index file.
+   * @param bufMgrIn						Buffer Manager Instance
+   * @param keyAttributes				Attributes of the key, in order, at most MAXKEYATTRIBUTES
+   * @param nodeOccupancy       The capacity of the nodes of the tree, at most what a node holds
+   * @param leafOccupancy       The capacity of the leaves of the tree, at most what a leaf holds
+   * @param includedColumns     Columns whose values are stored in the leaves, none by default
+   * @throws  BadIndexInfoException     If the attributes do not make a valid key, or if the index file already
+   * exists but values in its metapage do not match the parameters.
    */
 	BTreeIndex(const std::string & relationName, std::string & outIndexName,
-						BufMgr *bufMgrIn,	const int attrByteOffset,	const Datatype attrType, const int nodeOccupancy, const int leafOccupancy);
+						BufMgr *bufMgrIn, const std::vector<KeyAttribute>& keyAttributes,
+						const int nodeOccupancy = INTARRAYNONLEAFSIZE, const int leafOccupancy = INTARRAYLEAFSIZE,
+						const std::vector<IncludedColumn>& includedColumns = std::vector<IncludedColumn>());
 	
 
   /**
@@ -382,13 +2224,131 @@ class BTreeIndex {
 	void insertEntry(const void* key, const RecordId rid);
 
 
+  /**
+	 * Insert a batch of entries. The batch is sorted by key and the entries bound for the same leaf are
+	 * merged into it together, in a single descent, so each leaf on the way is read and split at most once.
+	 * A leaf receiving more entries than it can hold is split into as few leaves as they fit in.
+   * @param keys				Keys to insert, each a pointer to integer/double/char string
+   * @param rids				Record IDs of the records whose entries are getting inserted, one per key
+   * @param numEntries	Number of entries in the batch
+	**/
+	void insertBatch(const void* const* keys, const RecordId* rids, std::size_t numEntries);
+
+
+  /**
+	 * Delete the entry <value,rid>. Among the entries with the same key, the one with the given record id is deleted.
+	 * A node left less than half full by the deletion borrows entries from a sibling, or is merged with it if
+	 * both fit in one node. Merges may continue up to the root, which is replaced by its only child when it is
+	 * left with one. Pages of merged nodes are kept on a free list in the index file and reused by later splits.
+   * @param key			Key to delete, pointer to integer/double/char string
+   * @param rid			Record ID of the record whose entry is getting deleted from the index.
+	 * @throws  NoSuchKeyFoundException If there is no such entry in the index.
+	**/
+	void deleteEntry(const void* key, const RecordId rid);
+
+
   /**
 	 * Begin a filtered scan of the index.  For instance, if the method is called 
 	 * using ("a",GT,"d",LTE) then we should seek all entries with a value 
 	 * greater than "a" and less than or equal to "d".
+	 * Start from root to find out the leaf page that contains the first RecordID that satisfies the
+	 * scan parameters. That page stays pinned in the buffer pool until the cursor moves past it.
+   * @param lowVal	Low value of range, pointer to integer / double / char string
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer / double / char string
+   * @param highOp	High operator (LT/LTE)
+   * @param offset	Number of entries in range to skip before the first one returned. A counted index finds the
+   *							first entry returned from the root, others step over the entries skipped
+   * @param direction	DESCENDING to return the entries from the high bound down, the last one first. STRING
+   *							entries sharing their key prefix come in descending record id order, see StringKey
+   * @return Cursor positioned on the first entry in range
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values 
+   * @throws  BadScanrangeException If lowVal > highval
+	 * @throws  NoSuchKeyFoundException If there is no key in the B+ tree that satisfies the scan criteria.
+	**/
+	ScanCursor openScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp,
+		const std::size_t offset = 0, const ScanDirection direction = ASCENDING);
+
+
+  /**
+	 * Begin a filtered scan of the index on the given cursor, see openScan(), without throwing when no key
+	 * satisfies the scan criteria. A scan the cursor is executing is ended first.
+   * @param cursor	Cursor positioned on the first entry in range
+   * @param lowVal	Low value of range, pointer to integer / double / char string
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer / double / char string
+   * @param highOp	High operator (LT/LTE)
+   * @param offset	Number of entries in range to skip before the first one returned
+   * @param direction	DESCENDING to return the entries from the high bound down
+   * @return False, leaving the cursor not scanning, if there is no key in the B+ tree that satisfies the scan criteria.
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values 
+   * @throws  BadScanrangeException If lowVal > highval
+	**/
+	bool tryOpenScan(ScanCursor& cursor, const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp,
+		const std::size_t offset = 0, const ScanDirection direction = ASCENDING);
+
+  /**
+   * Counts the entries in a range. A counted index adds up the counts of the children on the paths from the
+   * root to the leaves of the two bounds, other indexes scan the range. STRING bounds longer than the key
+   * prefix are compared in full with the entries tied with them.
+   * @param lowVal	Low value of range, pointer to integer / double / char string
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer / double / char string
+   * @param highOp	High operator (LT/LTE)
+   * @return Number of entries in range
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+   */
+	std::size_t countRange(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+
+  /**
+   * Returns the number of entries with keys smaller than a key, which is the position in key order of the
+   * first entry with the key if there is one.
+   * @param key			Key, pointer to integer/double/char string
+   * @throws  BadIndexInfoException If the index is not counted
+   */
+	std::size_t rank(const void* key);
+
+  /**
+   * Finds the entry at a position in key order, entries with the same key being in index order.
+   * @param position	Position of the entry, from 0
+   * @param outRid		Record id of the entry returned in this
+   * @return False if the index has no more entries than the position
+   * @throws  BadIndexInfoException If the index is not counted
+   */
+	bool select(const std::size_t position, RecordId& outRid);
+
+  /**
+   * Returns whether the non-leaf nodes keep the number of entries under each of their children.
+   */
+	bool isCounted() const { return counted; }
+
+
+  /**
+	 * Find the record ids of all entries with the given key, without opening a scan.
+   * @param key			Key to look up, pointer to integer/double/char string
+   * @param outRids	Record ids of the entries found are appended to this, in index order
+   * @return Number of entries found
+	**/
+	std::size_t lookup(const void* key, std::vector<RecordId>& outRids);
+
+
+  /**
+	 * Find the record ids of the entries with each of the given keys. The leaf reached for one key stays pinned
+	 * and is searched directly for the next key whenever that key has to be in it, so keys given in ascending
+	 * order cost one descent per leaf visited rather than one per key. Keys in any other order are still looked
+	 * up correctly, descending from the root again where needed.
+   * @param keys		Keys to look up, each a pointer to integer/double/char string
+   * @param numKeys	Number of keys
+   * @param outRids	Record ids of the entries found are appended to this, grouped by key in the order of the keys
+   * @param counts	Number of entries found for each key is appended to this
+	**/
+	void lookupMany(const void* const* keys, std::size_t numKeys, std::vector<RecordId>& outRids, std::vector<std::size_t>& counts);
+
+
+  /**
+	 * Begin a filtered scan of the index with the cursor kept by the index, see openScan().
 	 * If another scan is already executing, that needs to be ended here.
-	 * Set up all the variables for scan. Start from root to find out the leaf page that contains the first RecordID
-	 * that satisfies the scan parameters. Keep that page pinned in the buffer pool.
    * @param lowVal	Low value of range, pointer to integer / double / char string
    * @param lowOp		Low operator (GT/GTE)
    * @param highVal	High value of range, pointer to integer / double / char string
@@ -401,17 +2361,92 @@ class BTreeIndex {
 
 
   /**
-	 * Fetch the record id of the next index entry that matches the scan.
+	 * Begin a filtered scan of the index with the cursor kept by the index, see tryOpenScan().
+	 * If another scan is already executing, that needs to be ended here.
+   * @param lowVal	Low value of range, pointer to integer / double / char string
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer / double / char string
+   * @param highOp	High operator (LT/LTE)
+   * @return False if there is no key in the B+ tree that satisfies the scan criteria.
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values 
+   * @throws  BadScanrangeException If lowVal > highval
+	**/
+	bool tryStartScan(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+
+
+  /**
+	 * Fetch the record id of the next index entry that matches the scan started by startScan().
 	 * Return the next record from current page being scanned. If current page has been scanned to its entirety, move on to the right sibling of current page, if any exists, to start scanning that page. Make sure to unpin any pages that are no longer required.
    * @param outRid	RecordId of next record found that satisfies the scan criteria returned in this
 	 * @throws ScanNotInitializedException If no scan has been initialized.
 	 * @throws IndexScanCompletedException If no more records, satisfying the scan criteria, are left to be scanned.
 	**/
-	void scanNext(RecordId& outRid);  // returned record id
+	void scanNext(RecordId& outRid, void* included = NULL);  // returned record id
+
+
+  /**
+	 * Fetch the record id of the next index entry that matches the scan started by startScan(),
+	 * see ScanCursor::tryScanNext().
+   * @param outRid	RecordId of next record found that satisfies the scan criteria returned in this
+   * @param included	If not NULL, the values of the included columns of the entry are copied here
+   * @return False if no more records, satisfying the scan criteria, are left to be scanned.
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	**/
+	bool tryScanNext(RecordId& outRid, void* included = NULL);
+
+
+  /**
+	 * Fetch the record ids of the next index entries that match the scan started by startScan(),
+	 * see ScanCursor::scanNextBatch().
+   * @param outRids	Array the record ids are returned in
+   * @param maxRids	Number of record ids the array can hold
+   * @param included	If not NULL, the values of the included columns of the entries are copied here
+   * @return Number of record ids returned, 0 if no more records, satisfying the scan criteria, are left to be scanned.
+	 * @throws ScanNotInitializedException If no scan has been initialized.
+	**/
+	std::size_t scanNextBatch(RecordId* outRids, std::size_t maxRids, void* included = NULL);
+
+  /**
+   * Estimates how many entries a scan of a range would return, from the statistics of the keys kept in the
+   * meta page. Entries are taken as spread evenly over the keys of each bucket of the histogram, and a single
+   * key not alone in its bucket as having the average number of entries of a key. Does not read the tree.
+   * @param lowVal	Low value of range, pointer to integer / double / char string
+   * @param lowOp		Low operator (GT/GTE)
+   * @param highVal	High value of range, pointer to integer / double / char string
+   * @param highOp	High operator (LT/LTE)
+   * @return Estimated number of entries in the range
+   * @throws  BadOpcodesException If lowOp and highOp do not contain one of their their expected values
+   * @throws  BadScanrangeException If lowVal > highval
+   */
+	double estimateRange(const void* lowVal, const Operator lowOp, const void* highVal, const Operator highOp);
+
+  /**
+   * Estimates the number of distinct keys in the index from the sketch in its statistics. Keys deleted since
+   * the index was built are still counted.
+   */
+	double estimateDistinctKeys();
+
+  /**
+   * Returns the number of bytes the values of the included columns of an entry take, the sum of their lengths
+   * in the order they were declared. 0 if the index is not covering.
+   */
+	int getIncludedSize() const
+	{
+		return includedSize;
+	}
+
+  /**
+   * Returns the attributes of the key of a COMPOSITE index, which build the keys passed to it.
+   * Empty for other indexes.
+   */
+	const CompositeKeyFormat& getKeyFormat() const
+	{
+		return keyFormat;
+	}
 
 
   /**
-	 * Terminate the current scan. Unpin any pinned pages. Reset scan specific variables.
+	 * Terminate the scan started by startScan(). Unpin any pinned pages. Reset scan specific variables.
 	 * @throws ScanNotInitializedException If no scan has been initialized.
 	**/
 	void endScan();
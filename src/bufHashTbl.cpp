@@ -68,6 +68,12 @@ void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId fra
 }
 
 void BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo) 
+{
+  if (!tryLookup(file, pageNo, frameNo))
+  	throw HashNotFoundException(file->filename(), pageNo);
+}
+
+bool BufHashTbl::tryLookup(const File* file, const PageId pageNo, FrameId &frameNo) 
 {
   int index = hash(file, pageNo);
   hashBucket* tmpBuc = ht[index];
@@ -75,12 +81,12 @@ void BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo)
     if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
     {
       frameNo = tmpBuc->frameNo; // return frameNo by reference
-      return;
+      return true;
     }
     tmpBuc = tmpBuc->next;
   }
 
-  throw HashNotFoundException(file->filename(), pageNo);
+  return false;
 }
 
 void BufHashTbl::remove(const File* file, const PageId pageNo) {
@@ -40,7 +40,8 @@ struct hashBucket {
 /**
 * @brief Hash table class to keep track of pages in the buffer pool
 *
-* @warning This class is not threadsafe.
+* @warning This class is not threadsafe. Calls touching different buckets may run at once, which lets the
+* caller guard the buckets apart by their hash values.
 */
 class BufHashTbl
 {
@@ -54,6 +55,7 @@ class BufHashTbl
 	 */
   hashBucket**  ht;
 
+ public:
 	/**
 	 * returns hash value between 0 and HTSIZE-1 computed using file and pageNo
 	 *
@@ -63,7 +65,6 @@ class BufHashTbl
 	 */
   int	 hash(const File* file, const PageId pageNo);
 
- public:
 	/**
    * Constructor of BufHashTbl class
 	 */
@@ -96,6 +97,17 @@ class BufHashTbl
 	 */
   void lookup(const File* file, const PageId pageNo, FrameId &frameNo);
 
+	/**
+   * Check if (file, pageNo) is currently in the buffer pool (ie. in
+   * the hash table), without throwing when it is not.
+	 *
+	 * @param file  	File object
+	 * @param pageNo	Page number in the file
+	 * @param frameNo Frame number reference, set only if the page is found
+   * @return  			True if the page entry is found in the hash table
+	 */
+  bool tryLookup(const File* file, const PageId pageNo, FrameId &frameNo);
+
 	/**
    * Delete entry (file,pageNo) from hash table.
 	 *
@@ -7,12 +7,12 @@
 
 #include <memory>
 #include <iostream>
+#include <vector>
 #include "buffer.h"
 #include "exceptions/buffer_exceeded_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
 #include "exceptions/bad_buffer_exception.h"
-#include "exceptions/hash_not_found_exception.h"
 
 namespace badgerdb { 
 
@@ -59,7 +59,7 @@ void BufMgr::allocBuf(FrameId & frame)
 {
   // perform first part of clock algorithm to search for 
   // open buffer frame
-  // Assumes non-concurrent access to buffer manager
+  // bufMutex keeps other frames from being allocated meanwhile
   std::uint32_t numScanned = 0;
   bool found = 0;
 
@@ -78,12 +78,15 @@ void BufMgr::allocBuf(FrameId & frame)
     // is valid, check referenced bit
     if (! bufDescTable[clockHand].refbit)
     {
-      // check to see if someone has it pinned
-      if (bufDescTable[clockHand].pinCnt == 0)
+      // check to see if someone has it pinned, the mutex of its stripe keeps it from being pinned
+      // until it is out of the hash table
+      BufDesc* tmpbuf = &(bufDescTable[clockHand]);
+      std::lock_guard<std::mutex> stripeLock(stripeMutex(tmpbuf->file, tmpbuf->pageNo));
+      if (tmpbuf->pinCnt == 0)
       {
         // hasn't been referenced and is not pinned, use it
         // remove previous entry from hash table
-        hashTable->remove(bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo);
+        hashTable->remove(tmpbuf->file, tmpbuf->pageNo);
         found = true;
         break;
       }
@@ -118,42 +121,93 @@ void BufMgr::allocBuf(FrameId & frame)
 } // end allocBuf
 
 	
-void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
+bool BufMgr::pinIfPresent(File* file, const PageId pageNo, Page*& page)
 {
-  // check to see if it is already in the buffer pool
-  // std::cout << "readPage called on file.page " << file << "." << pageNo << endl;
+  std::lock_guard<std::mutex> stripeLock(stripeMutex(file, pageNo));
+
   FrameId frameNo = 0;
-	try
+	if (!hashTable->tryLookup(file, pageNo, frameNo))
 	{
-  	hashTable->lookup(file, pageNo, frameNo);
+    return false;
+  }
 
-    // set the referenced bit
+  // set the referenced bit, unless it already is, so that pages pinned over and over are only read
+  if (!bufDescTable[frameNo].refbit)
+  {
     bufDescTable[frameNo].refbit = true;
-    bufDescTable[frameNo].pinCnt++;
-    page = &bufPool[frameNo];
   }
-  catch(const HashNotFoundException &e) //not in the buffer pool, must allocate a new page
-  {
-    // alloc a new frame
-    allocBuf(frameNo);
+  bufDescTable[frameNo].pinCnt++;
+  page = &bufPool[frameNo];
+  return true;
+}
+
 
-    // read the page into the new frame
-    bufStats.diskreads++;
-    //status = file->readPage(pageNo, &bufPool[frameNo]);
-    bufPool[frameNo] = file->readPage(pageNo);
+bool BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
+{
+  // check to see if it is already in the buffer pool
+  // std::cout << "readPage called on file.page " << file << "." << pageNo << endl;
+  if (pinIfPresent(file, pageNo, page))
+  {
+    return true;
+  }
 
-    // set up the entry properly
-    bufDescTable[frameNo].Set(file, pageNo);
-    page = &bufPool[frameNo];
+  std::lock_guard<std::mutex> lock(bufMutex);
 
-    // insert in the hash table
-    hashTable->insert(file, pageNo, frameNo);
+  // another thread may have read it in while waiting for the buffer pool
+  if (pinIfPresent(file, pageNo, page))
+  {
+    return true;
   }
+
+  // not in the buffer pool, must allocate a new page
+  // alloc a new frame
+  FrameId frameNo = 0;
+  allocBuf(frameNo);
+
+  // read the page into the new frame
+  bufStats.diskreads++;
+  //status = file->readPage(pageNo, &bufPool[frameNo]);
+  bufPool[frameNo] = file->readPage(pageNo);
+
+  // set up the entry properly
+  bufDescTable[frameNo].Set(file, pageNo);
+  page = &bufPool[frameNo];
+
+  // insert in the hash table
+  std::lock_guard<std::mutex> stripeLock(stripeMutex(file, pageNo));
+  hashTable->insert(file, pageNo, frameNo);
+  return false;
 }
 
 
+void BufMgr::prefetchPages(File* file, const PageId* pageNos, const std::size_t count)
+{
+  std::vector<PageId> missing;
+  {
+    std::lock_guard<std::mutex> lock(bufMutex);
+    FrameId frameNo;
+    for (std::size_t i = 0; i < count; i++)
+    {
+      std::lock_guard<std::mutex> stripeLock(stripeMutex(file, pageNos[i]));
+      if (!hashTable->tryLookup(file, pageNos[i], frameNo))
+      {
+        missing.push_back(pageNos[i]);
+      }
+    }
+    bufStats.prefetches += missing.size();
+  }
+
+  // the reads are only requested, there is nothing to wait for while holding the buffer pool
+  if (!missing.empty())
+  {
+    file->prefetchPages(&missing[0], missing.size());
+  }
+}
+
 void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty) 
 {
+  std::lock_guard<std::mutex> stripeLock(stripeMutex(file, pageNo));
+
   // lookup in hashtable
   FrameId frameNo = 0;
   hashTable->lookup(file, pageNo, frameNo);
@@ -170,6 +224,8 @@ void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty)
 
 void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page) 
 {
+  std::lock_guard<std::mutex> lock(bufMutex);
+
   FrameId frameNo;
 
   // alloc a new frame
@@ -184,16 +240,20 @@ void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page)
   bufDescTable[frameNo].Set(file, pageNo);
 
   // insert in the hash table
+  std::lock_guard<std::mutex> stripeLock(stripeMutex(file, pageNo));
   hashTable->insert(file, pageNo, frameNo);
 }
 
 void BufMgr::flushFile(const File* file) 
 {
+  std::lock_guard<std::mutex> lock(bufMutex);
+
   for (std::uint32_t i = 0; i < numBufs; i++)
 	{
   	BufDesc* tmpbuf = &(bufDescTable[i]);
   	if(tmpbuf->file && tmpbuf->valid == true && tmpbuf->file == file)
 		{
+	    std::lock_guard<std::mutex> stripeLock(stripeMutex(file, tmpbuf->pageNo));
 	    if (tmpbuf->pinCnt > 0)
   			throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
 
@@ -214,15 +274,20 @@ void BufMgr::flushFile(const File* file)
 
 void BufMgr::disposePage(File* file, const PageId pageNo)
 {
+  std::lock_guard<std::mutex> lock(bufMutex);
+
 	//Deallocate from file altogether
   //See if it is in the buffer pool
   FrameId frameNo = 0;
-  hashTable->lookup(file, pageNo, frameNo);
+  {
+    std::lock_guard<std::mutex> stripeLock(stripeMutex(file, pageNo));
+    hashTable->lookup(file, pageNo, frameNo);
 
-	// clear the page
-	bufDescTable[frameNo].Clear();
+    // clear the page
+    bufDescTable[frameNo].Clear();
 
-	hashTable->remove(file, pageNo);
+    hashTable->remove(file, pageNo);
+  }
 
   // deallocate it in the file	
   file->deletePage(pageNo);
@@ -230,6 +295,8 @@ void BufMgr::disposePage(File* file, const PageId pageNo)
 
 void BufMgr::printSelf(void) 
 {
+  std::lock_guard<std::mutex> lock(bufMutex);
+
   BufDesc* tmpbuf;
 	int validFrames = 0;
   
@@ -10,6 +10,8 @@
 #include "file.h"
 #include "bufHashTbl.h"
 #include <iostream>
+#include <atomic>
+#include <mutex>
 
 namespace badgerdb {
 
@@ -44,7 +46,7 @@ class BufDesc {
 	/**
    * Number of times this page has been pinned
 	 */
-  int pinCnt;
+  std::atomic<int> pinCnt;
 
 	/**
    * True if page is dirty;  false otherwise
@@ -59,7 +61,7 @@ class BufDesc {
 	/**
    * Has this buffer frame been reference recently
 	 */
-  bool refbit;
+  std::atomic<bool> refbit;
 
 	/**
    * Initialize buffer frame for a new user
@@ -137,12 +139,17 @@ struct BufStats
 	 */
   int diskwrites;
 
+	/**
+   * Number of pages asked to be read ahead of time through prefetchPages()
+	 */
+  int prefetches;
+
 	/**
    * Clear all values 
 	 */
   void clear()
   {
-		accesses = diskreads = diskwrites = 0;
+		accesses = diskreads = diskwrites = prefetches = 0;
   }
       
 	/**
@@ -155,8 +162,18 @@ struct BufStats
 };
 
 
+/**
+* @brief Number of mutexes the buckets of the hash table of the buffer pool are divided among
+*/
+const int BUFLOCKSTRIPES = 64;
+
 /**
 * @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
+*
+* Its methods may be called from several threads at once. A pinned page stays in its frame, so its contents
+* are used without going through the buffer manager, and threads sharing a page coordinate among themselves.
+* Pinning a page already in the buffer pool and unpinning a page only take the mutex of the stripe of the
+* hash table holding the page, so that threads using different pages do not wait on each other.
 */
 class BufMgr 
 {
@@ -186,6 +203,39 @@ class BufMgr
 	 */
   BufStats bufStats;
 
+	/**
+   * Serializes the calls that assign frames to pages or take them back, including the reads and writes of
+   * files they make. Taken before the mutex of a stripe when both are held
+	 */
+  std::mutex bufMutex;
+
+	/**
+   * Guard the buckets of the hash table, the pages in them from being taken out of their frames, and the
+   * pin counts of their frames. A bucket is guarded by the mutex its index falls on modulo BUFLOCKSTRIPES
+	 */
+  std::mutex stripeMutexes[BUFLOCKSTRIPES];
+
+	/**
+	 * Returns the mutex of the stripe of the hash table a page falls in.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 */
+  std::mutex& stripeMutex(const File* file, const PageId pageNo)
+  {
+		return stripeMutexes[hashTable->hash(file, pageNo) % BUFLOCKSTRIPES];
+  }
+
+	/**
+	 * Pins a page if it is in the buffer pool, holding only the mutex of its stripe.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param page  	Reference to page pointer, set to the frame of the page if it is found
+	 * @return				True if the page was in the buffer pool and was pinned
+	 */
+  bool pinIfPresent(File* file, const PageId pageNo, Page*& page);
+
 	/**
    * Advance clock to next frame in the buffer pool
 	 */
@@ -195,7 +245,7 @@ class BufMgr
   }
 
 	/**
-	 * Allocate a free frame.  
+	 * Allocate a free frame. Called holding bufMutex.
 	 *
 	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
 	 * @throws BufferExceededException If no such buffer is found which can be allocated
@@ -226,8 +276,19 @@ class BufMgr
 	 * @param file   	File object
 	 * @param PageNo  Page number in the file to be read
 	 * @param page  	Reference to page pointer. Used to fetch the Page object in which requested page from file is read in.
+	 * @return				True if the page was already in the buffer pool, false if it was read from the file
+	 */
+  bool readPage(File* file, const PageId PageNo, Page*& page);
+
+	/**
+	 * Starts reading pages of the file from disk in the background, ahead of the calls of readPage() that
+	 * will need them. Pages already in the buffer pool are left out. Returns without waiting for the reads.
+	 *
+	 * @param file   	File object
+	 * @param pageNos	Page numbers in the file
+	 * @param count		Number of pages
 	 */
-  void readPage(File* file, const PageId PageNo, Page*& page);
+  void prefetchPages(File* file, const PageId* pageNos, const std::size_t count);
 
 	/**
 	 * Unpin a page from memory since it is no longer required for it to remain in memory.
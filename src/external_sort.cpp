@@ -0,0 +1,432 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <sstream>
+#include <utility>
+#include "external_sort.h"
+
+namespace badgerdb
+{
+
+// -----------------------------------------------------------------------------
+// ExternalSort::ExternalSort -- Constructor
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    ExternalSort<T>::ExternalSort(FileScan& scan,
+                                  const int attrByteOffset,
+                                  BufMgr* bufMgrIn,
+                                  const std::string& runPrefix,
+                                  const std::uint32_t budgetFrames,
+                                  const unsigned numThreads,
+                                  const CompositeKeyFormat& keyFormat)
+    {
+        bufMgr = bufMgrIn;
+        this->runPrefix = runPrefix;
+        runsCreated = 0;
+        this->budgetFrames = std::max(budgetFrames, (std::uint32_t) 3);
+        this->numThreads = numThreads > 0 ? numThreads : std::max(std::thread::hardware_concurrency(), 1u);
+        numEntries = 0;
+        inMemoryPos = 0;
+
+        // the chunk being filled and the chunks held by the workers share the budget
+        std::size_t chunkSize = std::max((std::size_t) 1,
+                (std::size_t) this->budgetFrames * Page::SIZE / sizeof(RIDKeyPair<T>) / (this->numThreads + 1));
+
+        // workers still writing their runs, oldest first
+        std::vector<std::pair<std::thread*, Run*> > workers;
+        std::vector<RIDKeyPair<T> >* chunk = NULL;
+        try
+        {
+            chunk = new std::vector<RIDKeyPair<T> >();
+            chunk->reserve(chunkSize);
+            bool spilled = false;
+
+            while(true)
+            {
+                RecordId rid;
+                if (!scan.tryScanNext(rid))
+                {
+                    break;
+                }
+                std::string recordStr = scan.getRecord();
+                RIDKeyPair<T> entry;
+                entry.set(rid, keyFromRecord<T>(recordStr.c_str(), attrByteOffset, keyFormat));
+                chunk->push_back(entry);
+                numEntries++;
+
+                // chunk is full, hand it over to a worker to sort and write out
+                if (chunk->size() == chunkSize)
+                {
+                    if (workers.size() == this->numThreads)
+                    {
+                        joinWorker(workers);
+                    }
+                    startWorker(workers, chunk);
+                    spilled = true;
+
+                    chunk = new std::vector<RIDKeyPair<T> >();
+                    chunk->reserve(chunkSize);
+                }
+            }
+
+            if (!spilled)
+            {
+                // everything fit into memory, no need for runs
+                inMemory.swap(*chunk);
+                delete chunk;
+                chunk = NULL;
+                std::sort(inMemory.begin(), inMemory.end());
+                return;
+            }
+
+            if (chunk->empty())
+            {
+                delete chunk;
+                chunk = NULL;
+            }
+            else
+            {
+                startWorker(workers, chunk);
+            }
+            while (!workers.empty())
+            {
+                joinWorker(workers);
+            }
+
+            // one frame goes to each run being merged plus one to the output of intermediate merges
+            std::size_t fanIn = this->budgetFrames - 1;
+            while (runs.size() > fanIn + 1)
+            {
+                mergeRuns(fanIn);
+            }
+
+            // set up the final merge, a run is the cursor's to remove once it is open
+            while (!runs.empty())
+            {
+                openCursor(runs.front(), cursors, heap);
+                runs.erase(runs.begin());
+            }
+        }
+        catch (...)
+        {
+            // the destructor does not run for an object whose constructor throws. A thread object destroyed
+            // before its thread is joined ends the program, so every worker is waited for before its run goes
+            for (std::size_t i = 0; i < workers.size(); i++)
+            {
+                if (workers[i].first != NULL)
+                {
+                    workers[i].first->join();
+                    delete workers[i].first;
+                }
+                if (workers[i].second->file != NULL)
+                {
+                    removeRun(*workers[i].second);
+                }
+                delete workers[i].second;
+            }
+            delete chunk;
+            for (std::size_t i = 0; i < cursors.size(); i++)
+            {
+                closeCursor(cursors[i]);
+            }
+            for (std::size_t i = 0; i < runs.size(); i++)
+            {
+                removeRun(runs[i]);
+            }
+            throw;
+        }
+    }
+
+// -----------------------------------------------------------------------------
+// ExternalSort::startWorker
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    void ExternalSort<T>::startWorker(std::vector<std::pair<std::thread*, Run*> >& workers,
+                                      std::vector<RIDKeyPair<T> >*& chunk)
+    {
+        // the worker is listed before anything that can throw, so that its run is cleaned up either way
+        Run* run = new Run();
+        run->file = NULL;
+        workers.push_back(std::make_pair((std::thread*) NULL, run));
+        run->file = createRunFile();
+        workers.back().first = new std::thread(writeRun, chunk, run);
+
+        // the chunk is the worker's to release now
+        chunk = NULL;
+    }
+
+// -----------------------------------------------------------------------------
+// ExternalSort::joinWorker
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    void ExternalSort<T>::joinWorker(std::vector<std::pair<std::thread*, Run*> >& workers)
+    {
+        std::thread* thread = workers.front().first;
+        Run* run = workers.front().second;
+        thread->join();
+        delete thread;
+        workers.erase(workers.begin());
+        try
+        {
+            runs.push_back(*run);
+        }
+        catch (...)
+        {
+            removeRun(*run);
+            delete run;
+            throw;
+        }
+        delete run;
+    }
+
+// -----------------------------------------------------------------------------
+// ExternalSort::~ExternalSort -- destructor
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    ExternalSort<T>::~ExternalSort()
+    {
+        for (std::size_t i = 0; i < cursors.size(); i++)
+        {
+            closeCursor(cursors[i]);
+        }
+        for (std::size_t i = 0; i < runs.size(); i++)
+        {
+            removeRun(runs[i]);
+        }
+    }
+
+// -----------------------------------------------------------------------------
+// ExternalSort::next
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    bool ExternalSort<T>::next(RIDKeyPair<T>& out)
+    {
+        if (cursors.empty())
+        {
+            if (inMemoryPos >= inMemory.size())
+            {
+                return false;
+            }
+            out = inMemory[inMemoryPos++];
+            return true;
+        }
+        return popNext(cursors, heap, out);
+    }
+
+// -----------------------------------------------------------------------------
+// ExternalSort::createRunFile
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    BlobFile* ExternalSort<T>::createRunFile()
+    {
+        std::ostringstream nameStr;
+        nameStr << runPrefix << ".run" << runsCreated++;
+        std::string name = nameStr.str();
+
+        // clean up a run left behind by a previous build that crashed
+        if (File::exists(name))
+        {
+            File::remove(name);
+        }
+        return new BlobFile(name, true);
+    }
+
+// -----------------------------------------------------------------------------
+// ExternalSort::writeRun
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    void ExternalSort<T>::writeRun(std::vector<RIDKeyPair<T> >* chunk, Run* run)
+    {
+        std::sort(chunk->begin(), chunk->end());
+
+        const int perPage = SortRunPage<T>::CAPACITY;
+        run->numPages = 0;
+        std::size_t pos = 0;
+        while (pos < chunk->size())
+        {
+            PageId pageNum;
+            Page page = run->file->allocatePage(pageNum);
+            if (run->numPages == 0)
+            {
+                run->firstPageNum = pageNum;
+            }
+
+            SortRunPage<T>* runPage = (SortRunPage<T>*) &page;
+            runPage->numEntries = std::min((std::size_t) perPage, chunk->size() - pos);
+            std::copy(chunk->begin() + pos, chunk->begin() + pos + runPage->numEntries, runPage->entries);
+            run->file->writePage(pageNum, page);
+
+            pos += runPage->numEntries;
+            run->numPages++;
+        }
+        delete chunk;
+    }
+
+// -----------------------------------------------------------------------------
+// ExternalSort::mergeRuns
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    void ExternalSort<T>::mergeRuns(std::size_t count)
+    {
+        std::vector<RunCursor> mergeCursors;
+        std::priority_queue<HeapEntry> mergeHeap;
+        for (std::size_t i = 0; i < count; i++)
+        {
+            openCursor(runs[i], mergeCursors, mergeHeap);
+        }
+        runs.erase(runs.begin(), runs.begin() + count);
+
+        Run merged;
+        merged.file = createRunFile();
+        merged.numPages = 0;
+
+        const int perPage = SortRunPage<T>::CAPACITY;
+        Page* page = NULL;
+        PageId pageNum = 0;
+        SortRunPage<T>* runPage = NULL;
+        RIDKeyPair<T> entry;
+        while (popNext(mergeCursors, mergeHeap, entry))
+        {
+            if (runPage == NULL || runPage->numEntries == perPage)
+            {
+                if (page != NULL)
+                {
+                    bufMgr->unPinPage(merged.file, pageNum, true);
+                }
+                bufMgr->allocPage(merged.file, pageNum, page);
+                if (merged.numPages == 0)
+                {
+                    merged.firstPageNum = pageNum;
+                }
+                merged.numPages++;
+                runPage = (SortRunPage<T>*) page;
+                runPage->numEntries = 0;
+            }
+            runPage->entries[runPage->numEntries++] = entry;
+        }
+        if (page != NULL)
+        {
+            bufMgr->unPinPage(merged.file, pageNum, true);
+        }
+
+        runs.push_back(merged);
+    }
+
+// -----------------------------------------------------------------------------
+// ExternalSort::openCursor
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    void ExternalSort<T>::openCursor(const Run& run, std::vector<RunCursor>& cursorList,
+                                     std::priority_queue<HeapEntry>& mergeHeap)
+    {
+        RunCursor cursor;
+        cursor.run = run;
+        cursor.pageNum = run.firstPageNum;
+        cursor.nextEntry = 0;
+        bufMgr->readPage(run.file, cursor.pageNum, cursor.page);
+        cursorList.push_back(cursor);
+
+        HeapEntry head;
+        head.pair = ((SortRunPage<T>*) cursor.page)->entries[0];
+        head.cursor = cursorList.size() - 1;
+        mergeHeap.push(head);
+        cursorList.back().nextEntry = 1;
+    }
+
+// -----------------------------------------------------------------------------
+// ExternalSort::popNext
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    bool ExternalSort<T>::popNext(std::vector<RunCursor>& cursorList,
+                                  std::priority_queue<HeapEntry>& mergeHeap,
+                                  RIDKeyPair<T>& out)
+    {
+        if (mergeHeap.empty())
+        {
+            return false;
+        }
+
+        HeapEntry head = mergeHeap.top();
+        mergeHeap.pop();
+        out = head.pair;
+
+        // refill the heap from the run the entry came from
+        RunCursor& cursor = cursorList[head.cursor];
+        if (cursor.page == NULL)
+        {
+            return true;
+        }
+        SortRunPage<T>* runPage = (SortRunPage<T>*) cursor.page;
+        if (cursor.nextEntry >= runPage->numEntries)
+        {
+            bufMgr->unPinPage(cursor.run.file, cursor.pageNum, false);
+            cursor.pageNum++;
+            if (cursor.pageNum >= cursor.run.firstPageNum + cursor.run.numPages)
+            {
+                // run is exhausted
+                closeCursor(cursor);
+                return true;
+            }
+            bufMgr->readPage(cursor.run.file, cursor.pageNum, cursor.page);
+            runPage = (SortRunPage<T>*) cursor.page;
+            cursor.nextEntry = 0;
+        }
+
+        head.pair = runPage->entries[cursor.nextEntry++];
+        mergeHeap.push(head);
+        return true;
+    }
+
+// -----------------------------------------------------------------------------
+// ExternalSort::closeCursor
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    void ExternalSort<T>::closeCursor(RunCursor& cursor)
+    {
+        if (cursor.run.file == NULL)
+        {
+            return;
+        }
+        if (cursor.page != NULL && cursor.pageNum < cursor.run.firstPageNum + cursor.run.numPages)
+        {
+            bufMgr->unPinPage(cursor.run.file, cursor.pageNum, false);
+        }
+        cursor.page = NULL;
+        removeRun(cursor.run);
+        cursor.run.file = NULL;
+    }
+
+// -----------------------------------------------------------------------------
+// ExternalSort::removeRun
+// -----------------------------------------------------------------------------
+
+    template <class T>
+    void ExternalSort<T>::removeRun(const Run& run)
+    {
+        std::string name = run.file->filename();
+        bufMgr->flushFile(run.file);
+        delete run.file;
+        File::remove(name);
+    }
+
+    template class ExternalSort<int>;
+    template class ExternalSort<double>;
+    template class ExternalSort<StringKey>;
+    template class ExternalSort<CompositeKey>;
+}
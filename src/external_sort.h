@@ -0,0 +1,274 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <queue>
+#include <utility>
+#include <thread>
+
+#include "types.h"
+#include "page.h"
+#include "file.h"
+#include "buffer.h"
+#include "filescan.h"
+#include "btree.h"
+
+namespace badgerdb
+{
+
+/**
+ * @brief Default number of buffer frames worth of memory an index build may use for sorting.
+ */
+const std::uint32_t SORTBUFFERFRAMES = 32;
+
+/**
+ * @brief Layout of a page of a sorted run. Runs are temporary BlobFiles whose pages are cast to
+ * this structure.
+ */
+template <class T>
+struct SortRunPage{
+  /**
+   * Number of entries that fit on a page.
+   */
+	static const int CAPACITY = ( Page::SIZE - sizeof( int ) ) / sizeof( RIDKeyPair<T> );
+
+  /**
+   * Number of entries stored on this page.
+   */
+	int numEntries;
+
+  /**
+   * Stores the entries of the run, in ascending order.
+   */
+	RIDKeyPair<T> entries[ CAPACITY ];
+};
+
+/**
+ * @brief External merge sort of the <key, rid> pairs of a relation.
+ *
+ * The input is read through a FileScan and cut into chunks that fit the memory budget. Each chunk is
+ * sorted and written out as a run to a temporary BlobFile by a worker thread while the scan goes on.
+ * If the whole input fits into a single chunk it is sorted in memory and no run is written.
+ * Runs are then merged through the buffer manager with one pinned frame per run; if there are more
+ * runs than the budget allows, groups of them are merged into longer runs first. The final k-way
+ * merge is exposed as an iterator through next().
+ *
+ * Worker threads write their runs directly to their own files and never touch the buffer manager, so the
+ * runs being written take no frames from the budget of the merge and do not wait on the buffer pool.
+ */
+template <class T>
+class ExternalSort {
+
+ private:
+
+  /**
+   * A sorted run stored in a temporary file.
+   */
+	struct Run {
+		/**
+		 * File holding the run.
+		 */
+		BlobFile* file;
+
+		/**
+		 * Number of the first page of the run.
+		 */
+		PageId firstPageNum;
+
+		/**
+		 * Number of pages in the run.
+		 */
+		PageId numPages;
+	};
+
+  /**
+   * Position of the merge inside one run. Its current page stays pinned in the buffer pool.
+   */
+	struct RunCursor {
+		/**
+		 * Run being read.
+		 */
+		Run run;
+
+		/**
+		 * Number of the page currently pinned.
+		 */
+		PageId pageNum;
+
+		/**
+		 * Page currently pinned.
+		 */
+		Page* page;
+
+		/**
+		 * Index of the next entry to be read on the current page.
+		 */
+		int nextEntry;
+	};
+
+  /**
+   * Heap element of the k-way merge, the head entry of a run cursor.
+   */
+	struct HeapEntry {
+		RIDKeyPair<T> pair;
+		int cursor;
+
+		bool operator<( const HeapEntry& rhs ) const
+		{
+			// priority_queue is a max heap, so order is reversed
+			return rhs.pair < pair;
+		}
+	};
+
+  /**
+   * Buffer Manager Instance.
+   */
+	BufMgr* bufMgr;
+
+  /**
+   * Prefix of the names of temporary run files.
+   */
+	std::string runPrefix;
+
+  /**
+   * Number of run files created so far, used to name new ones.
+   */
+	int runsCreated;
+
+  /**
+   * Number of buffer frames the sort may use.
+   */
+	std::uint32_t budgetFrames;
+
+  /**
+   * Number of worker threads generating runs.
+   */
+	unsigned numThreads;
+
+  /**
+   * Total number of entries read from the input.
+   */
+	std::size_t numEntries;
+
+  /**
+   * Runs that are still to be merged.
+   */
+	std::vector<Run> runs;
+
+  /**
+   * Entries of the input, sorted, when it fit into memory and no run was written.
+   */
+	std::vector<RIDKeyPair<T> > inMemory;
+
+  /**
+   * Position of the iterator in inMemory.
+   */
+	std::size_t inMemoryPos;
+
+  /**
+   * Cursors of the final merge.
+   */
+	std::vector<RunCursor> cursors;
+
+  /**
+   * Head entries of the cursors of the final merge.
+   */
+	std::priority_queue<HeapEntry> heap;
+
+  /**
+   * Creates a new, empty temporary run file.
+   */
+	BlobFile* createRunFile();
+
+  /**
+   * Creates a run file and starts a worker writing a chunk to it, appending the worker to the list.
+   * @param workers		Workers still writing their runs, oldest first
+   * @param chunk		Entries for the worker, which releases them. Set to NULL once handed over.
+   */
+	void startWorker(std::vector<std::pair<std::thread*, Run*> >& workers, std::vector<RIDKeyPair<T> >*& chunk);
+
+  /**
+   * Waits for the oldest worker and adds its run to the runs to merge.
+   * @param workers		Workers still writing their runs, oldest first
+   */
+	void joinWorker(std::vector<std::pair<std::thread*, Run*> >& workers);
+
+  /**
+   * Sorts a chunk of entries and writes it out as a run. Runs on a worker thread.
+   * @param chunk		Entries to sort and write, released when done
+   * @param run			Run to write the chunk to. Its file must already be created.
+   */
+	static void writeRun(std::vector<RIDKeyPair<T> >* chunk, Run* run);
+
+  /**
+   * Opens a cursor on the first page of a run and pushes its first entry on the heap.
+   */
+	void openCursor(const Run& run, std::vector<RunCursor>& cursorList,
+			std::priority_queue<HeapEntry>& mergeHeap);
+
+  /**
+   * Pops the smallest entry of a merge, advancing the run it came from.
+   * @return False if every run of the merge has been consumed
+   */
+	bool popNext(std::vector<RunCursor>& cursorList, std::priority_queue<HeapEntry>& mergeHeap,
+			RIDKeyPair<T>& out);
+
+  /**
+   * Closes a cursor, removing its run file.
+   */
+	void closeCursor(RunCursor& cursor);
+
+  /**
+   * Merges the first count runs into a single run appended to the list of runs.
+   */
+	void mergeRuns(std::size_t count);
+
+  /**
+   * Removes the file of a run that will not be read anymore.
+   */
+	void removeRun(const Run& run);
+
+ public:
+
+  /**
+   * Sorts the <key, rid> pairs of every record of a scan, and prepares the final merge.
+   *
+   * @param scan						Scan over the records of the relation, read till its end
+   * @param attrByteOffset	Offset of the key attribute in the record
+   * @param bufMgrIn				Buffer Manager Instance used for merging
+   * @param runPrefix				Prefix of names of the temporary run files
+   * @param budgetFrames		Number of buffer frames of memory the sort may use, at least 3
+   * @param numThreads			Number of worker threads writing runs, 0 to use the number of cores
+   * @param keyFormat				Attributes of the key of a COMPOSITE index, which it is built from instead of
+   * the attribute at attrByteOffset
+   */
+	ExternalSort(FileScan& scan, const int attrByteOffset, BufMgr* bufMgrIn, const std::string& runPrefix,
+			const std::uint32_t budgetFrames = SORTBUFFERFRAMES, const unsigned numThreads = 0,
+			const CompositeKeyFormat& keyFormat = CompositeKeyFormat());
+
+  /**
+   * Unpins any pages of the merge and removes the remaining temporary run files.
+   */
+	~ExternalSort();
+
+  /**
+   * Total number of entries being sorted.
+   */
+	std::size_t size() const { return numEntries; }
+
+  /**
+   * Fetch the next entry of the sorted output.
+   * @param out		Next entry in ascending order is returned in this
+   * @return False if all entries have been returned
+   */
+	bool next(RIDKeyPair<T>& out);
+};
+
+}
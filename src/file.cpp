@@ -13,6 +13,8 @@
 #include <string>
 #include <cstdio>
 #include <cassert>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "exceptions/file_exists_exception.h"
 #include "exceptions/file_not_found_exception.h"
@@ -25,6 +27,7 @@ namespace badgerdb {
 
 File::StreamMap File::open_streams_;
 File::CountMap File::open_counts_;
+File::DescriptorMap File::open_descriptors_;
 
 void File::remove(const std::string& filename) {
   if (!exists(filename)) {
@@ -64,7 +67,7 @@ PageId File::getFirstPageNo() {
   return header.first_used_page;
 }
 
-File::File(const std::string& name, const bool create_new) : filename_(name) {
+File::File(const std::string& name, const bool create_new) : filename_(name), descriptor_(-1) {
   openIfNeeded(create_new);
 
   if (create_new) {
@@ -79,6 +82,7 @@ void File::openIfNeeded(const bool create_new) {
   if (open_counts_.find(filename_) != open_counts_.end()) {	//exists an entry already
     ++open_counts_[filename_];
     stream_ = open_streams_[filename_];
+    descriptor_ = open_descriptors_[filename_];
   } else {
     std::ios_base::openmode mode =
         std::fstream::in | std::fstream::out | std::fstream::binary;
@@ -99,6 +103,11 @@ void File::openIfNeeded(const bool create_new) {
     stream_.reset(new std::fstream(filename_, mode));
     open_streams_[filename_] = stream_;
     open_counts_[filename_] = 1;
+
+    // Opened along with the stream, so that readahead needs no system call
+    // to find the file and keeps working if the file is renamed or removed.
+    descriptor_ = ::open(filename_.c_str(), O_RDONLY);
+    open_descriptors_[filename_] = descriptor_;
   }
 }
 
@@ -110,9 +119,28 @@ void File::close() {
 	assert(open_counts_[filename_] >= 0);
 
   if (open_counts_[filename_] == 0) {
+    if (descriptor_ >= 0) {
+      ::close(descriptor_);
+    }
     open_streams_.erase(filename_);
     open_counts_.erase(filename_);
+    open_descriptors_.erase(filename_);
+  }
+  descriptor_ = -1;
+}
+
+void File::prefetchPages(const PageId* page_numbers, const std::size_t count) const {
+#ifdef POSIX_FADV_WILLNEED
+  // The advice applies to the file, not to the descriptor, so a descriptor of
+  // its own leaves the shared stream alone.
+  if (descriptor_ < 0) {
+    return;
+  }
+  for (std::size_t i = 0; i < count; ++i) {
+    posix_fadvise(descriptor_, pagePosition(page_numbers[i]), Page::SIZE,
+                  POSIX_FADV_WILLNEED);
   }
+#endif
 }
 
 FileHeader File::readHeader() const {
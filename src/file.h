@@ -150,6 +150,17 @@ class File {
    */
   virtual void deletePage(const PageId page_number) = 0;
 
+  /**
+   * Tells the operating system that the given pages will be read soon, so that
+   * it can start reading them from disk in the background. Returns without
+   * waiting for the reads, and does nothing where the system offers no way to
+   * do this.
+   *
+   * @param page_numbers  Numbers of the pages.
+   * @param count         Number of pages.
+   */
+  void prefetchPages(const PageId* page_numbers, const std::size_t count) const;
+
   /**
    * Returns the name of the file this object represents.
    *
@@ -212,6 +223,7 @@ class File {
 
   typedef std::map<std::string, std::shared_ptr<std::fstream> > StreamMap;
   typedef std::map<std::string, int> CountMap;
+  typedef std::map<std::string, int> DescriptorMap;
 
   /**
    * Streams for opened files.
@@ -223,6 +235,12 @@ class File {
    */
   static CountMap open_counts_;
 
+  /**
+   * Read-only descriptors for opened files, used to advise the system of
+   * reads ahead. Opened and closed along with the streams.
+   */
+  static DescriptorMap open_descriptors_;
+
   /**
    * Name of the file this object represents.
    */
@@ -233,6 +251,12 @@ class File {
    */
   std::shared_ptr<std::fstream> stream_;
 
+  /**
+   * Read-only descriptor of the underlying file, shared like the stream, or
+   * -1 if it could not be opened.
+   */
+  int descriptor_;
+
   friend class FileIterator;
 };
 
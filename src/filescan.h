@@ -31,6 +31,9 @@ class FileScan
   //return RecordId of next record that satisfies the scan 
   void scanNext(RecordId& outRid);
 
+  //return RecordId of next record that satisfies the scan, or false at the end of the file
+  bool tryScanNext(RecordId& outRid);
+
   //read current record, returning pointer and length
   std::string getRecord();
 
@@ -0,0 +1,228 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include "types.h"
+
+namespace badgerdb
+{
+
+/**
+ * @brief Reader/writer latch guarding one node of a B+ tree while a thread works on it.
+ * Latches are held for a few instructions at a time, so waiting threads yield the processor
+ * instead of sleeping. A waiting writer keeps new readers out, so that it is not starved by them.
+ * Each release in exclusive mode counts as a change of the node, which lets a reader coming back
+ * to a node tell whether it changed in the meantime. The same count lets a reader go through a node
+ * without latching it at all, reading it optimistically and checking afterwards with readVersion()
+ * and validate() that no writer got in the way.
+ *
+ * @warning A thread must not latch the same node twice.
+ */
+class NodeLatch
+{
+ private:
+	static const std::uint32_t WRITER = 1u << 31;
+	static const std::uint32_t WRITER_WAITING = 1u << 30;
+
+	/**
+	 * WRITER if held in exclusive mode, otherwise the number of readers holding it, with
+	 * WRITER_WAITING set while a writer waits for them to leave.
+	 */
+	std::atomic<std::uint32_t> state;
+
+	/**
+	 * Number of times the latch was released in exclusive mode.
+	 */
+	std::atomic<std::uint64_t> changes;
+
+ public:
+	NodeLatch() : state(0), changes(0) {}
+
+	NodeLatch(const NodeLatch&) = delete;
+	NodeLatch& operator=(const NodeLatch&) = delete;
+
+	/**
+	 * Acquires the latch in shared mode.
+	 */
+	void lockShared()
+	{
+		while (true)
+		{
+			std::uint32_t s = state.load(std::memory_order_relaxed);
+			if (!(s & (WRITER | WRITER_WAITING)) &&
+					state.compare_exchange_weak(s, s + 1, std::memory_order_acquire))
+			{
+				return;
+			}
+			std::this_thread::yield();
+		}
+	}
+
+	/**
+	 * Releases the latch held in shared mode.
+	 */
+	void unlockShared()
+	{
+		state.fetch_sub(1, std::memory_order_release);
+	}
+
+	/**
+	 * Acquires the latch in exclusive mode. Named after std::mutex so that std::lock_guard can hold it.
+	 */
+	void lock()
+	{
+		while (true)
+		{
+			std::uint32_t s = state.load(std::memory_order_relaxed);
+			if ((s & ~WRITER_WAITING) == 0 &&
+					state.compare_exchange_weak(s, WRITER, std::memory_order_acquire))
+			{
+				// optimistic readers that see a change made under the latch must also see the latch taken
+				std::atomic_thread_fence(std::memory_order_release);
+				return;
+			}
+			if (!(s & WRITER_WAITING))
+			{
+				state.fetch_or(WRITER_WAITING, std::memory_order_relaxed);
+			}
+			std::this_thread::yield();
+		}
+	}
+
+	/**
+	 * Releases the latch held in exclusive mode, counting a change of the node.
+	 */
+	void unlock()
+	{
+		changes.fetch_add(1, std::memory_order_release);
+		state.store(0, std::memory_order_release);
+	}
+
+	/**
+	 * Starts an optimistic read of the node, without latching it.
+	 * @param v	Version to pass to validate() once the node is read
+	 * @return	False if a writer holds the latch, in which case the node must not be read
+	 */
+	bool readVersion(std::uint64_t& v) const
+	{
+		v = changes.load(std::memory_order_acquire);
+		return !(state.load(std::memory_order_acquire) & WRITER);
+	}
+
+	/**
+	 * Checks that no writer took the latch since readVersion() returned v, in which case
+	 * everything read from the node in between is consistent.
+	 */
+	bool validate(const std::uint64_t v) const
+	{
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return !(state.load(std::memory_order_relaxed) & WRITER) &&
+			changes.load(std::memory_order_relaxed) == v;
+	}
+
+	/**
+	 * Returns the number of changes of the node so far. Only meaningful while the latch is held.
+	 */
+	std::uint64_t version() const
+	{
+		return changes.load(std::memory_order_relaxed);
+	}
+};
+
+/**
+ * @brief Holds a NodeLatch in shared mode for the lifetime of the guard.
+ */
+class SharedLatchGuard
+{
+ private:
+	NodeLatch& latch;
+
+ public:
+	explicit SharedLatchGuard(NodeLatch& l) : latch(l) { latch.lockShared(); }
+	~SharedLatchGuard() { latch.unlockShared(); }
+
+	SharedLatchGuard(const SharedLatchGuard&) = delete;
+	SharedLatchGuard& operator=(const SharedLatchGuard&) = delete;
+};
+
+/**
+ * @brief Latches of the nodes of an index file, looked up by page number. Latches are allocated
+ * in chunks the first time a page in the chunk is latched and live as long as the table,
+ * so that a latch never moves while a thread waits on it.
+ */
+class LatchTable
+{
+ private:
+	static const std::uint32_t CHUNK_BITS = 12;
+	static const std::uint32_t CHUNK_SIZE = 1u << CHUNK_BITS;
+
+	/**
+	 * Number of chunks, enough for index files of 2^26 pages.
+	 */
+	static const std::uint32_t NUM_CHUNKS = 1u << 14;
+
+	std::atomic<NodeLatch*> chunks[NUM_CHUNKS];
+
+	/**
+	 * Serializes the allocation of chunks.
+	 */
+	std::mutex chunkMutex;
+
+ public:
+	LatchTable()
+	{
+		for (std::uint32_t i = 0; i < NUM_CHUNKS; i++)
+		{
+			chunks[i].store(NULL, std::memory_order_relaxed);
+		}
+	}
+
+	~LatchTable()
+	{
+		for (std::uint32_t i = 0; i < NUM_CHUNKS; i++)
+		{
+			delete [] chunks[i].load(std::memory_order_relaxed);
+		}
+	}
+
+	LatchTable(const LatchTable&) = delete;
+	LatchTable& operator=(const LatchTable&) = delete;
+
+	/**
+	 * Returns the latch of a page.
+	 * @throws std::out_of_range If the page number is beyond the pages the table can hold
+	 */
+	NodeLatch& operator[](const PageId pageNo)
+	{
+		std::uint32_t chunk = pageNo >> CHUNK_BITS;
+		if (chunk >= NUM_CHUNKS)
+		{
+			throw std::out_of_range("page number beyond the latch table");
+		}
+
+		NodeLatch* latches = chunks[chunk].load(std::memory_order_acquire);
+		if (latches == NULL)
+		{
+			std::lock_guard<std::mutex> lock(chunkMutex);
+			latches = chunks[chunk].load(std::memory_order_relaxed);
+			if (latches == NULL)
+			{
+				latches = new NodeLatch[CHUNK_SIZE];
+				chunks[chunk].store(latches, std::memory_order_release);
+			}
+		}
+		return latches[pageNo & (CHUNK_SIZE - 1)];
+	}
+};
+
+}
@@ -6,21 +6,34 @@
  */
 
 #include <vector>
+#include <limits>
+#include <fstream>
+#include <cmath>
 #include "btree.h"
 #include "page.h"
 #include "filescan.h"
+#include "bitmapscan.h"
+#include "external_sort.h"
+#include "node_search.h"
 #include "page_iterator.h"
 #include "file_iterator.h"
 #include "exceptions/insufficient_space_exception.h"
 #include "exceptions/index_scan_completed_exception.h"
 #include "exceptions/file_not_found_exception.h"
+#include "exceptions/file_open_exception.h"
 #include "exceptions/no_such_key_found_exception.h"
 #include "exceptions/bad_scanrange_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/bad_index_info_exception.h"
 #include <random>
 #include <chrono>
+#include <thread>
+#include <atomic>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 #define checkPassFail(a, b) 																				\
 {																																		\
@@ -70,8 +83,19 @@ void createRelationForward();
 void createRelationBackward();
 void createRelationRandom();
 void createRelationRandomSize(int relSize);
+void createRelationDuplicates(int numKeys);
 void intTests();
 int intScan(BTreeIndex *index, int lowVal, Operator lowOp, int highVal, Operator highOp);
+int doubleScan(BTreeIndex *index, double lowVal, Operator lowOp, double highVal, Operator highOp);
+int stringScan(BTreeIndex *index, std::string lowVal, Operator lowOp, std::string highVal, Operator highOp);
+template <class T>
+int keyScan(BTreeIndex *index, T lowVal, Operator lowOp, T highVal, Operator highOp);
+template <class T>
+bool batchScanMatches(BTreeIndex *index, T lowVal, Operator lowOp, T highVal, Operator highOp, size_t batchSize);
+int compositeScan(BTreeIndex* index, const CompositeKey& low, const CompositeKey& high, int lowI, int highI);
+int ridScan(BTreeIndex* index, int lowVal, Operator lowOp, int highVal, Operator highOp, size_t offset,
+	std::vector<RecordId>& outRids, ScanDirection direction = ASCENDING);
+bool descendingScanMatches(BTreeIndex* index, int lowVal, Operator lowOp, int highVal, Operator highOp);
 void indexTests();
 void largeTests(BTreeIndex *index);
 void emptyTests();
@@ -96,6 +120,32 @@ void test14();
 void test15();
 void test16();
 void test17();
+void test18();
+void test19();
+void test20();
+void test21();
+void test22();
+void test23();
+void test24();
+void test25();
+void test26();
+void test27();
+void test28();
+void test29();
+void test30();
+void test31();
+void test32();
+void test33();
+void test34();
+void test35();
+void test36();
+void test38();
+void test39();
+void test40();
+void test41();
+void test42();
+void test43();
+void test44();
 
 void errorTests();
 void deleteRelation();
@@ -175,6 +225,32 @@ int main(int argc, char **argv)
 	test15();
 	test16();
 	test17();
+	test18();
+	test19();
+	test20();
+	test21();
+	test22();
+	test23();
+	test24();
+	test25();
+	test26();
+	test27();
+	test28();
+	test29();
+	test30();
+	test31();
+	test32();
+	test33();
+	test34();
+	test35();
+	test36();
+	test38();
+	test39();
+	test40();
+	test41();
+	test42();
+	test43();
+	test44();
 	
 	errorTests();
 
@@ -224,7 +300,7 @@ void test4()
 	try
 	{
 		createRelationRandom();
-		BTreeIndex index = BTreeIndex(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
 		if (index.getNodeStatus())
 		{
 			std::cout << "Test 4 failed, no split occurred" << std::endl;;
@@ -257,7 +333,7 @@ void test5()
 	try
 	{
 		createRelationRandom();
-		BTreeIndex index = BTreeIndex(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
 		int lowval = 10;
 		int highval = 100;
 		index.startScan(&lowval, LT, &highval, GT);
@@ -285,7 +361,7 @@ void test6()
 	try
 	{
 		createRelationRandom();
-		BTreeIndex index = BTreeIndex(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
 		int lowval = 100;
 		int highval = 10;
 		index.startScan(&lowval, GT, &highval, LT);
@@ -314,7 +390,7 @@ void test7()
 	try
 	{
 		createRelationRandom();
-		BTreeIndex index = BTreeIndex(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
 		index.endScan();
 		std::cout << "Test 7 failed, endScan() ran without a Scan running" << std::endl;
 	}
@@ -340,7 +416,7 @@ void test8()
 	try
 	{
 		createRelationRandom();
-		BTreeIndex index = BTreeIndex(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
 		int lowval = 10;
 		int highval = 100;
 		index.startScan(&lowval, GT, &highval, LT);
@@ -382,7 +458,7 @@ void test9()
 	try
 	{
 		createRelationForward();
-		BTreeIndex index = BTreeIndex(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
 		if (index.getNodeStatus())
 		{
 			std::cout << "Test 9 failed, no split occurred" << std::endl;
@@ -415,7 +491,7 @@ void test10()
 	try
 	{
 		createRelationBackward();
-		BTreeIndex index = BTreeIndex(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
 		if (index.getNodeStatus())
 		{
 			std::cout << "Test 10 failed, no split occurred" << std::endl;
@@ -671,203 +747,2846 @@ void test17()
 	deleteRelation();
 }
 
-void allTests(BTreeIndex* index, int relSize)
+void test18()
 {
-	// checks that all entries from [0, relSize)) are in the B+ tree in one search
-	checkPassFail(intScan(index, 0,  GTE, relSize, LT), relSize)
-	// checks that all entries from [0, relSize)) are in the B+ tree individually
-	for (int i = 0; i < relSize; i++)
+	// inserts a second copy of every key, shifted by relationSize, into a bulk loaded tree whose
+	// leaves and nodes are packed, so every insert lands in a full node and has to split
+	std::cout << "Test 18: inserting into a bulk loaded B+ tree with specified capacities" << std::endl;
+	createRelationRandom();
+	try
 	{
-		checkPassFail(intScan(index,i, GTE, i + 1, LT), 1)
-		checkPassFail(intScan(index,i - 1, GT, i , LTE), 1)
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, 6, 4);
+		{
+			FileScan fscan(relationName, bufMgr);
+			try
+			{
+				RecordId scanRid;
+				while(1)
+				{
+					fscan.scanNext(scanRid);
+					std::string recordStr = fscan.getRecord();
+					int key = *((int *)(recordStr.c_str() + offsetof(RECORD, i))) + relationSize;
+					index.insertEntry(&key, scanRid);
+				}
+			}
+			catch(const EndOfFileException &e)
+			{
+			}
+		}
+		checkPassFail(intScan(&index, 0, GTE, 2 * relationSize, LT), 2 * relationSize)
+		checkPassFail(intScan(&index, relationSize - 10, GTE, relationSize + 10, LT), 20)
+		checkPassFail(intScan(&index, 2 * relationSize - 5, GT, 3 * relationSize, LTE), 4)
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Test 18 failed" << std::endl;
 	}
-}
-
-// -----------------------------------------------------------------------------
-// createRelationForward
-// -----------------------------------------------------------------------------
 
-void createRelationForward()
-{
-	std::vector<RecordId> ridVec;
-  // destroy any old copies of relation file
 	try
 	{
-		File::remove(relationName);
+		File::remove(intIndexName);
 	}
 	catch(const FileNotFoundException &e)
 	{
-	}
-
-  file1 = new PageFile(relationName, true);
 
-  // initialize all of record1.s to keep purify happy
-  memset(record1.s, ' ', sizeof(record1.s));
-	PageId new_page_number;
-  Page new_page = file1->allocatePage(new_page_number);
+	}
+	deleteRelation();
+}
 
-  // Insert a bunch of tuples into the relation.
-  for(int i = 0; i < relationSize; i++ )
+void test19()
+{
+	// sorts a relation with a budget of 3 frames, which forces many runs and several merge passes
+	std::cout << "Test 19: external sort of 100000 tuples with a 3 frame budget" << std::endl;
+	createRelationRandomSize(100000);
 	{
-    sprintf(record1.s, "%05d string record", i);
-    record1.i = i;
-    record1.d = (double)i;
-    std::string new_data(reinterpret_cast<char*>(&record1), sizeof(record1));
+		FileScan fscan(relationName, bufMgr);
+		ExternalSort<int> sorted(fscan, offsetof(tuple,i), bufMgr, relationName + ".test19", 3, 4);
 
-		while(1)
+		int count = 0;
+		RIDKeyPair<int> entry;
+		while (sorted.next(entry))
 		{
-			try
+			if (entry.key != count)
 			{
-    		new_page.insertRecord(new_data);
 				break;
 			}
-			catch(const InsufficientSpaceException &e)
-			{
-				file1->writePage(new_page_number, new_page);
-  			new_page = file1->allocatePage(new_page_number);
-			}
+			count++;
 		}
-  }
+		checkPassFail(count, 100000)
+	}
+	checkPassFail(File::exists(relationName + ".test19.run0"), false)
 
-	file1->writePage(new_page_number, new_page);
+	// a run file that cannot be created while workers are writing theirs fails the sort, which waits for
+	// the workers and leaves no runs behind
+	{
+		BlobFile stale(relationName + ".test19.run2", true);
+		bool thrown = false;
+		try
+		{
+			FileScan fscan(relationName, bufMgr);
+			ExternalSort<int> sorted(fscan, offsetof(tuple,i), bufMgr, relationName + ".test19", 3, 4);
+		}
+		catch(const FileOpenException &e)
+		{
+			thrown = true;
+		}
+		checkPassFail(thrown, true)
+		checkPassFail(File::exists(relationName + ".test19.run0"), false)
+		checkPassFail(File::exists(relationName + ".test19.run1"), false)
+	}
+	File::remove(relationName + ".test19.run2");
+	deleteRelation();
 }
 
-// -----------------------------------------------------------------------------
-// createRelationBackward
-// -----------------------------------------------------------------------------
-
-void createRelationBackward()
+void test20()
 {
-  // destroy any old copies of relation file
-	try
+	// micro-benchmark of the node search kernels on a full leaf, checking that they all agree
+	std::cout << "Test 20: node search kernels on a full leaf" << std::endl;
+	const int numLookups = 1000000;
+	std::vector<int> keys(INTARRAYLEAFSIZE);
+	for (int i = 0; i < INTARRAYLEAFSIZE; i++)
 	{
-		File::remove(relationName);
+		keys[i] = 2 * i;
 	}
-	catch(const FileNotFoundException &e)
+	std::vector<int> probes(numLookups);
+	std::mt19937 gen(20);
+	std::uniform_int_distribution<int> dist(-1, 2 * INTARRAYLEAFSIZE);
+	for (int i = 0; i < numLookups; i++)
 	{
+		probes[i] = dist(gen);
 	}
-  file1 = new PageFile(relationName, true);
 
-  // initialize all of record1.s to keep purify happy
-  memset(record1.s, ' ', sizeof(record1.s));
-	PageId new_page_number;
-  Page new_page = file1->allocatePage(new_page_number);
-
-  // Insert a bunch of tuples into the relation.
-  for(int i = relationSize - 1; i >= 0; i-- )
+	const SearchKernel kernels[] = { LINEAR_SEARCH, BINARY_SEARCH, SSE_SEARCH, AVX2_SEARCH };
+	const char* names[] = { "linear", "binary", "sse", "avx2" };
+	SearchKernel original = getSearchKernel();
+	for (int k = 0; k < 4; k++)
 	{
-    sprintf(record1.s, "%05d string record", i);
-    record1.i = i;
-    record1.d = i;
+		if (!setSearchKernel(kernels[k]))
+		{
+			std::cout << names[k] << ": not supported" << std::endl;
+			continue;
+		}
 
-    std::string new_data(reinterpret_cast<char*>(&record1), sizeof(RECORD));
+		int mismatches = 0;
+		long checksum = 0;
+		auto begin = std::chrono::high_resolution_clock::now();
+#if defined(__x86_64__) || defined(__i386__)
+		unsigned long long startCycles = __rdtsc();
+#endif
+		for (int i = 0; i < numLookups; i++)
+		{
+			checksum += searchLowerBound(&keys[0], INTARRAYLEAFSIZE, probes[i]);
+		}
+#if defined(__x86_64__) || defined(__i386__)
+		unsigned long long cycles = __rdtsc() - startCycles;
+#endif
+		auto end = std::chrono::high_resolution_clock::now();
+		auto durNs = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
 
-		while(1)
+		for (int i = 0; i < 1000; i++)
 		{
-			try
-			{
-    		new_page.insertRecord(new_data);
-				break;
-			}
-			catch(const InsufficientSpaceException &e)
+			int expected = std::lower_bound(keys.begin(), keys.end(), probes[i]) - keys.begin();
+			if (searchLowerBound(&keys[0], INTARRAYLEAFSIZE, probes[i]) != expected)
 			{
-				file1->writePage(new_page_number, new_page);
-  			new_page = file1->allocatePage(new_page_number);
+				mismatches++;
 			}
 		}
-  }
 
-	// write to page
-	file1->writePage(new_page_number, new_page);
+		std::cout << names[k] << ": " << (double) durNs / numLookups << " ns";
+#if defined(__x86_64__) || defined(__i386__)
+		std::cout << ", " << (double) cycles / numLookups << " cycles";
+#endif
+		std::cout << " per lookup (checksum " << checksum << ")" << std::endl;
+		checkPassFail(mismatches, 0)
+	}
+	setSearchKernel(original);
 }
 
-// -----------------------------------------------------------------------------
-// createRelationRandom
-// -----------------------------------------------------------------------------
-
-void createRelationRandom()
+void test21()
 {
-  // destroy any old copies of relation file
+	// the largest integer used to be the padding of unused key slots, so it could not be indexed
+	std::cout << "Test 21: indexing the largest and smallest integer keys" << std::endl;
+	createRelationRandom();
 	try
 	{
-		File::remove(relationName);
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+
+		RecordId firstRid;
+		{
+			FileScan fscan(relationName, bufMgr);
+			fscan.scanNext(firstRid);
+		}
+		int largest = std::numeric_limits<int>::max();
+		int smallest = std::numeric_limits<int>::min();
+		index.insertEntry(&largest, firstRid);
+		index.insertEntry(&smallest, firstRid);
+
+		checkPassFail(intScan(&index, largest - 1, GT, largest, LTE), 1)
+		checkPassFail(intScan(&index, largest, GT, largest, LTE), 0)
+		checkPassFail(intScan(&index, smallest, GTE, 0, LT), 1)
+		checkPassFail(intScan(&index, smallest, GTE, largest, LTE), relationSize + 2)
+		checkPassFail(intScan(&index, 0, GTE, largest, LT), relationSize)
 	}
-	catch(const FileNotFoundException &e)
+	catch(std::exception &e)
 	{
+		std::cout << "Test 21 failed" << std::endl;
 	}
-  file1 = new PageFile(relationName, true);
 
-  // initialize all of record1.s to keep purify happy
-  memset(record1.s, ' ', sizeof(record1.s));
-	PageId new_page_number;
-  Page new_page = file1->allocatePage(new_page_number);
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(const FileNotFoundException &e)
+	{
 
-  // insert records in random order
+	}
+	deleteRelation();
+}
 
-  std::vector<int> intvec(relationSize);
-  for( int i = 0; i < relationSize; i++ )
-  {
-    intvec[i] = i;
-  }
+void test22()
+{
+	// indexes the double attribute, once with full nodes and once with small ones that split a lot
+	std::cout << "Test 22: B+ tree on a DOUBLE attribute" << std::endl;
+	createRelationRandom();
+	const int occupancies[2][2] = { { DOUBLEARRAYNONLEAFSIZE, DOUBLEARRAYLEAFSIZE }, { 4, 6 } };
+	for (int o = 0; o < 2; o++)
+	{
+		try
+		{
+			BTreeIndex index(relationName, doubleIndexName, bufMgr, offsetof(tuple,d), DOUBLE,
+					occupancies[o][0], occupancies[o][1]);
 
-  long pos;
-  int val;
-	int i = 0;
-  while( i < relationSize )
-  {
-    pos = rand() % (relationSize-i);
-    val = intvec[pos];
-    sprintf(record1.s, "%05d string record", val);
-    record1.i = val;
-    record1.d = val;
+			// every key again half way between two of the original ones
+			{
+				FileScan fscan(relationName, bufMgr);
+				try
+				{
+					RecordId scanRid;
+					while(1)
+					{
+						fscan.scanNext(scanRid);
+						std::string recordStr = fscan.getRecord();
+						double key = *((double *)(recordStr.c_str() + offsetof(RECORD, d))) + 0.5;
+						index.insertEntry(&key, scanRid);
+					}
+				}
+				catch(const EndOfFileException &e)
+				{
+				}
+			}
+			checkPassFail(doubleScan(&index, 25, GT, 40, LT), 29)
+			checkPassFail(doubleScan(&index, 25, GTE, 40, LTE), 31)
+			checkPassFail(doubleScan(&index, 25.2, GT, 25.7, LT), 1)
+			checkPassFail(doubleScan(&index, -1, GT, 0.25, LT), 1)
+			checkPassFail(doubleScan(&index, 0, GTE, relationSize, LT), 2 * relationSize)
+			checkPassFail(doubleScan(&index, relationSize - 0.5, GT, relationSize + 1, LT), 0)
+		}
+		catch(std::exception &e)
+		{
+			std::cout << "Test 22 failed" << std::endl;
+		}
 
-    std::string new_data(reinterpret_cast<char*>(&record1), sizeof(RECORD));
+		try
+		{
+			File::remove(doubleIndexName);
+		}
+		catch(const FileNotFoundException &e)
+		{
 
-		while(1)
+		}
+	}
+	deleteRelation();
+}
+
+void test23()
+{
+	// indexes the string attribute. Its values first differ within the inline key prefix, then
+	// all of them share a prefix longer than it so that every comparison is a tie on the prefix
+	std::cout << "Test 23: B+ tree on a STRING attribute" << std::endl;
+	const char* formats[2] = { "%05d string record", "a long shared prefix %05d" };
+	for (int f = 0; f < 2; f++)
+	{
+		createRelationRandom();
+		if (f == 1)
 		{
-			try
-			{
-    		new_page.insertRecord(new_data);
-				break;
-			}
-			catch(const InsufficientSpaceException &e)
+			// rewrite the strings of the relation with the shared prefix
+			for (FileIterator iter = file1->begin(); iter != file1->end(); ++iter)
 			{
-      	file1->writePage(new_page_number, new_page);
-  			new_page = file1->allocatePage(new_page_number);
+				Page page = *iter;
+				for (PageIterator pageIter = page.begin(); pageIter != page.end(); ++pageIter)
+				{
+					RECORD rec = *(reinterpret_cast<const RECORD*>((*pageIter).data()));
+					sprintf(rec.s, formats[f], rec.i);
+					page.updateRecord(pageIter.getCurrentRecord(), std::string(reinterpret_cast<char*>(&rec), sizeof(RECORD)));
+				}
+				file1->writePage(page.page_number(), page);
 			}
 		}
 
-		int temp = intvec[relationSize-1-i];
-		intvec[relationSize-1-i] = intvec[pos];
-		intvec[pos] = temp;
-		i++;
-  }
-  
-	file1->writePage(new_page_number, new_page);
+		char low[64], high[64];
+		try
+		{
+			BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple,s), STRING, 4, 6);
+
+			sprintf(low, formats[f], 25);
+			sprintf(high, formats[f], 40);
+			checkPassFail(stringScan(&index, low, GT, high, LT), 14)
+			checkPassFail(stringScan(&index, low, GTE, high, LTE), 16)
+			sprintf(low, formats[f], 4990);
+			checkPassFail(stringScan(&index, low, GT, "zzzzz", LT), 9)
+			checkPassFail(stringScan(&index, "", GTE, "zzzzz", LT), relationSize)
+			checkPassFail(stringScan(&index, "0", GTE, "1", LT), (f == 0 ? relationSize : 0))
+			checkPassFail(stringScan(&index, "00025", GTE, "00040", LT), (f == 0 ? 15 : 0))
+		}
+		catch(std::exception &e)
+		{
+			std::cout << "Test 23 failed" << std::endl;
+		}
+
+		try
+		{
+			File::remove(stringIndexName);
+		}
+		catch(const FileNotFoundException &e)
+		{
+
+		}
+		deleteRelation();
+	}
 }
 
-// -----------------------------------------------------------------------------
-// createRelationRandomSize
-// -----------------------------------------------------------------------------
-void createRelationRandomSize(int relSize)
+void test24()
 {
-	// inserts specified number of records in random order
-  // destroy any old copies of relation file
+	// deletes entries from a tree with small nodes so that leaves and nodes underflow and are rebalanced
+	// or merged, then reinserts some of them, which has to reuse the pages freed by the merges
+	std::cout << "Test 24: deleting entries with merges and redistribution" << std::endl;
+	createRelationRandom();
 	try
 	{
-		File::remove(relationName);
-	}
-	catch(const FileNotFoundException &e)
-	{
-	}
-  file1 = new PageFile(relationName, true);
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, 4, 6);
 
-  // initialize all of record1.s to keep purify happy
-  memset(record1.s, ' ', sizeof(record1.s));
-	PageId new_page_number;
-  Page new_page = file1->allocatePage(new_page_number);
+		// every <key, rid> pair of the relation, in random order
+		std::vector<RIDKeyPair<int> > entries;
+		{
+			FileScan fscan(relationName, bufMgr);
+			try
+			{
+				RecordId scanRid;
+				while(1)
+				{
+					fscan.scanNext(scanRid);
+					std::string recordStr = fscan.getRecord();
+					RIDKeyPair<int> entry;
+					entry.set(scanRid, *((int *)(recordStr.c_str() + offsetof(RECORD, i))));
+					entries.push_back(entry);
+				}
+			}
+			catch(const EndOfFileException &e)
+			{
+			}
+		}
 
-  // insert records in random order
+		// delete the lower half and the odd keys of the upper half
+		int deleted = -1;
+		for (size_t e = 0; e < entries.size(); e++)
+		{
+			if (entries[e].key < relationSize / 2 || entries[e].key % 2 == 1)
+			{
+				index.deleteEntry(&entries[e].key, entries[e].rid);
+				deleted = e;
+			}
+		}
+		checkPassFail(intScan(&index, 0, GTE, relationSize, LT), relationSize / 4)
+		checkPassFail(intScan(&index, 3000, GTE, 3100, LT), 50)
+
+		bool thrown = false;
+		try
+		{
+			index.deleteEntry(&entries[deleted].key, entries[deleted].rid);
+		}
+		catch(const NoSuchKeyFoundException &e)
+		{
+			thrown = true;
+		}
+		checkPassFail(thrown, true)
+
+		// reinserting a few keys fits in the pages freed by the merges
+		std::streamoff size = std::ifstream(intIndexName.c_str(), std::ios::binary | std::ios::ate).tellg();
+		for (size_t e = 0; e < entries.size(); e++)
+		{
+			if (entries[e].key >= relationSize / 2 && entries[e].key < 3500 && entries[e].key % 2 == 1)
+			{
+				index.insertEntry(&entries[e].key, entries[e].rid);
+			}
+		}
+		checkPassFail(intScan(&index, relationSize / 2, GTE, 3500, LT), 1000)
+		checkPassFail(intScan(&index, 0, GTE, relationSize, LT), relationSize / 4 + 500)
+		checkPassFail(std::ifstream(intIndexName.c_str(), std::ios::binary | std::ios::ate).tellg(), size)
+
+		// deleting everything shrinks the tree back to a single leaf
+		for (size_t e = 0; e < entries.size(); e++)
+		{
+			if (entries[e].key >= relationSize / 2 && (entries[e].key % 2 == 0 || entries[e].key < 3500))
+			{
+				index.deleteEntry(&entries[e].key, entries[e].rid);
+			}
+		}
+		checkPassFail(intScan(&index, 0, GTE, relationSize, LT), 0)
+		checkPassFail(index.getNodeStatus(), true)
+
+		// duplicates of a key span many leaves, each delete has to find its own record id
+		int key = 7;
+		for (int e = 0; e < 200; e++)
+		{
+			index.insertEntry(&key, entries[e].rid);
+		}
+		for (int e = 0; e < 200; e += 2)
+		{
+			index.deleteEntry(&key, entries[e].rid);
+		}
+		checkPassFail(intScan(&index, key, GTE, key, LTE), 100)
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Test 24 failed" << std::endl;
+	}
+
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+
+	}
+	deleteRelation();
+}
+
+void test25()
+{
+	// several cursors scan the same index at once, each at its own pace
+	std::cout << "Test 25: several scan cursors open on one index" << std::endl;
+	createRelationRandom();
+	try
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, 4, 6);
+
+		// nested loop: for every key in [0, 200) count the keys in [key, key + 10)
+		int outerLow = 0;
+		int outerHigh = 200;
+		int outerCount = 0;
+		int innerCount = 0;
+		RecordId scanRid;
+		ScanCursor outer = index.openScan(&outerLow, GTE, &outerHigh, LT);
+		try
+		{
+			while(1)
+			{
+				outer.scanNext(scanRid);
+				int innerLow = outerCount;
+				int innerHigh = outerCount + 10;
+				outerCount++;
+
+				ScanCursor inner = index.openScan(&innerLow, GTE, &innerHigh, LT);
+				try
+				{
+					while(1)
+					{
+						inner.scanNext(scanRid);
+						innerCount++;
+					}
+				}
+				catch(const IndexScanCompletedException &e)
+				{
+				}
+			}
+		}
+		catch(const IndexScanCompletedException &e)
+		{
+		}
+		outer.endScan();
+		checkPassFail(outerCount, 200)
+		checkPassFail(innerCount, 2000)
+
+		// cursors over disjoint ranges advanced round robin, next to the scan kept by the index
+		std::vector<ScanCursor> cursors;
+		std::vector<int> counts(4, 0);
+		for (int c = 0; c < 4; c++)
+		{
+			int low = c * 1000;
+			int high = low + 1000;
+			cursors.push_back(index.openScan(&low, GTE, &high, LT));
+		}
+		checkPassFail(intScan(&index, 4000, GTE, relationSize, LT), relationSize - 4000)
+		bool scanning = true;
+		while (scanning)
+		{
+			scanning = false;
+			for (int c = 0; c < 4; c++)
+			{
+				if (!cursors[c].isExecuting())
+				{
+					continue;
+				}
+				try
+				{
+					cursors[c].scanNext(scanRid);
+					counts[c]++;
+					scanning = true;
+				}
+				catch(const IndexScanCompletedException &e)
+				{
+					cursors[c].endScan();
+				}
+			}
+		}
+		for (int c = 0; c < 4; c++)
+		{
+			checkPassFail(counts[c], 1000)
+		}
+
+		// a cursor that never scanned moves like any other
+		ScanCursor idle;
+		ScanCursor moved(std::move(idle));
+		idle = std::move(moved);
+		checkPassFail(idle.isExecuting(), false)
+
+		bool thrown = false;
+		try
+		{
+			cursors[0].scanNext(scanRid);
+		}
+		catch(const ScanNotInitializedException &e)
+		{
+			thrown = true;
+		}
+		checkPassFail(thrown, true)
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Test 25 failed" << std::endl;
+	}
+
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+
+	}
+	deleteRelation();
+}
+
+void test26()
+{
+	// batched scans return the same record ids, in the same order, as one scanNext() call per entry
+	std::cout << "Test 26: batched scans" << std::endl;
+	createRelationRandom();
+	try
+	{
+		BTreeIndex intIndex(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, 4, 6);
+		const size_t batchSizes[] = { 1, 7, 1000 };
+		for (int b = 0; b < 3; b++)
+		{
+			checkPassFail(batchScanMatches(&intIndex, 0, GTE, relationSize, LT, batchSizes[b]), true)
+			checkPassFail(batchScanMatches(&intIndex, 25, GT, 3000, LTE, batchSizes[b]), true)
+			checkPassFail(batchScanMatches(&intIndex, 996, GTE, 996, LTE, batchSizes[b]), true)
+			checkPassFail(batchScanMatches(&intIndex, -10, GT, std::numeric_limits<int>::max(), LTE, batchSizes[b]), true)
+		}
+
+		// a full scan through the legacy interface, timed against one call per entry
+		int low = 0;
+		int high = relationSize;
+		RecordId scanRid;
+		int single = 0;
+		auto begin = std::chrono::high_resolution_clock::now();
+		intIndex.startScan(&low, GTE, &high, LT);
+		try
+		{
+			while(1)
+			{
+				intIndex.scanNext(scanRid);
+				single++;
+			}
+		}
+		catch(const IndexScanCompletedException &e)
+		{
+		}
+		auto middle = std::chrono::high_resolution_clock::now();
+		std::vector<RecordId> rids(256);
+		int batched = 0;
+		size_t returned;
+		intIndex.startScan(&low, GTE, &high, LT);
+		while ((returned = intIndex.scanNextBatch(&rids[0], rids.size())) > 0)
+		{
+			batched += returned;
+		}
+		auto end = std::chrono::high_resolution_clock::now();
+		intIndex.endScan();
+		std::cout << "scanNext: " << std::chrono::duration_cast<std::chrono::microseconds>(middle - begin).count()
+			<< " us, scanNextBatch: " << std::chrono::duration_cast<std::chrono::microseconds>(end - middle).count()
+			<< " us" << std::endl;
+		checkPassFail(single, relationSize)
+		checkPassFail(batched, relationSize)
+
+		bool thrown = false;
+		try
+		{
+			intIndex.scanNextBatch(&rids[0], rids.size());
+		}
+		catch(const ScanNotInitializedException &e)
+		{
+			thrown = true;
+		}
+		checkPassFail(thrown, true)
+
+		// string bounds longer than the key prefix are rechecked entry by entry
+		BTreeIndex stringIndex(relationName, stringIndexName, bufMgr, offsetof(tuple,s), STRING, 4, 6);
+		checkPassFail(batchScanMatches<std::string>(&stringIndex, "00100 string record", GT, "02000 string record", LTE, 7), true)
+		checkPassFail(batchScanMatches<std::string>(&stringIndex, "00100", GTE, "02000", LT, 1000), true)
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Test 26 failed" << std::endl;
+	}
+
+	try
+	{
+		File::remove(intIndexName);
+		File::remove(stringIndexName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+	deleteRelation();
+}
+
+void test27()
+{
+	// end of scan, empty ranges, buffer misses and end of file reported without exceptions
+	std::cout << "Test 27: exception-free scans and page reads" << std::endl;
+	createRelationRandom();
+
+	{
+		FileScan fscan(relationName, bufMgr);
+		RecordId scanRid;
+		int records = 0;
+		while (fscan.tryScanNext(scanRid))
+		{
+			records++;
+		}
+		checkPassFail(records, relationSize)
+		checkPassFail(fscan.tryScanNext(scanRid), false)
+	}
+
+	try
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+
+		Page* page;
+		PageId pageNo = (*file1->begin()).page_number();
+		bufMgr->flushFile(file1);
+		checkPassFail(bufMgr->readPage(file1, pageNo, page), false)
+		checkPassFail(bufMgr->readPage(file1, pageNo, page), true)
+		bufMgr->unPinPage(file1, pageNo, false);
+		bufMgr->unPinPage(file1, pageNo, false);
+
+		// an empty range leaves the cursor idle, ending the scan it had
+		ScanCursor cursor;
+		int low = 100;
+		int high = 110;
+		checkPassFail(index.tryOpenScan(cursor, &low, GTE, &high, LT), true)
+		int emptyLow = relationSize + 10;
+		int emptyHigh = relationSize + 20;
+		checkPassFail(index.tryOpenScan(cursor, &emptyLow, GTE, &emptyHigh, LT), false)
+		checkPassFail(cursor.isExecuting(), false)
+		checkPassFail(index.tryStartScan(&emptyLow, GTE, &emptyHigh, LT), false)
+
+		checkPassFail(index.tryOpenScan(cursor, &low, GT, &high, LTE), true)
+		RecordId scanRid;
+		int count = 0;
+		while (cursor.tryScanNext(scanRid))
+		{
+			count++;
+		}
+		checkPassFail(count, 10)
+		checkPassFail(cursor.tryScanNext(scanRid), false)
+		checkPassFail(cursor.isExecuting(), true)
+		cursor.endScan();
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Test 27 failed" << std::endl;
+	}
+
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+	deleteRelation();
+}
+
+void test28()
+{
+	// point lookups, one key at a time and many keys per call
+	std::cout << "Test 28: point lookups" << std::endl;
+	createRelationRandom();
+	try
+	{
+		BTreeIndex intIndex(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, 4, 6);
+
+		// duplicates of one key spanning several leaves
+		for (int i = 0; i < 300; i++)
+		{
+			int dup = 42;
+			RecordId rid;
+			rid.page_number = 1;
+			rid.slot_number = i + 1;
+			intIndex.insertEntry(&dup, rid);
+		}
+
+		std::vector<RecordId> rids;
+		int key = 41;
+		checkPassFail(intIndex.lookup(&key, rids), 1)
+		key = 42;
+		checkPassFail(intIndex.lookup(&key, rids), 301)
+		key = relationSize;
+		checkPassFail(intIndex.lookup(&key, rids), 0)
+		checkPassFail(rids.size(), 302)
+
+		// every third key, some of them not in the index, in ascending and in descending order
+		std::vector<int> keys;
+		for (int k = -6; k < relationSize + 6; k += 3)
+		{
+			keys.push_back(k);
+		}
+		std::vector<const void*> keyPtrs;
+		for (size_t k = 0; k < keys.size(); k++)
+		{
+			keyPtrs.push_back(&keys[k]);
+		}
+		std::vector<RecordId> ascRids;
+		std::vector<size_t> ascCounts;
+		intIndex.lookupMany(&keyPtrs[0], keyPtrs.size(), ascRids, ascCounts);
+		int mismatches = 0;
+		size_t expectedTotal = 0;
+		for (size_t k = 0; k < keys.size(); k++)
+		{
+			size_t expected = (keys[k] < 0 || keys[k] >= relationSize) ? 0 : ((keys[k] == 42) ? 301 : 1);
+			mismatches += (ascCounts[k] != expected);
+			expectedTotal += expected;
+		}
+		checkPassFail(mismatches, 0)
+		checkPassFail(ascRids.size(), expectedTotal)
+
+		std::vector<const void*> descPtrs(keyPtrs.rbegin(), keyPtrs.rend());
+		std::vector<RecordId> descRids;
+		std::vector<size_t> descCounts;
+		intIndex.lookupMany(&descPtrs[0], descPtrs.size(), descRids, descCounts);
+		checkPassFail(std::equal(descCounts.begin(), descCounts.end(), ascCounts.rbegin()), true)
+		checkPassFail(descRids.size(), expectedTotal)
+
+		// all keys in one call, timed against a scan started for each key
+		std::vector<int> allKeys(relationSize);
+		std::vector<const void*> allPtrs(relationSize);
+		for (int k = 0; k < relationSize; k++)
+		{
+			allKeys[k] = k;
+			allPtrs[k] = &allKeys[k];
+		}
+		auto begin = std::chrono::high_resolution_clock::now();
+		int scanned = 0;
+		RecordId scanRid;
+		for (int k = 0; k < relationSize; k++)
+		{
+			if (intIndex.tryStartScan(&allKeys[k], GTE, &allKeys[k], LTE))
+			{
+				while (intIndex.tryScanNext(scanRid))
+				{
+					scanned++;
+				}
+			}
+		}
+		intIndex.endScan();
+		auto middle = std::chrono::high_resolution_clock::now();
+		std::vector<RecordId> allRids;
+		std::vector<size_t> allCounts;
+		intIndex.lookupMany(&allPtrs[0], allPtrs.size(), allRids, allCounts);
+		auto end = std::chrono::high_resolution_clock::now();
+		std::cout << "scan per key: " << std::chrono::duration_cast<std::chrono::microseconds>(middle - begin).count()
+			<< " us, lookupMany: " << std::chrono::duration_cast<std::chrono::microseconds>(end - middle).count()
+			<< " us" << std::endl;
+		checkPassFail(scanned, relationSize + 300)
+		checkPassFail(allRids.size(), relationSize + 300)
+
+		// the full string decides between keys tied on their prefix
+		BTreeIndex stringIndex(relationName, stringIndexName, bufMgr, offsetof(tuple,s), STRING);
+		std::string strKeys[] = { "00042", "00042 string rec", "00042 string record", "00042 string record!" };
+		checkPassFail(stringIndex.lookup(strKeys[0].c_str(), rids), 0)
+		checkPassFail(stringIndex.lookup(strKeys[1].c_str(), rids), 0)
+		checkPassFail(stringIndex.lookup(strKeys[2].c_str(), rids), 1)
+		checkPassFail(stringIndex.lookup(strKeys[3].c_str(), rids), 0)
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Test 28 failed" << std::endl;
+	}
+
+	try
+	{
+		File::remove(intIndexName);
+		File::remove(stringIndexName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+	deleteRelation();
+}
+
+void test29()
+{
+	// batched inserts of random keys, checked against the same keys inserted one at a time
+	std::cout << "Test 29: batched inserts" << std::endl;
+	createRelationRandom();
+	const int numInserts = 100000;
+	const int batchSize = 1000;
+	std::vector<int> keys(numInserts);
+	for (int i = 0; i < numInserts; i++)
+	{
+		keys[i] = relationSize + i;
+	}
+	std::shuffle(keys.begin(), keys.end(), std::mt19937(29));
+	std::vector<const void*> keyPtrs(numInserts);
+	std::vector<RecordId> rids(numInserts);
+	for (int i = 0; i < numInserts; i++)
+	{
+		keyPtrs[i] = &keys[i];
+		// record ids tell the keys apart, the page number being the key
+		rids[i].page_number = keys[i];
+		rids[i].slot_number = 1;
+	}
+
+	for (int batched = 0; batched < 2; batched++)
+	{
+		try
+		{
+			BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+			auto begin = std::chrono::high_resolution_clock::now();
+			for (int i = 0; i < numInserts; i += batchSize)
+			{
+				if (batched)
+				{
+					index.insertBatch(&keyPtrs[i], &rids[i], batchSize);
+				}
+				else
+				{
+					for (int k = i; k < i + batchSize; k++)
+					{
+						index.insertEntry(keyPtrs[k], rids[k]);
+					}
+				}
+			}
+			auto end = std::chrono::high_resolution_clock::now();
+			std::cout << (batched ? "insertBatch: " : "insertEntry: ")
+				<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() << " us" << std::endl;
+
+			// every inserted key comes back once, in order
+			int low = relationSize;
+			int high = relationSize + numInserts;
+			int expected = relationSize;
+			int misplaced = 0;
+			RecordId scanRid;
+			checkPassFail(index.tryStartScan(&low, GTE, &high, LT), true)
+			while (index.tryScanNext(scanRid))
+			{
+				misplaced += (scanRid.page_number != (PageId) expected);
+				expected++;
+			}
+			index.endScan();
+			checkPassFail(misplaced, 0)
+			checkPassFail(expected, relationSize + numInserts)
+			checkPassFail(intScan(&index, 0, GTE, relationSize, LT), relationSize)
+		}
+		catch(std::exception &e)
+		{
+			std::cout << "Test 29 failed" << std::endl;
+		}
+
+		try
+		{
+			File::remove(intIndexName);
+		}
+		catch(const FileNotFoundException &e)
+		{
+		}
+	}
+
+	// small nodes, so one batch splits leaves and the root into several nodes at once, and duplicates
+	try
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, 4, 6);
+		int dup = 77;
+		std::vector<RecordId> found;
+		index.lookup(&dup, found);
+		std::vector<const void*> dupPtrs(100, &dup);
+		std::vector<RecordId> dupRids(100, found[0]);
+		index.insertBatch(&dupPtrs[0], &dupRids[0], dupPtrs.size());
+		index.insertBatch(&keyPtrs[0], &rids[0], 20000);
+
+		found.clear();
+		checkPassFail(index.lookup(&dup, found), 101)
+		checkPassFail(intScan(&index, 0, GTE, relationSize, LT), relationSize + 100)
+		int low = relationSize;
+		int high = relationSize + numInserts;
+		std::vector<RecordId> batch(256);
+		size_t returned;
+		int count = 0;
+		index.startScan(&low, GTE, &high, LT);
+		while ((returned = index.scanNextBatch(&batch[0], batch.size())) > 0)
+		{
+			count += returned;
+		}
+		index.endScan();
+		checkPassFail(count, 20000)
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Test 29 failed" << std::endl;
+	}
+
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+	deleteRelation();
+}
+
+void test30()
+{
+	// keys inserted in ascending and in descending order pack the leaves they fill
+	std::cout << "Test 30: ascending and descending inserts" << std::endl;
+	createRelationForward();
+	const int occupancies[][2] = { { INTARRAYNONLEAFSIZE, INTARRAYLEAFSIZE }, { 4, 6 } };
+	for (int o = 0; o < 2; o++)
+	{
+		try
+		{
+			BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, occupancies[o][0], occupancies[o][1]);
+			const int numInserts = (o == 0) ? 50000 : 3000;
+			// the record id of an entry is its key shifted to be positive
+			const int offset = numInserts + 1;
+			RecordId rid;
+			rid.slot_number = 1;
+
+			for (int order = 0; order < 2; order++)
+			{
+				std::streamoff size = std::ifstream(intIndexName.c_str(), std::ios::binary | std::ios::ate).tellg();
+				auto begin = std::chrono::high_resolution_clock::now();
+				for (int i = 0; i < numInserts; i++)
+				{
+					int key = (order == 0) ? relationSize + i : -1 - i;
+					rid.page_number = key + offset;
+					index.insertEntry(&key, rid);
+				}
+				auto end = std::chrono::high_resolution_clock::now();
+				std::cout << ((order == 0) ? "ascending: " : "descending: ")
+					<< std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count() << " us" << std::endl;
+
+				// full leaves, plus non-leaf nodes holding at least half as many children as they can
+				int pages = (std::ifstream(intIndexName.c_str(), std::ios::binary | std::ios::ate).tellg() - size) / Page::SIZE;
+				int leaves = (numInserts + occupancies[o][1] - 1) / occupancies[o][1];
+				checkPassFail((pages <= leaves + 2 * leaves / (occupancies[o][0] + 1) + 2), true)
+			}
+
+			// all keys come back in order, on both sides of the keys of the relation
+			for (int order = 0; order < 2; order++)
+			{
+				int low = (order == 0) ? relationSize : -numInserts;
+				int high = low + numInserts;
+				int expected = low;
+				int misplaced = 0;
+				RecordId scanRid;
+				checkPassFail(index.tryStartScan(&low, GTE, &high, LT), true)
+				while (index.tryScanNext(scanRid))
+				{
+					misplaced += (scanRid.page_number != (PageId) (expected + offset));
+					expected++;
+				}
+				index.endScan();
+				checkPassFail(misplaced, 0)
+				checkPassFail(expected, high)
+			}
+			checkPassFail(intScan(&index, 0, GTE, relationSize, LT), relationSize)
+
+			// duplicates of the last key join its posting list once it has one, rather than being appended after it
+			int last = relationSize + numInserts;
+			const int numDuplicates = 4 * occupancies[o][1];
+			for (int i = 0; i < numDuplicates; i++)
+			{
+				rid.page_number = 2 * numDuplicates - i;
+				index.insertEntry(&last, rid);
+			}
+			std::vector<RecordId> found;
+			checkPassFail((int) index.lookup(&last, found), numDuplicates)
+			int unordered = 0;
+			for (size_t i = 1; i < found.size(); i++)
+			{
+				unordered += !(found[i - 1].page_number < found[i].page_number);
+			}
+			checkPassFail(unordered, 0)
+		}
+		catch(std::exception &e)
+		{
+			std::cout << "Test 30 failed" << std::endl;
+		}
+
+		try
+		{
+			File::remove(intIndexName);
+		}
+		catch(const FileNotFoundException &e)
+		{
+		}
+	}
+	deleteRelation();
+}
+
+void test31()
+{
+	// threads insert disjoint keys while others scan and look up keys, then everything is checked
+	std::cout << "Test 31: concurrent inserts, scans and lookups" << std::endl;
+	createRelationForward();
+	const int numInserts = 40000;
+	const int numReaders = 2;
+	const int threadCounts[] = { 1, 2, 4, 8 };
+	for (int c = 0; c < 4; c++)
+	{
+		const int numWriters = threadCounts[c];
+		try
+		{
+			BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+			std::atomic<bool> writing(true);
+			std::atomic<int> misordered(0);
+			std::atomic<int> missing(0);
+			std::atomic<int> scans(0);
+
+			// each reader scans the keys being inserted, which must come back in order, and looks up
+			// keys of the relation, which must be found exactly once
+			std::vector<std::thread> readers;
+			for (int r = 0; r < numReaders; r++)
+			{
+				readers.push_back(std::thread([&, r]()
+				{
+					std::mt19937 gen(r);
+					std::vector<RecordId> batch(128);
+					std::vector<RecordId> found;
+					while (writing)
+					{
+						int low = relationSize;
+						int high = relationSize + numInserts;
+						ScanCursor cursor;
+						if (index.tryOpenScan(cursor, &low, GTE, &high, LT))
+						{
+							PageId last = 0;
+							size_t returned;
+							while ((returned = cursor.scanNextBatch(&batch[0], batch.size())) > 0)
+							{
+								for (size_t i = 0; i < returned; i++)
+								{
+									misordered += (batch[i].page_number <= last);
+									last = batch[i].page_number;
+								}
+							}
+							cursor.endScan();
+						}
+						scans++;
+
+						for (int i = 0; i < 100; i++)
+						{
+							int key = gen() % relationSize;
+							found.clear();
+							missing += (index.lookup(&key, found) != 1);
+						}
+					}
+				}));
+			}
+
+			// writer t inserts the keys that are t modulo the number of writers, in random order
+			auto begin = std::chrono::high_resolution_clock::now();
+			std::vector<std::thread> writers;
+			for (int t = 0; t < numWriters; t++)
+			{
+				writers.push_back(std::thread([&, t]()
+				{
+					std::vector<int> keys;
+					for (int k = t; k < numInserts; k += numWriters)
+					{
+						keys.push_back(relationSize + k);
+					}
+					std::shuffle(keys.begin(), keys.end(), std::mt19937(t));
+					RecordId rid;
+					rid.slot_number = 1;
+					for (size_t i = 0; i < keys.size(); i++)
+					{
+						// the record id of an entry is its key, so that the order of the entries shows in it
+						rid.page_number = keys[i];
+						index.insertEntry(&keys[i], rid);
+					}
+				}));
+			}
+			for (int t = 0; t < numWriters; t++)
+			{
+				writers[t].join();
+			}
+			auto end = std::chrono::high_resolution_clock::now();
+			writing = false;
+			for (int r = 0; r < numReaders; r++)
+			{
+				readers[r].join();
+			}
+
+			long long us = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
+			std::cout << numWriters << " writers: " << us << " us, "
+				<< (long long) numInserts * 1000000 / std::max(us, 1LL) << " inserts/s, "
+				<< scans << " concurrent scans" << std::endl;
+			checkPassFail(misordered, 0)
+			checkPassFail(missing, 0)
+
+			// every key inserted comes back once, in order
+			int low = relationSize;
+			int high = relationSize + numInserts;
+			int expected = relationSize;
+			int misplaced = 0;
+			RecordId scanRid;
+			checkPassFail(index.tryStartScan(&low, GTE, &high, LT), true)
+			while (index.tryScanNext(scanRid))
+			{
+				misplaced += (scanRid.page_number != (PageId) expected);
+				expected++;
+			}
+			index.endScan();
+			checkPassFail(misplaced, 0)
+			checkPassFail(expected, high)
+			checkPassFail(intScan(&index, 0, GTE, relationSize, LT), relationSize)
+
+			// the statistics counted every insert of every writer
+			int first = 0;
+			checkPassFail((std::fabs(index.estimateRange(&first, GTE, &high, LT) - high) < 1), true)
+		}
+		catch(std::exception &e)
+		{
+			std::cout << "Test 31 failed" << std::endl;
+		}
+
+		try
+		{
+			File::remove(intIndexName);
+		}
+		catch(const FileNotFoundException &e)
+		{
+		}
+	}
+	deleteRelation();
+}
+
+void test32()
+{
+	// threads look up keys while one thread keeps inserting, so that the descents run into nodes being changed
+	// The speedup over a single reader only shows how far lookups scale with as many cores as readers
+	std::cout << "Test 32: lookups alongside inserts, " << std::thread::hardware_concurrency() << " cores" << std::endl;
+	createRelationForward();
+	const int numLookups = 100000;
+	const int maxInserts = 20000;
+	const int threadCounts[] = { 1, 2, 4, 8 };
+	try
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		std::atomic<int> nextKey(relationSize);
+		long long singleReader = 0;
+		for (int c = 0; c < 4; c++)
+		{
+			const int numReaders = threadCounts[c];
+			std::atomic<bool> reading(true);
+			std::atomic<int> missing(0);
+			int firstKey = nextKey;
+
+			std::thread writer([&]()
+			{
+				RecordId rid;
+				rid.slot_number = 1;
+				for (int i = 0; i < maxInserts && reading; i++)
+				{
+					int key = nextKey++;
+					rid.page_number = key;
+					index.insertEntry(&key, rid);
+				}
+			});
+
+			// each reader looks up keys of the relation, and keys inserted before it started, which are all there once
+			auto begin = std::chrono::high_resolution_clock::now();
+			std::vector<std::thread> readers;
+			for (int r = 0; r < numReaders; r++)
+			{
+				readers.push_back(std::thread([&, r]()
+				{
+					std::mt19937 gen(r);
+					std::vector<RecordId> found;
+					for (int i = 0; i < numLookups / numReaders; i++)
+					{
+						int key = gen() % firstKey;
+						found.clear();
+						missing += (index.lookup(&key, found) != 1);
+					}
+				}));
+			}
+			for (int r = 0; r < numReaders; r++)
+			{
+				readers[r].join();
+			}
+			auto end = std::chrono::high_resolution_clock::now();
+			reading = false;
+			writer.join();
+
+			long long us = std::max((long long) std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count(), 1LL);
+			singleReader = (numReaders == 1) ? us : singleReader;
+			std::cout << numReaders << " readers: " << us << " us, "
+				<< (long long) numLookups * 1000000 / us << " lookups/s, "
+				<< (double) singleReader / us << "x one reader, "
+				<< nextKey - firstKey << " concurrent inserts" << std::endl;
+			checkPassFail(missing, 0)
+		}
+
+		// every key inserted comes back once, in order
+		int low = relationSize;
+		int high = nextKey;
+		checkPassFail(intScan(&index, 0, GTE, relationSize, LT), relationSize)
+		int expected = relationSize;
+		int misplaced = 0;
+		RecordId scanRid;
+		checkPassFail(index.tryStartScan(&low, GTE, &high, LT), true)
+		while (index.tryScanNext(scanRid))
+		{
+			misplaced += (scanRid.page_number != (PageId) expected);
+			expected++;
+		}
+		index.endScan();
+		checkPassFail(misplaced, 0)
+		checkPassFail(expected, high)
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Test 32 failed" << std::endl;
+	}
+
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+	deleteRelation();
+}
+
+void test33()
+{
+	// long scans prefetch the leaves ahead of them, short scans and lookups do not
+	std::cout << "Test 33: scan readahead" << std::endl;
+	createRelationForward();
+	try
+	{
+		// one key per leaf at most six, so the scans cross hundreds of leaves
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, 4, 6);
+
+		bufMgr->clearBufStats();
+		checkPassFail(intScan(&index, 0, GTE, relationSize, LT), relationSize)
+		int prefetches = bufMgr->getBufStats().prefetches;
+		std::cout << "full scan prefetched " << prefetches << " leaves" << std::endl;
+		checkPassFail((prefetches > 0), true)
+		checkPassFail((prefetches <= relationSize / 3 + 64), true)
+
+		// a scan crossing into a second leaf only reads a couple of leaves ahead
+		bufMgr->clearBufStats();
+		checkPassFail(intScan(&index, 100, GTE, 106, LTE), 7)
+		checkPassFail((bufMgr->getBufStats().prefetches <= 2), true)
+
+		bufMgr->clearBufStats();
+		std::vector<RecordId> found;
+		for (int key = 0; key < relationSize; key += 50)
+		{
+			index.lookup(&key, found);
+		}
+		checkPassFail((int) found.size(), relationSize / 50)
+		checkPassFail(bufMgr->getBufStats().prefetches, 0)
+
+		// batches of record ids match the scan one entry at a time over the whole tree
+		checkPassFail(batchScanMatches(&index, 0, GTE, relationSize, LT, 97), true)
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Test 33 failed" << std::endl;
+	}
+
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+	deleteRelation();
+}
+
+void test34()
+{
+	// a covering index returns the values of its included columns from the leaves
+	std::cout << "Test 34: covering index with included columns" << std::endl;
+	createRelationForward();
+	std::vector<IncludedColumn> columns(1);
+	columns[0].byteOffset = offsetof(tuple,d);
+	columns[0].length = sizeof(double);
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+	try
+	{
+		std::vector<RecordId> rids(relationSize);
+		{
+			// small leaves, so that inserts and deletes split and merge them
+			BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, 4, 6, columns);
+			checkPassFail(index.getIncludedSize(), (int) sizeof(double))
+
+			// every key comes back with its record's d, which equals the key
+			int low = 0;
+			int high = relationSize;
+			int count = 0;
+			int wrong = 0;
+			RecordId rid;
+			double d;
+			index.startScan(&low, GTE, &high, LT);
+			while (index.tryScanNext(rid, &d))
+			{
+				wrong += (d != (double) count);
+				rids[count++] = rid;
+			}
+			index.endScan();
+			checkPassFail(count, relationSize)
+			checkPassFail(wrong, 0)
+
+			// entries deleted and inserted again read their values from the records
+			for (int key = 0; key < relationSize; key += 2)
+			{
+				index.deleteEntry(&key, rids[key]);
+			}
+			checkPassFail(intScan(&index, 0, GTE, relationSize, LT), relationSize / 2)
+			for (int key = 0; key < relationSize; key += 4)
+			{
+				index.insertEntry(&key, rids[key]);
+			}
+			std::vector<int> keys;
+			std::vector<const void*> keyPtrs;
+			std::vector<RecordId> batchRids;
+			for (int key = 2; key < relationSize; key += 4)
+			{
+				keys.push_back(key);
+				batchRids.push_back(rids[key]);
+			}
+			for (std::size_t i = 0; i < keys.size(); i++)
+			{
+				keyPtrs.push_back(&keys[i]);
+			}
+			index.insertBatch(&keyPtrs[0], &batchRids[0], keys.size());
+
+			// batches return the values of their entries one after the other
+			const std::size_t batchSize = 97;
+			std::vector<RecordId> batch(batchSize);
+			std::vector<double> values(batchSize);
+			count = 0;
+			wrong = 0;
+			index.startScan(&low, GTE, &high, LT);
+			std::size_t n;
+			while ((n = index.scanNextBatch(&batch[0], batchSize, &values[0])) > 0)
+			{
+				for (std::size_t i = 0; i < n; i++)
+				{
+					wrong += (values[i] != (double) count);
+					count++;
+				}
+			}
+			index.endScan();
+			checkPassFail(count, relationSize)
+			checkPassFail(wrong, 0)
+		}
+
+		// the included columns are part of the index, opening it with others fails
+		bool mismatch = false;
+		try
+		{
+			BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		}
+		catch(const BadIndexInfoException &e)
+		{
+			mismatch = true;
+		}
+		checkPassFail(mismatch, true)
+
+		{
+			BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, 4, 6, columns);
+			int key = relationSize / 2;
+			RecordId rid;
+			double d = 0;
+			index.startScan(&key, GTE, &key, LTE);
+			index.scanNext(rid, &d);
+			index.endScan();
+			checkPassFail((d == (double) key), true)
+		}
+
+		// opened with other capacities it keeps those it was built with, where its values are
+		{
+			BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, columns);
+			int low = 0;
+			int high = relationSize;
+			int count = 0;
+			int wrong = 0;
+			RecordId rid;
+			double d;
+			index.startScan(&low, GTE, &high, LT);
+			while (index.tryScanNext(rid, &d))
+			{
+				wrong += (d != (double) count);
+				count++;
+			}
+			index.endScan();
+			checkPassFail(count, relationSize)
+			checkPassFail(wrong, 0)
+		}
+		File::remove(intIndexName);
+
+		// a covering index built with the default capacities holds fewer entries per leaf
+		{
+			BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, columns);
+			int low = 0;
+			int high = relationSize;
+			int count = 0;
+			int wrong = 0;
+			RecordId rid;
+			double d;
+			index.startScan(&low, GTE, &high, LT);
+			while (index.tryScanNext(rid, &d))
+			{
+				wrong += (d != (double) count);
+				count++;
+			}
+			index.endScan();
+			checkPassFail(count, relationSize)
+			checkPassFail(wrong, 0)
+		}
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Test 34 failed" << std::endl;
+	}
+
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+	deleteRelation();
+}
+
+void test35()
+{
+	// records found through an index are fetched once per page, in the order of the file
+	std::cout << "Test 35: RID-sorted heap fetch" << std::endl;
+	createRelationRandom();
+	try
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+
+		int low = 0;
+		int high = relationSize;
+		ScanCursor indexScan = index.openScan(&low, GTE, &high, LT);
+		BitmapHeapScan heapScan(relationName, bufMgr, indexScan);
+		checkPassFail(indexScan.isExecuting(), false)
+		checkPassFail((heapScan.numPages() > 1), true)
+
+		// every page is read once, and every record of the range comes back once
+		bufMgr->clearBufStats();
+		std::vector<bool> seen(relationSize, false);
+		int count = 0;
+		int wrong = 0;
+		PageId lastPage = 0;
+		RecordId rid;
+		while (heapScan.tryScanNext(rid))
+		{
+			std::string record = heapScan.getRecord();
+			const RECORD* tuple = reinterpret_cast<const RECORD*>(record.data());
+			wrong += (tuple->i < low || tuple->i >= high || seen[tuple->i] || rid.page_number < lastPage);
+			seen[tuple->i] = true;
+			lastPage = rid.page_number;
+			count++;
+		}
+		checkPassFail(count, relationSize)
+		checkPassFail(wrong, 0)
+		checkPassFail(bufMgr->getBufStats().diskreads, (int) heapScan.numPages())
+
+		// a narrower range reads only the pages of its records, repeated ids are fetched once
+		std::vector<RecordId> rids;
+		low = 1000;
+		high = 1999;
+		ScanCursor cursor = index.openScan(&low, GTE, &high, LTE);
+		while (cursor.tryScanNext(rid))
+		{
+			rids.push_back(rid);
+			rids.push_back(rid);
+		}
+		cursor.endScan();
+		BitmapHeapScan rangeScan(relationName, bufMgr, rids);
+		count = 0;
+		wrong = 0;
+		while (rangeScan.tryScanNext(rid))
+		{
+			std::string record = rangeScan.getRecord();
+			const RECORD* tuple = reinterpret_cast<const RECORD*>(record.data());
+			wrong += (tuple->i < low || tuple->i > high);
+			count++;
+		}
+		checkPassFail(count, 1000)
+		checkPassFail(wrong, 0)
+		checkPassFail((rangeScan.numPages() <= heapScan.numPages()), true)
+
+		// a scan that found nothing in range fetches nothing
+		low = relationSize;
+		high = relationSize + 10;
+		index.tryOpenScan(cursor, &low, GTE, &high, LT);
+		BitmapHeapScan emptyScan(relationName, bufMgr, cursor);
+		checkPassFail(emptyScan.tryScanNext(rid), false)
+		checkPassFail((int) emptyScan.numPages(), 0)
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Test 35 failed" << std::endl;
+	}
+
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+	deleteRelation();
+}
+
+void test36()
+{
+	// a composite key orders entries by its attributes one after the other
+	std::cout << "Test 36: composite keys" << std::endl;
+	createRelationForward();
+	std::string compositeIndexName;
+	try
+	{
+		// the encoding orders negative numbers and -0.0 like the values they come from
+		std::vector<KeyAttribute> numbers(2);
+		numbers[0].byteOffset = offsetof(tuple,i);
+		numbers[0].type = INTEGER;
+		numbers[1].byteOffset = offsetof(tuple,d);
+		numbers[1].type = DOUBLE;
+		CompositeKeyFormat numberFormat(numbers);
+		int ints[] = { -5, -1, 0, 0, 0, 7 };
+		double doubles[] = { 1.0, -3.5, -0.0, 0.0, 2.5, -100 };
+		std::vector<CompositeKey> keys;
+		for (int k = 0; k < 6; k++)
+		{
+			const void* values[] = { &ints[k], &doubles[k] };
+			keys.push_back(numberFormat.makeKey(values, 2));
+		}
+		checkPassFail((keys[0] < keys[1] && keys[1] < keys[2] && keys[2] == keys[3] && keys[3] < keys[4] &&
+				keys[4] < keys[5]), true)
+
+		// key on the first three characters of s then i, 100 records share each prefix
+		std::vector<KeyAttribute> attributes(2);
+		attributes[0].byteOffset = offsetof(tuple,s);
+		attributes[0].type = STRING;
+		attributes[0].length = 3;
+		attributes[1].byteOffset = offsetof(tuple,i);
+		attributes[1].type = INTEGER;
+		BTreeIndex index(relationName, compositeIndexName, bufMgr, attributes, 4, 6);
+		const CompositeKeyFormat& format = index.getKeyFormat();
+
+		// a prefix on the leading attribute covers all of its records
+		const char* prefix = "012";
+		const void* prefixValues[] = { prefix };
+		CompositeKey low = format.makeKey(prefixValues, 1);
+		CompositeKey high = format.makeKey(prefixValues, 1, true);
+		checkPassFail(compositeScan(&index, low, high, 1200, 1299), 100)
+
+		// equality on the leading attribute and a range on the next one
+		int lowI = 1250;
+		int highI = 1259;
+		const void* lowValues[] = { prefix, &lowI };
+		const void* highValues[] = { prefix, &highI };
+		low = format.makeKey(lowValues, 2);
+		high = format.makeKey(highValues, 2);
+		checkPassFail(compositeScan(&index, low, high, lowI, highI), 10)
+
+		// keys of the leading attribute on both sides of the range
+		const char* lastPrefix = "049";
+		const void* lastValues[] = { lastPrefix };
+		low = format.makeKey(prefixValues, 1);
+		high = format.makeKey(lastValues, 1, true);
+		checkPassFail(compositeScan(&index, low, high, 1200, relationSize - 1), relationSize - 1200)
+
+		// entries are deleted and inserted with keys built the same way
+		int key = 1255;
+		const void* keyValues[] = { prefix, &key };
+		CompositeKey deleted = format.makeKey(keyValues, 2);
+		std::vector<RecordId> found;
+		checkPassFail(index.lookup(&deleted, found), 1)
+		index.deleteEntry(&deleted, found[0]);
+		low = format.makeKey(lowValues, 2);
+		high = format.makeKey(highValues, 2);
+		checkPassFail(compositeScan(&index, low, high, lowI, highI), 9)
+		index.insertEntry(&deleted, found[0]);
+		checkPassFail(compositeScan(&index, low, high, lowI, highI), 10)
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Test 36 failed" << std::endl;
+	}
+
+	try
+	{
+		File::remove(compositeIndexName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+	deleteRelation();
+}
+
+void test38()
+{
+	// leaves store record ids without their padding, page numbers of all sizes come back whole
+	std::cout << "Test 38: packed record ids in leaves" << std::endl;
+	createRelationForward();
+	checkPassFail((INTARRAYLEAFSIZE > (int) ((Page::SIZE - sizeof(NodeHeader)) / (sizeof(int) + sizeof(RecordId)))), true)
+	try
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, 4, 6);
+
+		// record ids with page numbers past 16 bits, inserted after the keys of the relation
+		const int numKeys = 500;
+		std::vector<RecordId> rids(numKeys);
+		for (int k = 0; k < numKeys; k++)
+		{
+			int key = relationSize + k;
+			rids[k].page_number = 0x12345 + k * 0x10001;
+			rids[k].slot_number = (SlotId) (k * 131);
+			rids[k].padding = 0;
+			index.insertEntry(&key, rids[k]);
+		}
+
+		int low = relationSize;
+		int high = relationSize + numKeys;
+		RecordId rid;
+		int count = 0;
+		int wrong = 0;
+		index.startScan(&low, GTE, &high, LT);
+		while (index.tryScanNext(rid))
+		{
+			wrong += (rid != rids[count]);
+			count++;
+		}
+		index.endScan();
+		checkPassFail(count, numKeys)
+		checkPassFail(wrong, 0)
+
+		// deletes find the entry of the same record id among duplicates
+		int key = relationSize;
+		index.insertEntry(&key, rids[1]);
+		index.deleteEntry(&key, rids[0]);
+		std::vector<RecordId> found;
+		checkPassFail((int) index.lookup(&key, found), 1)
+		checkPassFail((found[0] == rids[1]), true)
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Test 38 failed" << std::endl;
+	}
+
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+	deleteRelation();
+}
+
+void test39()
+{
+	// keys with many duplicates are stored once, their record ids going to posting lists
+	std::cout << "Test 39: posting lists for duplicate keys" << std::endl;
+	createRelationDuplicates(4);
+	try
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+
+		// the 5000 entries would take several leaves, the four keys fit in the root
+		checkPassFail(index.getNodeStatus(), true)
+		checkPassFail(intScan(&index, 0, GTE, 3, LTE), relationSize)
+		checkPassFail(intScan(&index, 2, GTE, 2, LTE), relationSize / 4)
+		checkPassFail(intScan(&index, 0, GT, 3, LT), relationSize / 2)
+		checkPassFail(batchScanMatches(&index, 0, GTE, 3, LTE, 100), true)
+
+		// the record ids of a key come in the order of the relation
+		int key = 1;
+		std::vector<RecordId> found;
+		checkPassFail((int) index.lookup(&key, found), relationSize / 4)
+		int unordered = 0;
+		for (size_t i = 1; i < found.size(); i++)
+		{
+			unordered += !(found[i - 1].page_number < found[i].page_number ||
+				(found[i - 1].page_number == found[i].page_number && found[i - 1].slot_number < found[i].slot_number));
+		}
+		checkPassFail(unordered, 0)
+
+		// more duplicates go to the list, in their place, splitting its pages
+		const int numNew = 3000;
+		std::vector<RecordId> rids(numNew);
+		for (int k = 0; k < numNew; k++)
+		{
+			rids[k].page_number = (k % 2 == 0) ? 0x10000 + k : 0x30000 - k;
+			rids[k].slot_number = 1;
+			rids[k].padding = 0;
+			index.insertEntry(&key, rids[k]);
+		}
+		checkPassFail(index.getNodeStatus(), true)
+		std::vector<RecordId> all;
+		checkPassFail((int) index.lookup(&key, all), relationSize / 4 + numNew)
+		checkPassFail(batchScanMatches(&index, 0, GTE, 3, LTE, 1000), true)
+
+		// a scan picks up where it was after the list changed
+		RecordId rid;
+		int count = 0;
+		ScanCursor cursor = index.openScan(&key, GTE, &key, LTE);
+		for (; count < 2000; count++)
+		{
+			cursor.scanNext(rid);
+		}
+		RecordId last;
+		last.page_number = 0x40000;
+		last.slot_number = 1;
+		last.padding = 0;
+		index.insertEntry(&key, last);
+		while (cursor.tryScanNext(rid))
+		{
+			count++;
+		}
+		cursor.endScan();
+		checkPassFail(count, relationSize / 4 + numNew + 1)
+
+		// duplicates are kept in record id order whatever order they come in, and a scan parked among them picks
+		// up after the last one it returned once they move to a posting list
+		int newKey = 7;
+		int numPlain = INTARRAYLEAFSIZE - 4;
+		for (int k = 0; k < numPlain; k++)
+		{
+			rid.page_number = 0x50000 + ((k % 2 == 0) ? k : numPlain - k);
+			rid.slot_number = 1;
+			rid.padding = 0;
+			index.insertEntry(&newKey, rid);
+		}
+		std::vector<RecordId> scanned(3);
+		cursor = index.openScan(&newKey, GTE, &newKey, LTE);
+		for (int k = 0; k < 3; k++)
+		{
+			cursor.scanNext(scanned[k]);
+		}
+		rid.page_number = 0x60000;
+		index.insertEntry(&newKey, rid);
+		while (cursor.tryScanNext(rid))
+		{
+			scanned.push_back(rid);
+		}
+		cursor.endScan();
+		checkPassFail((int) scanned.size(), numPlain + 1)
+		unordered = 0;
+		for (size_t i = 1; i < scanned.size(); i++)
+		{
+			unordered += !(scanned[i - 1].page_number < scanned[i].page_number);
+		}
+		checkPassFail(unordered, 0)
+
+		// deleting every entry of a key frees its list
+		for (int k = 0; k < numNew; k++)
+		{
+			index.deleteEntry(&key, rids[k]);
+		}
+		index.deleteEntry(&key, last);
+		for (size_t i = 0; i < found.size(); i++)
+		{
+			index.deleteEntry(&key, found[i]);
+		}
+		checkPassFail(intScan(&index, 0, GTE, 3, LTE), relationSize - relationSize / 4)
+		bool thrown = false;
+		try
+		{
+			index.deleteEntry(&key, found[0]);
+		}
+		catch(const NoSuchKeyFoundException &e)
+		{
+			thrown = true;
+		}
+		checkPassFail(thrown, true)
+		found.clear();
+		checkPassFail((int) index.lookup(&key, found), 0)
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Test 39 failed" << std::endl;
+	}
+
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+	deleteRelation();
+}
+
+void test40()
+{
+	// the statistics of the keys estimate ranges without reading the tree, and are kept with the index
+	std::cout << "Test 40: key statistics" << std::endl;
+	createRelationForward();
+	try
+	{
+		int low = 0;
+		int high = relationSize;
+		int from = 1000;
+		int to = 2000;
+		{
+			BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+			checkPassFail((std::fabs(index.estimateRange(&low, GTE, &high, LT) - relationSize) < 1), true)
+			checkPassFail((std::fabs(index.estimateRange(&from, GTE, &to, LT) - 1000) < 50), true)
+			checkPassFail((std::fabs(index.estimateRange(&from, GT, &from, LTE)) < 1), true)
+			checkPassFail((std::fabs(index.estimateDistinctKeys() - relationSize) < relationSize / 10), true)
+
+			// entries inserted past the last key stretch the last bucket, deleted ones are taken out again
+			const int numNew = 100;
+			std::vector<RecordId> rids(numNew);
+			for (int k = 0; k < numNew; k++)
+			{
+				int key = relationSize + k;
+				rids[k].page_number = 0x10000 + k;
+				rids[k].slot_number = 1;
+				rids[k].padding = 0;
+				index.insertEntry(&key, rids[k]);
+			}
+			int end = relationSize + 1000;
+			checkPassFail((std::fabs(index.estimateRange(&high, GTE, &end, LT) - numNew) < 5), true)
+			for (int k = 0; k < numNew / 2; k++)
+			{
+				int key = relationSize + k;
+				index.deleteEntry(&key, rids[k]);
+			}
+			checkPassFail((std::fabs(index.estimateRange(&low, GTE, &end, LT) - (relationSize + numNew / 2)) < 1), true)
+		}
+
+		// opening the index again reads them from its meta page
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		int end = relationSize + 1000;
+		checkPassFail((std::fabs(index.estimateRange(&low, GTE, &end, LT) - (relationSize + 100 / 2)) < 1), true)
+		checkPassFail((std::fabs(index.estimateRange(&from, GTE, &to, LT) - 1000) < 50), true)
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Test 40 failed" << std::endl;
+	}
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+	deleteRelation();
+
+	// a key repeated in many entries fills buckets of its own
+	createRelationDuplicates(4);
+	try
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		int key = 2;
+		int missing = 7;
+		checkPassFail((std::fabs(index.estimateRange(&key, GTE, &key, LTE) - relationSize / 4) < relationSize / 40), true)
+		checkPassFail((std::fabs(index.estimateRange(&missing, GTE, &missing, LTE)) < 1), true)
+		checkPassFail((std::fabs(index.estimateDistinctKeys() - 4) < 1), true)
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Test 40 failed" << std::endl;
+	}
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+	deleteRelation();
+}
+
+void test41()
+{
+	// a counted index counts ranges, ranks keys and finds entries by position from the root
+	std::cout << "Test 41: counted index" << std::endl;
+	createRelationRandom();
+	try
+	{
+		std::vector<RecordId> all;
+		std::vector<RecordId> found;
+		{
+			BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, true, 8, 8);
+			checkPassFail(index.isCounted(), true)
+			checkPassFail(index.getNodeStatus(), false)
+
+			const int ranges[][4] = { {0, GTE, relationSize, LT}, {25, GT, 40, LT}, {0, GTE, 1, LT},
+				{4999, GTE, 4999, LTE}, {100, GT, 4000, LTE}, {-10, GTE, 10, LT}, {6000, GT, 7000, LTE} };
+			for (size_t r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++)
+			{
+				checkPassFail((int) index.countRange(&ranges[r][0], (Operator) ranges[r][1], &ranges[r][2], (Operator) ranges[r][3]),
+					ridScan(&index, ranges[r][0], (Operator) ranges[r][1], ranges[r][2], (Operator) ranges[r][3], 0, found))
+			}
+
+			int key = 1234;
+			int past = 6000;
+			checkPassFail((int) index.rank(&key), 1234)
+			checkPassFail((int) index.rank(&past), relationSize)
+			RecordId rid;
+			found.clear();
+			index.lookup(&key, found);
+			checkPassFail((index.select(1234, rid) && rid == found[0]), true)
+			checkPassFail(index.select(relationSize, rid), false)
+
+			// a scan opened at an offset starts at the entry that many after the first one in range
+			int low = 1000;
+			int high = 2000;
+			key = 1250;
+			found.clear();
+			index.lookup(&key, found);
+			ScanCursor cursor = index.openScan(&low, GTE, &high, LT, 250);
+			cursor.scanNext(rid);
+			checkPassFail((rid == found[0]), true)
+			cursor.endScan();
+			checkPassFail(ridScan(&index, low, GTE, high, LT, 250, found), 750)
+			checkPassFail(index.tryOpenScan(cursor, &low, GTE, &high, LT, 1000), false)
+
+			// entries inserted and deleted, many of them duplicates going to posting lists, keep the counts right
+			const int numNew = 3000;
+			std::vector<RecordId> rids(numNew);
+			std::vector<int> keys(numNew);
+			for (int k = 0; k < numNew; k++)
+			{
+				keys[k] = (k * 7) % 100;
+				rids[k].page_number = 0x10000 + k;
+				rids[k].slot_number = 1;
+				rids[k].padding = 0;
+				index.insertEntry(&keys[k], rids[k]);
+			}
+			for (int k = 0; k < numNew; k += 3)
+			{
+				index.deleteEntry(&keys[k], rids[k]);
+			}
+			for (size_t r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++)
+			{
+				checkPassFail((int) index.countRange(&ranges[r][0], (Operator) ranges[r][1], &ranges[r][2], (Operator) ranges[r][3]),
+					ridScan(&index, ranges[r][0], (Operator) ranges[r][1], ranges[r][2], (Operator) ranges[r][3], 0, found))
+			}
+
+			// every position and offset agrees with a full scan
+			low = -1;
+			high = relationSize;
+			int total = ridScan(&index, low, GTE, high, LT, 0, all);
+			checkPassFail(total, relationSize + numNew - numNew / 3)
+			int mismatches = 0;
+			for (int p = 0; p < total; p += 37)
+			{
+				mismatches += !(index.select(p, rid) && rid == all[p]);
+				if (p % 11 == 0)
+				{
+					mismatches += ridScan(&index, low, GTE, high, LT, p, found) != total - p || !(found[0] == all[p]);
+				}
+			}
+			checkPassFail(mismatches, 0)
+			key = 50;
+			checkPassFail((int) index.rank(&key), (int) index.countRange(&low, GTE, &key, LT))
+		}
+
+		// the counts are kept in the nodes, and the index is only opened again as counted
+		{
+			BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, true, 8, 8);
+			int low = -1;
+			int high = relationSize;
+			checkPassFail((int) index.countRange(&low, GTE, &high, LT), (int) all.size())
+		}
+
+		// opened with other capacities it keeps those it was built with, where its counts are
+		{
+			BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, true);
+			int low = -1;
+			int high = relationSize;
+			int key = 1234;
+			RecordId rid;
+			checkPassFail((int) index.countRange(&low, GTE, &high, LT), (int) all.size())
+			checkPassFail((int) index.rank(&key), (int) index.countRange(&low, GTE, &key, LT))
+			checkPassFail((index.select(500, rid) && rid == all[500]), true)
+
+			key = relationSize + 10;
+			rid.page_number = 0x30000;
+			rid.slot_number = 1;
+			rid.padding = 0;
+			for (int k = 0; k < 100; k++)
+			{
+				index.insertEntry(&key, rid);
+				rid.page_number++;
+			}
+			high = relationSize + 20;
+			checkPassFail((int) index.countRange(&low, GTE, &high, LT), (int) all.size() + 100)
+			checkPassFail((int) index.rank(&key), (int) all.size())
+		}
+		bool thrown = false;
+		try
+		{
+			BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, 8, 8);
+		}
+		catch(const BadIndexInfoException &e)
+		{
+			thrown = true;
+		}
+		checkPassFail(thrown, true)
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Test 41 failed" << std::endl;
+	}
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+
+	// an index without counts scans to count and steps over the entries skipped
+	try
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, 8, 8);
+		int low = 1000;
+		int high = 2000;
+		std::vector<RecordId> found;
+		checkPassFail((int) index.countRange(&low, GTE, &high, LT), 1000)
+		checkPassFail(ridScan(&index, low, GTE, high, LT, 250, found), 750)
+		int key = 1250;
+		std::vector<RecordId> expected;
+		index.lookup(&key, expected);
+		checkPassFail((found[0] == expected[0]), true)
+		bool thrown = false;
+		try
+		{
+			index.rank(&key);
+		}
+		catch(const BadIndexInfoException &e)
+		{
+			thrown = true;
+		}
+		checkPassFail(thrown, true)
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Test 41 failed" << std::endl;
+	}
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+
+	// STRING bounds that tie with every key on its prefix are counted against the full strings
+	for (FileIterator iter = file1->begin(); iter != file1->end(); ++iter)
+	{
+		Page page = *iter;
+		for (PageIterator pageIter = page.begin(); pageIter != page.end(); ++pageIter)
+		{
+			RECORD rec = *(reinterpret_cast<const RECORD*>((*pageIter).data()));
+			sprintf(rec.s, "a long shared prefix %05d", rec.i);
+			page.updateRecord(pageIter.getCurrentRecord(), std::string(reinterpret_cast<char*>(&rec), sizeof(RECORD)));
+		}
+		file1->writePage(page.page_number(), page);
+	}
+	try
+	{
+		BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple,s), STRING, true, 4, 6);
+		char low[64], high[64];
+		sprintf(low, "a long shared prefix %05d", 25);
+		sprintf(high, "a long shared prefix %05d", 40);
+		checkPassFail((int) index.countRange(low, GT, high, LT), 14)
+		checkPassFail((int) index.countRange(low, GTE, high, LTE), 16)
+		checkPassFail((int) index.countRange(low, GTE, "zzzzz", LT), relationSize - 25)
+		checkPassFail((int) index.rank(low), 25)
+		checkPassFail((int) index.rank(high), 40)
+
+		// the entries in range are not in one place among the ties, so those skipped are stepped over
+		int count = 0;
+		RecordId rid;
+		ScanCursor cursor = index.openScan(low, GTE, high, LTE, 6);
+		while (cursor.tryScanNext(rid))
+		{
+			count++;
+		}
+		cursor.endScan();
+		checkPassFail(count, 10)
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Test 41 failed" << std::endl;
+	}
+	try
+	{
+		File::remove(stringIndexName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+	deleteRelation();
+}
+
+void test42()
+{
+	// descending scans follow the left sibling links of the leaves, which splits and merges keep up
+	std::cout << "Test 42: descending scans" << std::endl;
+	createRelationRandom();
+	try
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, 8, 8);
+		const int ranges[][4] = { {0, GTE, relationSize, LT}, {25, GT, 40, LT}, {0, GTE, 1, LT},
+			{4999, GTE, 4999, LTE}, {100, GT, 4000, LTE}, {-10, GTE, 10, LT}, {6000, GT, 7000, LTE} };
+		int mismatches = 0;
+		for (size_t r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++)
+		{
+			mismatches += !descendingScanMatches(&index, ranges[r][0], (Operator) ranges[r][1], ranges[r][2], (Operator) ranges[r][3]);
+		}
+		checkPassFail(mismatches, 0)
+
+		// the largest keys come first
+		int low = 0;
+		int high = relationSize;
+		int misplaced = 0;
+		ScanCursor cursor = index.openScan(&low, GTE, &high, LT, 0, DESCENDING);
+		for (int key = relationSize - 1; key >= relationSize - 10; key--)
+		{
+			RecordId rid;
+			std::vector<RecordId> expected;
+			cursor.scanNext(rid);
+			index.lookup(&key, expected);
+			misplaced += !(rid == expected[0]);
+		}
+		cursor.endScan();
+		checkPassFail(misplaced, 0)
+		high = 0;
+		checkPassFail(index.tryOpenScan(cursor, &low, GT, &high, LTE, 0, DESCENDING), false)
+
+		// leaves split by inserts, one at a time and in a batch, and merged by deletes stay linked both ways
+		const int numNew = 2000;
+		std::vector<RecordId> rids(numNew);
+		std::vector<int> keys(numNew);
+		std::vector<const void*> keyPtrs(numNew);
+		for (int k = 0; k < numNew; k++)
+		{
+			keys[k] = (k * 7919) % relationSize;
+			keyPtrs[k] = &keys[k];
+			rids[k].page_number = 0x10000 + k;
+			rids[k].slot_number = 1;
+			rids[k].padding = 0;
+		}
+		for (int k = 0; k < numNew / 2; k++)
+		{
+			index.insertEntry(&keys[k], rids[k]);
+		}
+		index.insertBatch(&keyPtrs[numNew / 2], &rids[numNew / 2], numNew / 2);
+		mismatches = 0;
+		for (size_t r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++)
+		{
+			mismatches += !descendingScanMatches(&index, ranges[r][0], (Operator) ranges[r][1], ranges[r][2], (Operator) ranges[r][3]);
+		}
+		checkPassFail(mismatches, 0)
+
+		for (int k = 0; k < numNew; k++)
+		{
+			index.deleteEntry(&keys[k], rids[k]);
+		}
+		std::vector<RecordId> found;
+		for (int key = 1000; key < 3000; key++)
+		{
+			found.clear();
+			index.lookup(&key, found);
+			index.deleteEntry(&key, found[0]);
+		}
+		mismatches = 0;
+		for (size_t r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++)
+		{
+			mismatches += !descendingScanMatches(&index, ranges[r][0], (Operator) ranges[r][1], ranges[r][2], (Operator) ranges[r][3]);
+		}
+		checkPassFail(mismatches, 0)
+		checkPassFail(ridScan(&index, 0, GTE, relationSize, LT, 0, found, DESCENDING), relationSize - 2000)
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Test 42 failed" << std::endl;
+	}
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+
+	// a counted index finds the first entry of a descending scan at an offset from the root
+	try
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, true, 8, 8);
+		std::vector<RecordId> all;
+		std::vector<RecordId> found;
+		int total = ridScan(&index, 100, GT, 4000, LTE, 0, all);
+		int mismatches = 0;
+		for (int p = 1; p < total; p += 97)
+		{
+			mismatches += ridScan(&index, 100, GT, 4000, LTE, p, found, DESCENDING) != total - p ||
+				!(found[0] == all[total - 1 - p]) || !(found.back() == all[0]);
+		}
+		checkPassFail(mismatches, 0)
+		checkPassFail(ridScan(&index, 100, GT, 4000, LTE, total, found, DESCENDING), 0)
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Test 42 failed" << std::endl;
+	}
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+	deleteRelation();
+
+	// posting lists are read from their last page back
+	createRelationDuplicates(4);
+	try
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		checkPassFail(descendingScanMatches(&index, 0, GTE, 3, LTE), true)
+		checkPassFail(descendingScanMatches(&index, 0, GT, 3, LT), true)
+
+		// more duplicates split the pages of the list
+		int key = 1;
+		const int numNew = 3000;
+		std::vector<RecordId> rids(numNew);
+		for (int k = 0; k < numNew; k++)
+		{
+			rids[k].page_number = (k % 2 == 0) ? 0x10000 + k : 0x30000 - k;
+			rids[k].slot_number = 1;
+			rids[k].padding = 0;
+			index.insertEntry(&key, rids[k]);
+		}
+		checkPassFail(descendingScanMatches(&index, 0, GTE, 3, LTE), true)
+
+		// a descending scan picks up where it was after the list changed
+		RecordId rid;
+		int count = 0;
+		ScanCursor cursor = index.openScan(&key, GTE, &key, LTE, 0, DESCENDING);
+		for (; count < 2000; count++)
+		{
+			cursor.scanNext(rid);
+		}
+		RecordId first;
+		first.page_number = 0;
+		first.slot_number = 1;
+		first.padding = 0;
+		index.insertEntry(&key, first);
+		while (cursor.tryScanNext(rid))
+		{
+			count++;
+		}
+		cursor.endScan();
+		checkPassFail(count, relationSize / 4 + numNew + 1)
+		checkPassFail((rid == first), true)
+
+		// emptied pages are dropped from the list
+		for (int k = 0; k < numNew; k++)
+		{
+			index.deleteEntry(&key, rids[k]);
+		}
+		checkPassFail(descendingScanMatches(&index, 0, GTE, 3, LTE), true)
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Test 42 failed" << std::endl;
+	}
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+	deleteRelation();
+
+	// STRING entries sharing their key prefix come in descending record id order, not full string order
+	createRelationRandom();
+	for (FileIterator iter = file1->begin(); iter != file1->end(); ++iter)
+	{
+		Page page = *iter;
+		for (PageIterator pageIter = page.begin(); pageIter != page.end(); ++pageIter)
+		{
+			RECORD rec = *(reinterpret_cast<const RECORD*>((*pageIter).data()));
+			sprintf(rec.s, "a long shared prefix %05d", rec.i);
+			page.updateRecord(pageIter.getCurrentRecord(), std::string(reinterpret_cast<char*>(&rec), sizeof(RECORD)));
+		}
+		file1->writePage(page.page_number(), page);
+	}
+	try
+	{
+		BTreeIndex index(relationName, stringIndexName, bufMgr, offsetof(tuple,s), STRING, 4, 6);
+		char low[64], high[64];
+		sprintf(low, "a long shared prefix %05d", 25);
+		sprintf(high, "a long shared prefix %05d", 40);
+		std::vector<RecordId> found;
+		RecordId rid;
+		ScanCursor cursor = index.openScan(low, GTE, high, LTE, 0, DESCENDING);
+		while (cursor.tryScanNext(rid))
+		{
+			found.push_back(rid);
+		}
+		cursor.endScan();
+		checkPassFail((int) found.size(), 16)
+		int misplaced = 0;
+		for (size_t k = 1; k < found.size(); k++)
+		{
+			misplaced += found[k].page_number > found[k - 1].page_number ||
+				(found[k].page_number == found[k - 1].page_number && found[k].slot_number >= found[k - 1].slot_number);
+		}
+		checkPassFail(misplaced, 0)
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Test 42 failed" << std::endl;
+	}
+	try
+	{
+		File::remove(stringIndexName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+	deleteRelation();
+
+	// descending and ascending scans run alongside inserts splitting the leaves they are on
+	createRelationForward();
+	try
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, 16, 16);
+		const int numInserts = 20000;
+		std::atomic<bool> writing(true);
+		std::atomic<int> misordered(0);
+		std::vector<std::thread> readers;
+		for (int r = 0; r < 2; r++)
+		{
+			readers.push_back(std::thread([&, r]()
+			{
+				std::vector<RecordId> batch(64);
+				while (writing)
+				{
+					int low = relationSize;
+					int high = relationSize + numInserts;
+					ScanCursor cursor;
+					if (index.tryOpenScan(cursor, &low, GTE, &high, LT, 0, (r == 0) ? DESCENDING : ASCENDING))
+					{
+						PageId last = (r == 0) ? high : 0;
+						size_t returned;
+						while ((returned = cursor.scanNextBatch(&batch[0], batch.size())) > 0)
+						{
+							for (size_t i = 0; i < returned; i++)
+							{
+								misordered += (r == 0) ? batch[i].page_number >= last : batch[i].page_number <= last;
+								last = batch[i].page_number;
+							}
+						}
+						cursor.endScan();
+					}
+				}
+			}));
+		}
+
+		// the record id of an entry is its key, so that the order of the entries shows in it
+		std::vector<std::thread> writers;
+		for (int t = 0; t < 2; t++)
+		{
+			writers.push_back(std::thread([&, t]()
+			{
+				std::vector<int> keys;
+				for (int k = t; k < numInserts; k += 2)
+				{
+					keys.push_back(relationSize + k);
+				}
+				std::shuffle(keys.begin(), keys.end(), std::mt19937(t));
+				RecordId rid;
+				rid.slot_number = 1;
+				for (size_t i = 0; i < keys.size(); i++)
+				{
+					rid.page_number = keys[i];
+					index.insertEntry(&keys[i], rid);
+				}
+			}));
+		}
+		for (int t = 0; t < 2; t++)
+		{
+			writers[t].join();
+		}
+		writing = false;
+		for (int r = 0; r < 2; r++)
+		{
+			readers[r].join();
+		}
+		checkPassFail(misordered, 0)
+
+		std::vector<RecordId> found;
+		int misplaced = 0;
+		checkPassFail(ridScan(&index, relationSize, GTE, relationSize + numInserts, LT, 0, found, DESCENDING), numInserts)
+		for (int k = 0; k < numInserts; k++)
+		{
+			misplaced += (found[k].page_number != (PageId) (relationSize + numInserts - 1 - k));
+		}
+		checkPassFail(misplaced, 0)
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Test 42 failed" << std::endl;
+	}
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+	deleteRelation();
+}
+
+void test43()
+{
+	// a scan that deletes each entry it returns goes on with the next one, among duplicates in leaves or in
+	// posting lists, over leaves merged under it and in either direction
+	std::cout << "Test 43: deleting the entries a scan returns" << std::endl;
+	createRelationForward();
+	const int occupancies[][2] = { {INTARRAYNONLEAFSIZE, INTARRAYLEAFSIZE}, {8, 8} };
+	for (int o = 0; o < 2; o++)
+	{
+		try
+		{
+			BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER, occupancies[o][0], occupancies[o][1]);
+			int key = relationSize / 2;
+			const int numDuplicates = 24;
+			for (int d = 0; d < 2; d++)
+			{
+				ScanDirection direction = (d == 0) ? ASCENDING : DESCENDING;
+				for (int k = 0; k < numDuplicates; k++)
+				{
+					RecordId rid;
+					rid.page_number = 0x10000 + ((k % 2 == 0) ? k : numDuplicates - k);
+					rid.slot_number = 1;
+					rid.padding = 0;
+					index.insertEntry(&key, rid);
+				}
+
+				int count = 0;
+				RecordId rid;
+				ScanCursor cursor = index.openScan(&key, GTE, &key, LTE, 0, direction);
+				while (cursor.tryScanNext(rid))
+				{
+					index.deleteEntry(&key, rid);
+					count++;
+				}
+				cursor.endScan();
+				checkPassFail(count, numDuplicates + (d == 0))
+				std::vector<RecordId> found;
+				checkPassFail((int) index.lookup(&key, found), 0)
+			}
+
+			// the rows around the duplicates stay
+			checkPassFail(intScan(&index, 0, GTE, relationSize, LT), relationSize - 1)
+			int count = 0;
+			int low = relationSize / 4;
+			int high = relationSize / 2 + relationSize / 4;
+			RecordId rid;
+			ScanCursor cursor = index.openScan(&low, GTE, &high, LT, 0, DESCENDING);
+			while (cursor.tryScanNext(rid))
+			{
+				int deleted = high - 1 - count - (high - 1 - count <= key);
+				index.deleteEntry(&deleted, rid);
+				count++;
+			}
+			cursor.endScan();
+			checkPassFail(count, high - low - 1)
+			checkPassFail(intScan(&index, 0, GTE, relationSize, LT), relationSize - (high - low))
+		}
+		catch(std::exception &e)
+		{
+			std::cout << "Test 43 failed" << std::endl;
+		}
+
+		try
+		{
+			File::remove(intIndexName);
+		}
+		catch(const FileNotFoundException &e)
+		{
+		}
+	}
+	deleteRelation();
+
+	// the duplicates of a key in a posting list
+	createRelationDuplicates(4);
+	try
+	{
+		BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple,i), INTEGER);
+		for (int key = 1; key <= 2; key++)
+		{
+			int count = 0;
+			RecordId rid;
+			ScanCursor cursor = index.openScan(&key, GTE, &key, LTE, 0, (key == 1) ? ASCENDING : DESCENDING);
+			while (cursor.tryScanNext(rid))
+			{
+				index.deleteEntry(&key, rid);
+				count++;
+			}
+			cursor.endScan();
+			checkPassFail(count, relationSize / 4)
+		}
+		checkPassFail(intScan(&index, 0, GTE, 3, LTE), relationSize / 2)
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Test 43 failed" << std::endl;
+	}
+
+	try
+	{
+		File::remove(intIndexName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+	deleteRelation();
+}
+
+void test44()
+{
+	// threads pin and unpin pages of a file through a buffer pool smaller than the file, so that pages are
+	// pinned in their frames while others are read into frames taken from other pages
+	std::cout << "Test 44: concurrent pins" << std::endl;
+	const std::string blobName = "relA.pins";
+	const int numPages = 60;
+	const int numThreads = 4;
+	const int numReads = 20000;
+	try
+	{
+		BufMgr pool(20);
+		BlobFile blob(blobName, true);
+		std::vector<PageId> pageNos;
+		for (int i = 0; i < numPages; i++)
+		{
+			PageId pageNo;
+			Page* page;
+			pool.allocPage(&blob, pageNo, page);
+			memcpy((char*) page, &pageNo, sizeof(pageNo));
+			pool.unPinPage(&blob, pageNo, true);
+			pageNos.push_back(pageNo);
+		}
+
+		// each page read holds its own number, whichever frame it was read into
+		std::atomic<int> wrong(0);
+		std::atomic<int> failed(0);
+		std::vector<std::thread> threads;
+		for (int t = 0; t < numThreads; t++)
+		{
+			threads.push_back(std::thread([&, t]()
+			{
+				std::mt19937 gen(t);
+				for (int i = 0; i < numReads; i++)
+				{
+					// most reads go to a few pages, which stay in the buffer pool
+					PageId pageNo = pageNos[(gen() % 4 == 0) ? gen() % numPages : gen() % 4];
+					try
+					{
+						Page* page;
+						pool.readPage(&blob, pageNo, page);
+						PageId stamp;
+						memcpy(&stamp, (char*) page, sizeof(stamp));
+						wrong += (stamp != pageNo);
+						pool.unPinPage(&blob, pageNo, false);
+					}
+					catch(std::exception &e)
+					{
+						failed++;
+					}
+				}
+			}));
+		}
+		for (int t = 0; t < numThreads; t++)
+		{
+			threads[t].join();
+		}
+		checkPassFail(wrong, 0)
+		checkPassFail(failed, 0)
+		checkPassFail((pool.getBufStats().diskreads > numPages), true)
+
+		// every pin was let go
+		pool.flushFile(&blob);
+	}
+	catch(std::exception &e)
+	{
+		std::cout << "Test 44 failed" << std::endl;
+	}
+
+	try
+	{
+		File::remove(blobName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+}
+
+void allTests(BTreeIndex* index, int relSize)
+{
+	// checks that all entries from [0, relSize)) are in the B+ tree in one search
+	checkPassFail(intScan(index, 0,  GTE, relSize, LT), relSize)
+	// checks that all entries from [0, relSize)) are in the B+ tree individually
+	for (int i = 0; i < relSize; i++)
+	{
+		checkPassFail(intScan(index,i, GTE, i + 1, LT), 1)
+		checkPassFail(intScan(index,i - 1, GT, i , LTE), 1)
+	}
+}
+
+// -----------------------------------------------------------------------------
+// createRelationForward
+// -----------------------------------------------------------------------------
+
+void createRelationForward()
+{
+	std::vector<RecordId> ridVec;
+  // destroy any old copies of relation file
+	try
+	{
+		File::remove(relationName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+
+  file1 = new PageFile(relationName, true);
+
+  // initialize all of record1.s to keep purify happy
+  memset(record1.s, ' ', sizeof(record1.s));
+	PageId new_page_number;
+  Page new_page = file1->allocatePage(new_page_number);
+
+  // Insert a bunch of tuples into the relation.
+  for(int i = 0; i < relationSize; i++ )
+	{
+    sprintf(record1.s, "%05d string record", i);
+    record1.i = i;
+    record1.d = (double)i;
+    std::string new_data(reinterpret_cast<char*>(&record1), sizeof(record1));
+
+		while(1)
+		{
+			try
+			{
+    		new_page.insertRecord(new_data);
+				break;
+			}
+			catch(const InsufficientSpaceException &e)
+			{
+				file1->writePage(new_page_number, new_page);
+  			new_page = file1->allocatePage(new_page_number);
+			}
+		}
+  }
+
+	file1->writePage(new_page_number, new_page);
+}
+
+// -----------------------------------------------------------------------------
+// createRelationBackward
+// -----------------------------------------------------------------------------
+
+void createRelationBackward()
+{
+  // destroy any old copies of relation file
+	try
+	{
+		File::remove(relationName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+  file1 = new PageFile(relationName, true);
+
+  // initialize all of record1.s to keep purify happy
+  memset(record1.s, ' ', sizeof(record1.s));
+	PageId new_page_number;
+  Page new_page = file1->allocatePage(new_page_number);
+
+  // Insert a bunch of tuples into the relation.
+  for(int i = relationSize - 1; i >= 0; i-- )
+	{
+    sprintf(record1.s, "%05d string record", i);
+    record1.i = i;
+    record1.d = i;
+
+    std::string new_data(reinterpret_cast<char*>(&record1), sizeof(RECORD));
+
+		while(1)
+		{
+			try
+			{
+    		new_page.insertRecord(new_data);
+				break;
+			}
+			catch(const InsufficientSpaceException &e)
+			{
+				file1->writePage(new_page_number, new_page);
+  			new_page = file1->allocatePage(new_page_number);
+			}
+		}
+  }
+
+	// write to page
+	file1->writePage(new_page_number, new_page);
+}
+
+// -----------------------------------------------------------------------------
+// createRelationRandom
+// -----------------------------------------------------------------------------
+
+void createRelationRandom()
+{
+  // destroy any old copies of relation file
+	try
+	{
+		File::remove(relationName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+  file1 = new PageFile(relationName, true);
+
+  // initialize all of record1.s to keep purify happy
+  memset(record1.s, ' ', sizeof(record1.s));
+	PageId new_page_number;
+  Page new_page = file1->allocatePage(new_page_number);
+
+  // insert records in random order
+
+  std::vector<int> intvec(relationSize);
+  for( int i = 0; i < relationSize; i++ )
+  {
+    intvec[i] = i;
+  }
+
+  long pos;
+  int val;
+	int i = 0;
+  while( i < relationSize )
+  {
+    pos = rand() % (relationSize-i);
+    val = intvec[pos];
+    sprintf(record1.s, "%05d string record", val);
+    record1.i = val;
+    record1.d = val;
+
+    std::string new_data(reinterpret_cast<char*>(&record1), sizeof(RECORD));
+
+		while(1)
+		{
+			try
+			{
+    		new_page.insertRecord(new_data);
+				break;
+			}
+			catch(const InsufficientSpaceException &e)
+			{
+      	file1->writePage(new_page_number, new_page);
+  			new_page = file1->allocatePage(new_page_number);
+			}
+		}
+
+		int temp = intvec[relationSize-1-i];
+		intvec[relationSize-1-i] = intvec[pos];
+		intvec[pos] = temp;
+		i++;
+  }
+  
+	file1->writePage(new_page_number, new_page);
+}
+
+// -----------------------------------------------------------------------------
+// createRelationRandomSize
+// -----------------------------------------------------------------------------
+void createRelationRandomSize(int relSize)
+{
+	// inserts specified number of records in random order
+  // destroy any old copies of relation file
+	try
+	{
+		File::remove(relationName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+  file1 = new PageFile(relationName, true);
+
+  // initialize all of record1.s to keep purify happy
+  memset(record1.s, ' ', sizeof(record1.s));
+	PageId new_page_number;
+  Page new_page = file1->allocatePage(new_page_number);
+
+  // insert records in random order
 
   std::vector<int> intvec(relSize);
   for( int i = 0; i < relSize; i++ )
@@ -913,6 +3632,53 @@ void createRelationRandomSize(int relSize)
 	file1->writePage(new_page_number, new_page);
 }
 
+// -----------------------------------------------------------------------------
+// createRelationDuplicates
+// -----------------------------------------------------------------------------
+
+void createRelationDuplicates(int numKeys)
+{
+	// inserts records in order whose INTEGER attribute only takes numKeys values, each in as many records
+  // destroy any old copies of relation file
+	try
+	{
+		File::remove(relationName);
+	}
+	catch(const FileNotFoundException &e)
+	{
+	}
+  file1 = new PageFile(relationName, true);
+
+  // initialize all of record1.s to keep purify happy
+  memset(record1.s, ' ', sizeof(record1.s));
+	PageId new_page_number;
+  Page new_page = file1->allocatePage(new_page_number);
+
+  for(int i = 0; i < relationSize; i++ )
+	{
+    sprintf(record1.s, "%05d string record", i);
+    record1.i = i % numKeys;
+    record1.d = (double)i;
+    std::string new_data(reinterpret_cast<char*>(&record1), sizeof(record1));
+
+		while(1)
+		{
+			try
+			{
+    		new_page.insertRecord(new_data);
+				break;
+			}
+			catch(const InsufficientSpaceException &e)
+			{
+				file1->writePage(new_page_number, new_page);
+  			new_page = file1->allocatePage(new_page_number);
+			}
+		}
+  }
+
+	file1->writePage(new_page_number, new_page);
+}
+
 // -----------------------------------------------------------------------------
 // indexTests
 // -----------------------------------------------------------------------------
@@ -949,6 +3715,120 @@ void intTests()
 }
 
 int intScan(BTreeIndex * index, int lowVal, Operator lowOp, int highVal, Operator highOp)
+{
+	return keyScan(index, lowVal, lowOp, highVal, highOp);
+}
+
+int doubleScan(BTreeIndex * index, double lowVal, Operator lowOp, double highVal, Operator highOp)
+{
+	return keyScan(index, lowVal, lowOp, highVal, highOp);
+}
+
+int stringScan(BTreeIndex * index, std::string lowVal, Operator lowOp, std::string highVal, Operator highOp)
+{
+	return keyScan(index, lowVal, lowOp, highVal, highOp);
+}
+
+// keys are passed to the index as a pointer to the integer/double or to the char string
+template <class T>
+const void* keyParam(const T& key)
+{
+	return &key;
+}
+
+const void* keyParam(const std::string& key)
+{
+	return key.c_str();
+}
+
+int ridScan(BTreeIndex* index, int lowVal, Operator lowOp, int highVal, Operator highOp, size_t offset,
+	std::vector<RecordId>& outRids, ScanDirection direction)
+{
+	// the record ids of the entries in range after the first offset ones, without reading the records
+	outRids.clear();
+	ScanCursor cursor;
+	if (!index->tryOpenScan(cursor, &lowVal, lowOp, &highVal, highOp, offset, direction))
+	{
+		return 0;
+	}
+	RecordId rid;
+	while (cursor.tryScanNext(rid))
+	{
+		outRids.push_back(rid);
+	}
+	cursor.endScan();
+	return outRids.size();
+}
+
+// compares a descending scan, fetched one entry at a time and in batches, against the ascending scan of the same range
+bool descendingScanMatches(BTreeIndex* index, int lowVal, Operator lowOp, int highVal, Operator highOp)
+{
+	std::vector<RecordId> ascending;
+	std::vector<RecordId> descending;
+	ridScan(index, lowVal, lowOp, highVal, highOp, 0, ascending);
+	ridScan(index, lowVal, lowOp, highVal, highOp, 0, descending, DESCENDING);
+
+	std::vector<RecordId> batched;
+	ScanCursor cursor;
+	if (index->tryOpenScan(cursor, &lowVal, lowOp, &highVal, highOp, 0, DESCENDING))
+	{
+		RecordId batch[7];
+		size_t count;
+		while ((count = cursor.scanNextBatch(batch, 7)) > 0)
+		{
+			batched.insert(batched.end(), batch, batch + count);
+		}
+		cursor.endScan();
+	}
+	return descending.size() == ascending.size() && batched.size() == ascending.size() &&
+		std::equal(descending.begin(), descending.end(), ascending.rbegin()) &&
+		std::equal(batched.begin(), batched.end(), ascending.rbegin());
+}
+
+// compares a scan fetched in batches of batchSize record ids against the same scan fetched one entry at a time
+template <class T>
+bool batchScanMatches(BTreeIndex * index, T lowVal, Operator lowOp, T highVal, Operator highOp, size_t batchSize)
+{
+	std::vector<RecordId> expected;
+	RecordId scanRid;
+	ScanCursor single = index->openScan(keyParam(lowVal), lowOp, keyParam(highVal), highOp);
+	try
+	{
+		while(1)
+		{
+			single.scanNext(scanRid);
+			expected.push_back(scanRid);
+		}
+	}
+	catch(const IndexScanCompletedException &e)
+	{
+	}
+
+	std::vector<RecordId> batched;
+	std::vector<RecordId> batch(batchSize);
+	ScanCursor cursor = index->openScan(keyParam(lowVal), lowOp, keyParam(highVal), highOp);
+	size_t returned;
+	while ((returned = cursor.scanNextBatch(&batch[0], batchSize)) > 0)
+	{
+		batched.insert(batched.end(), batch.begin(), batch.begin() + returned);
+	}
+
+	if (batched.size() != expected.size())
+	{
+		return false;
+	}
+	for (size_t i = 0; i < expected.size(); i++)
+	{
+		if (batched[i].page_number != expected[i].page_number || batched[i].slot_number != expected[i].slot_number)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+template <class T>
+int keyScan(BTreeIndex * index, T lowVal, Operator lowOp, T highVal, Operator highOp)
 {
   RecordId scanRid;
 	Page *curPage;
@@ -961,38 +3841,26 @@ int intScan(BTreeIndex * index, int lowVal, Operator lowOp, int highVal, Operato
 
   int numResults = 0;
 	
-	try
-	{
-  	index->startScan(&lowVal, lowOp, &highVal, highOp);
-	}
-	catch(const NoSuchKeyFoundException &e)
+	if (!index->tryStartScan(keyParam(lowVal), lowOp, keyParam(highVal), highOp))
 	{
     std::cout << "No Key Found satisfying the scan criteria." << std::endl;
 		return 0;
 	}
 
-	while(1)
+	while(index->tryScanNext(scanRid))
 	{
-		try
-		{
-			index->scanNext(scanRid);
-			bufMgr->readPage(file1, scanRid.page_number, curPage);
-			RECORD myRec = *(reinterpret_cast<const RECORD*>(curPage->getRecord(scanRid).data()));
-			bufMgr->unPinPage(file1, scanRid.page_number, false);
+		bufMgr->readPage(file1, scanRid.page_number, curPage);
+		RECORD myRec = *(reinterpret_cast<const RECORD*>(curPage->getRecord(scanRid).data()));
+		bufMgr->unPinPage(file1, scanRid.page_number, false);
 
-			if( numResults < 5 )
-			{
-				std::cout << "at:" << scanRid.page_number << "," << scanRid.slot_number;
-				std::cout << " -->:" << myRec.i << ":" << myRec.d << ":" << myRec.s << ":" <<std::endl;
-			}
-			else if( numResults == 5 )
-			{
-				std::cout << "..." << std::endl;
-			}
+		if( numResults < 5 )
+		{
+			std::cout << "at:" << scanRid.page_number << "," << scanRid.slot_number;
+			std::cout << " -->:" << myRec.i << ":" << myRec.d << ":" << myRec.s << ":" <<std::endl;
 		}
-		catch(const IndexScanCompletedException &e)
+		else if( numResults == 5 )
 		{
-			break;
+			std::cout << "..." << std::endl;
 		}
 
 		numResults++;
@@ -1008,6 +3876,33 @@ int intScan(BTreeIndex * index, int lowVal, Operator lowOp, int highVal, Operato
 	return numResults;
 }
 
+// counts the entries of a COMPOSITE index in [low, high], -1 if the record of one has i outside [lowI, highI]
+int compositeScan(BTreeIndex* index, const CompositeKey& low, const CompositeKey& high, int lowI, int highI)
+{
+	int count = 0;
+	RecordId rid;
+	ScanCursor cursor;
+	if (!index->tryOpenScan(cursor, &low, GTE, &high, LTE))
+	{
+		return 0;
+	}
+	while (cursor.tryScanNext(rid))
+	{
+		Page* page;
+		bufMgr->readPage(file1, rid.page_number, page);
+		std::string record = page->getRecord(rid);
+		bufMgr->unPinPage(file1, rid.page_number, false);
+		const RECORD* tuple = reinterpret_cast<const RECORD*>(record.data());
+		if (tuple->i < lowI || tuple->i > highI)
+		{
+			return -1;
+		}
+		count++;
+	}
+	cursor.endScan();
+	return count;
+}
+
 // -----------------------------------------------------------------------------
 // errorTests
 // -----------------------------------------------------------------------------
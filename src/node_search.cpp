@@ -0,0 +1,200 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "node_search.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NODE_SEARCH_X86
+#include <immintrin.h>
+#endif
+
+namespace badgerdb
+{
+
+// -----------------------------------------------------------------------------
+// Scalar kernels
+// -----------------------------------------------------------------------------
+
+    static int linearLowerBound(const int* keys, const int numKeys, const int key)
+    {
+        int index = 0;
+        while (index < numKeys && keys[index] < key)
+        {
+            index++;
+        }
+        return index;
+    }
+
+    /*
+    Narrows [base, base + n] down to a window that holds the lower bound without
+    branching on the comparisons, which the processor cannot predict.
+    Stops once the window has at most minWindow keys.
+    */
+    static inline const int* narrow(const int* base, int& n, const int key, const int minWindow)
+    {
+        while (n > minWindow)
+        {
+            int half = n / 2;
+            base = (base[half] < key) ? base + half : base;
+            n -= half;
+        }
+        return base;
+    }
+
+    static int binaryLowerBound(const int* keys, const int numKeys, const int key)
+    {
+        if (numKeys == 0)
+        {
+            return 0;
+        }
+        int n = numKeys;
+        const int* base = narrow(keys, n, key, 1);
+        return (base - keys) + (*base < key);
+    }
+
+#ifdef NODE_SEARCH_X86
+
+// -----------------------------------------------------------------------------
+// Vectorized kernels
+// -----------------------------------------------------------------------------
+
+    /*
+    Both kernels narrow the search with the binary search down to a window of a few
+    vectors and then count the keys in the window that are smaller than the key.
+    Since the keys are sorted, that count is the offset of the lower bound in the window.
+    */
+
+    static int sseLowerBound(const int* keys, const int numKeys, const int key)
+    {
+        int n = numKeys;
+        const int* base = narrow(keys, n, key, 16);
+
+        __m128i probe = _mm_set1_epi32(key);
+        __m128i count = _mm_setzero_si128();
+        int i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            // lanes where key > keys[i] are all ones, i.e. -1
+            __m128i block = _mm_loadu_si128((const __m128i*) (base + i));
+            count = _mm_sub_epi32(count, _mm_cmpgt_epi32(probe, block));
+        }
+        count = _mm_add_epi32(count, _mm_shuffle_epi32(count, _MM_SHUFFLE(1, 0, 3, 2)));
+        count = _mm_add_epi32(count, _mm_shuffle_epi32(count, _MM_SHUFFLE(2, 3, 0, 1)));
+        int less = _mm_cvtsi128_si32(count);
+        for (; i < n; i++)
+        {
+            less += base[i] < key;
+        }
+        return (base - keys) + less;
+    }
+
+    __attribute__((target("avx2")))
+    static int avx2LowerBound(const int* keys, const int numKeys, const int key)
+    {
+        int n = numKeys;
+        const int* base = narrow(keys, n, key, 32);
+
+        __m256i probe = _mm256_set1_epi32(key);
+        __m256i count = _mm256_setzero_si256();
+        int i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256i block = _mm256_loadu_si256((const __m256i*) (base + i));
+            count = _mm256_sub_epi32(count, _mm256_cmpgt_epi32(probe, block));
+        }
+        __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(count), _mm256_extracti128_si256(count, 1));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+        int less = _mm_cvtsi128_si32(sum);
+        for (; i < n; i++)
+        {
+            less += base[i] < key;
+        }
+        return (base - keys) + less;
+    }
+
+#endif
+
+// -----------------------------------------------------------------------------
+// Kernel selection
+// -----------------------------------------------------------------------------
+
+    static IntSearchFunction kernelFunction(const SearchKernel kernel)
+    {
+        switch (kernel)
+        {
+            case LINEAR_SEARCH:
+                return linearLowerBound;
+            case BINARY_SEARCH:
+                return binaryLowerBound;
+#ifdef NODE_SEARCH_X86
+            case SSE_SEARCH:
+                return sseLowerBound;
+            case AVX2_SEARCH:
+                return avx2LowerBound;
+#endif
+            default:
+                return binaryLowerBound;
+        }
+    }
+
+    bool searchKernelSupported(const SearchKernel kernel)
+    {
+#ifdef NODE_SEARCH_X86
+        // may run before main() while static objects are constructed
+        __builtin_cpu_init();
+#endif
+        switch (kernel)
+        {
+            case LINEAR_SEARCH:
+            case BINARY_SEARCH:
+                return true;
+#ifdef NODE_SEARCH_X86
+            case SSE_SEARCH:
+                return __builtin_cpu_supports("sse2");
+            case AVX2_SEARCH:
+                return __builtin_cpu_supports("avx2");
+#endif
+            default:
+                return false;
+        }
+    }
+
+    static SearchKernel currentKernel = BINARY_SEARCH;
+
+    static IntSearchFunction defaultKernel()
+    {
+        const SearchKernel preferred[] = { AVX2_SEARCH, SSE_SEARCH, BINARY_SEARCH };
+        for (int i = 0; i < 3; i++)
+        {
+            if (searchKernelSupported(preferred[i]))
+            {
+                currentKernel = preferred[i];
+                break;
+            }
+        }
+        return kernelFunction(currentKernel);
+    }
+
+    IntSearchFunction intSearchKernel = defaultKernel();
+
+    bool setSearchKernel(const SearchKernel kernel)
+    {
+        if (!searchKernelSupported(kernel))
+        {
+            return false;
+        }
+        currentKernel = kernel;
+        intSearchKernel = kernelFunction(kernel);
+        return true;
+    }
+
+    SearchKernel getSearchKernel()
+    {
+        return currentKernel;
+    }
+}
@@ -0,0 +1,104 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <limits>
+
+namespace badgerdb
+{
+
+/**
+ * @brief Kernels available to search the sorted key array of a B+ tree node.
+ */
+enum SearchKernel
+{
+	LINEAR_SEARCH = 0,	/* Scalar scan comparing one key at a time */
+	BINARY_SEARCH = 1,	/* Branchless binary search */
+	SSE_SEARCH = 2,			/* Binary search narrowing to a window counted with 4-wide SSE compares */
+	AVX2_SEARCH = 3			/* Binary search narrowing to a window counted with 8-wide AVX2 compares */
+};
+
+/**
+ * @brief Signature of a search kernel over INTEGER keys. Returns the number of keys in the sorted
+ * array that are smaller than the key searched for, which is the index of the first key >= key.
+ */
+typedef int (*IntSearchFunction)( const int* keys, const int numKeys, const int key );
+
+/**
+ * @brief Kernel currently used by searchLowerBound(). Chosen when the program starts as the
+ * fastest one the processor supports.
+ */
+extern IntSearchFunction intSearchKernel;
+
+/**
+ * @brief Returns the index of the first key in the sorted array that is >= key,
+ * or numKeys if there is none. All traversals of the B+ tree find their position through this.
+ * @param keys		Sorted key array of a node
+ * @param numKeys	Number of keys to search
+ * @param key			Key to search for
+ */
+inline int searchLowerBound( const int* keys, const int numKeys, const int key )
+{
+	return intSearchKernel( keys, numKeys, key );
+}
+
+/**
+ * @brief Returns the index of the first key in the sorted array that is >= key, or numKeys if there
+ * is none, for key types other than INTEGER which have no vectorized kernel.
+ * @param keys		Sorted key array of a node
+ * @param numKeys	Number of keys to search
+ * @param key			Key to search for
+ */
+template <class T>
+inline int searchLowerBound( const T* keys, const int numKeys, const T& key )
+{
+	return std::lower_bound( keys, keys + numKeys, key ) - keys;
+}
+
+/**
+ * @brief Returns the index of the first key in the sorted array that is > key, or numKeys if there is none.
+ * @param keys		Sorted key array of a node
+ * @param numKeys	Number of keys to search
+ * @param key			Key to search for
+ */
+inline int searchUpperBound( const int* keys, const int numKeys, const int key )
+{
+	return key == std::numeric_limits<int>::max() ? numKeys : intSearchKernel( keys, numKeys, key + 1 );
+}
+
+/**
+ * @brief Returns the index of the first key in the sorted array that is > key, or numKeys if there
+ * is none, for key types other than INTEGER.
+ * @param keys		Sorted key array of a node
+ * @param numKeys	Number of keys to search
+ * @param key			Key to search for
+ */
+template <class T>
+inline int searchUpperBound( const T* keys, const int numKeys, const T& key )
+{
+	return std::upper_bound( keys, keys + numKeys, key ) - keys;
+}
+
+/**
+ * @brief Returns whether the processor this runs on supports a search kernel.
+ */
+bool searchKernelSupported( const SearchKernel kernel );
+
+/**
+ * @brief Selects the kernel used by searchLowerBound().
+ * @return False, leaving the current kernel in place, if the processor does not support it
+ */
+bool setSearchKernel( const SearchKernel kernel );
+
+/**
+ * @brief Returns the kernel currently used by searchLowerBound().
+ */
+SearchKernel getSearchKernel();
+
+}